@@ -0,0 +1,227 @@
+// Benchmark for the DBC signal database.
+//
+// Generates a synthetic DBC with the requested number of signals (mixed
+// Intel/Motorola, signed/unsigned, multiplexed) and times how long
+// dbc_database takes to load it and the bundled OBD2 database.
+//
+// Then the payloads of a candump log are decoded with the compiled plans
+// of both databases (every frame against every message, ignoring the id),
+// checked against the bit by bit reference decoder and timed.
+//
+// Finally the log is split into per id columns and decoded signal by
+// signal with the SIMD column kernels and the scalar fallback; both must
+// match the per frame plans exactly.
+//
+//	g++ -std=c++17 -O2 bench_dbc.cpp -o bench_dbc
+//	./bench_dbc [-n signals] [-o synthetic.dbc] [-l candump.log] [OBD2v1.4.dbc]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "dbc.h"
+#include "dbc_decode.h"
+#include "dbc_columns.h"
+using namespace std;
+
+static double ms_since(chrono::steady_clock::time_point t0)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+// Eight signals per message: a multiplexor, four multiplexed signals and
+// three plain ones, plus a comment for every message.
+static bool make_synthetic(const char *out, int signals)
+{
+	FILE *fp = fopen(out, "w");
+	if (!fp)
+		return false;
+	fprintf(fp, "VERSION \"\"\n\nNS_ :\n\tCM_\n\tBA_\n\nBS_:\n\nBU_: ECU TESTER\n\n");
+	int messages = (signals + 7) / 8;
+	for (int m = 0; m < messages; m++) {
+		unsigned id = (m & 1) ? (0x80000000U | (0x18DA0000U + m)) : (0x100 + m % 0x600);
+		fprintf(fp, "BO_ %u MSG_%d: 8 ECU\n", id, m);
+		fprintf(fp, " SG_ MSG_%d_Mux M : 7|4@0+ (1,0) [0|15] \"\" TESTER\n", m);
+		for (int s = 0; s < 4; s++)
+			fprintf(fp, " SG_ MSG_%d_Mux%d m%d : 31|16@0%c (0.25,-40) [-40|16343.75] \"rpm\" TESTER\n",
+				m, s, s, (s & 1) ? '-' : '+');
+		fprintf(fp, " SG_ MSG_%d_Intel : 8|12@1+ (0.1,0) [0|409.5] \"km/h\" TESTER\n", m);
+		fprintf(fp, " SG_ MSG_%d_Flag : 20|1@1+ (1,0) [0|1] \"\" TESTER\n", m);
+		fprintf(fp, " SG_ MSG_%d_Temp : 55|8@0- (1,-40) [-168|87] \"degC\" TESTER\n\n", m);
+	}
+	for (int m = 0; m < messages; m++)
+		fprintf(fp, "CM_ BO_ %d \"Synthetic message %d,\nspanning two lines\";\n", 0x100 + m % 0x600, m);
+	fclose(fp);
+	return true;
+}
+
+static bool time_load(const char *path, dbc_database &db)
+{
+	auto t0 = chrono::steady_clock::now();
+	bool ok = db.load(path);
+	double ms = ms_since(t0);
+	if (!ok) {
+		cout << path << ": " << db.error << " (line " << db.error_line << ")" << endl;
+		return false;
+	}
+	cout << path << ": " << db.signal_count() << " signals in " << db.messages.size()
+	     << " messages loaded in " << ms << " ms" << endl;
+	return true;
+}
+
+// returns the number of mismatches against the reference decoder
+static size_t time_decode(const char *name, const dbc_database &db, const vector<can_frame_rec> &frames)
+{
+	dbc_decoder decoder(db);
+	size_t most = 0;
+	for (auto &plan : decoder.all())
+		most = max(most, plan.size());
+	vector<double> values(most);
+	vector<uint8_t> valid(most);
+
+	// correctness first
+	size_t bad = 0;
+	for (auto &plan : decoder.all()) {
+		for (auto &f : frames) {
+			plan.decode(f, values.data(), valid.data());
+			for (size_t i = 0; i < plan.size(); i++) {
+				bool fits;
+				double ref = dbc_decode_reference(plan.msg->signals[i], f, &fits);
+				if (values[i] != ref && bad++ < 5)
+					cout << "  mismatch " << plan.msg->signals[i].name << ": " << values[i]
+					     << " != " << ref << endl;
+				// multiplexed signals also depend on their switch
+				if (!plan.msg->signals[i].is_multiplexed && (bool)valid[i] != fits &&
+				    bad++ < 5)
+					cout << "  valid mismatch " << plan.msg->signals[i].name << " in a "
+					     << (int)f.len << " byte frame" << endl;
+			}
+		}
+	}
+
+	size_t signals = 0;
+	double sum = 0;
+	auto t0 = chrono::steady_clock::now();
+	for (auto &plan : decoder.all()) {
+		for (auto &f : frames) {
+			plan.decode(f, values.data(), valid.data());
+			sum += values[0];
+		}
+		signals += plan.size() * frames.size();
+	}
+	double plan_ms = ms_since(t0);
+
+	t0 = chrono::steady_clock::now();
+	for (auto &plan : decoder.all())
+		for (auto &f : frames)
+			for (auto &sig : plan.msg->signals)
+				sum += dbc_decode_reference(sig, f);
+	double ref_ms = ms_since(t0);
+
+	cout << name << ": " << signals << " signals decoded, plans " << signals / plan_ms / 1e3
+	     << " Msignals/s, reference " << signals / ref_ms / 1e3 << " Msignals/s, "
+	     << bad << " mismatches (" << (sum != 0) << ")" << endl;
+	return bad;
+}
+
+// returns the number of column values that differ from the per frame plans
+static size_t time_columns(const char *name, const dbc_database &db, const vector<can_frame_rec> &frames)
+{
+	dbc_decoder decoder(db);
+	column_store store;
+	for (auto &f : frames)
+		store.add(f);
+
+	size_t bad = 0;
+	vector<vector<double>> simd, scalar;
+	vector<double> values;
+	vector<uint8_t> valid;
+	for (auto &plan : decoder.all()) {
+		values.resize(plan.size());
+		valid.resize(plan.size());
+		for (auto &col : store.all()) {
+			decode_columns(plan, col, simd, true);
+			decode_columns(plan, col, scalar, false);
+			for (size_t r = 0; r < col.size(); r++) {
+				can_frame_rec f = {};
+				f.ts_usec = col.ts[r];
+				f.len = col.len[r];
+				for (int b = 0; b < 8; b++)
+					f.data[b] = (uint8_t)(col.payload[r] >> (8 * b));
+				plan.decode(f, values.data(), valid.data());
+				for (size_t s = 0; s < plan.size(); s++)
+					if ((simd[s][r] != values[s] || scalar[s][r] != values[s]) && bad++ < 5)
+						cout << "  column mismatch " << plan.msg->signals[s].name << ": "
+						     << simd[s][r] << " / " << scalar[s][r] << " != " << values[s] << endl;
+			}
+		}
+	}
+
+	double ms[2];
+	size_t signals = 0;
+	double sum = 0;
+	for (int pass = 0; pass < 2; pass++) {
+		auto t0 = chrono::steady_clock::now();
+		signals = 0;
+		for (auto &plan : decoder.all()) {
+			for (auto &col : store.all()) {
+				decode_columns(plan, col, simd, pass == 0);
+				sum += simd[0][0];
+				signals += plan.size() * col.size();
+			}
+		}
+		ms[pass] = ms_since(t0);
+	}
+	cout << name << ": " << signals << " column values, simd " << signals / ms[0] / 1e3
+	     << " Msignals/s, scalar " << signals / ms[1] / 1e3 << " Msignals/s, "
+	     << bad << " mismatches (" << (sum != 0) << ")" << endl;
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	int signals = 10000;
+	const char *out = "bench_dbc_synthetic.dbc";
+	const char *obd2 = "OBD2v1.4.dbc";
+	const char *log = "candump-2021-02-13_154133.log";
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			signals = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			out = argv[++i];
+		else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			log = argv[++i];
+		else
+			obd2 = argv[i];
+	}
+
+	if (!make_synthetic(out, signals)) {
+		cerr << "Problem creating " << out << endl;
+		return 1;
+	}
+	dbc_database synthetic, obd2_db;
+	if (!time_load(out, synthetic) || !time_load(obd2, obd2_db))
+		return 1;
+
+	mapped_file log_file(log);
+	if (!log_file.good()) {
+		cerr << "Problem opening " << log << endl;
+		return 1;
+	}
+	vector<can_frame_rec> frames;
+	candump_reader reader(log_file);
+	can_frame_rec f;
+	while (reader.next(f))
+		frames.push_back(f);
+	// keep the synthetic run at a similar size to the OBD2 one
+	vector<can_frame_rec> few(frames.begin(), frames.begin() + min(frames.size(), (size_t)200));
+
+	size_t bad = time_decode(obd2, obd2_db, frames);
+	bad += time_decode(out, synthetic, few);
+	bad += time_columns(obd2, obd2_db, frames);
+	bad += time_columns(out, synthetic, few);
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+// Throughput benchmark for candump log ingestion.
+//
+// Builds a synthetic log by repeating the bundled candump logs (with the
+// timestamps shifted so the result stays monotonic) and then compares the
+// old std::getline + substr loop against the mapped candump_reader.
+//
+// Finally the full per-id analysis is timed with 1, 2, 4 ... threads up to
+// the given maximum.
+//
+//	g++ -std=c++17 -O2 -pthread bench_ingest.cpp -o bench_ingest
+//	./bench_ingest [-s size_mb] [-j max_threads] [-o synthetic.log] [log ...]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include "candump_reader.h"
+#include "can_parallel.h"
+using namespace std;
+
+static double seconds_since(chrono::steady_clock::time_point t0)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+// Append the source logs to out over and over until it reaches target bytes.
+static size_t make_synthetic(const vector<string> &sources, const char *out, size_t target)
+{
+	FILE *fp = fopen(out, "wb");
+	if (!fp)
+		return 0;
+	size_t written = 0;
+	int64_t cursor = -1;	// where the next copy of a source starts
+	char buf[128];
+	while (written < target) {
+		size_t before = written;
+		for (auto &src : sources) {
+			mapped_file in(src.c_str());
+			if (!in.good())
+				continue;
+			candump_reader reader(in);
+			can_frame_rec f;
+			int64_t first = -1, ts = cursor;
+			while (reader.next(f)) {
+				if (first < 0) {
+					first = f.ts_usec;
+					if (cursor < 0)
+						cursor = first;
+				}
+				ts = f.ts_usec - first + cursor;
+				string_view rest = reader.line().substr(reader.line().find(')'));
+				int n = snprintf(buf, sizeof(buf), "(%lld.%06lld",
+						 (long long)(ts / 1000000), (long long)(ts % 1000000));
+				fwrite(buf, 1, n, fp);
+				fwrite(rest.data(), 1, rest.size(), fp);
+				fputc('\n', fp);
+				written += n + rest.size() + 1;
+			}
+			cursor = ts + 1000;
+		}
+		if (written == before)
+			break;
+	}
+	fclose(fp);
+	return written;
+}
+
+int main(int argc, char **argv)
+{
+	size_t size_mb = 256;
+	unsigned max_threads = std::thread::hardware_concurrency();
+	const char *out = "bench_ingest_synthetic.log";
+	vector<string> sources;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			size_mb = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			max_threads = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			out = argv[++i];
+		else
+			sources.push_back(argv[i]);
+	}
+	if (sources.empty()) {
+		sources.push_back("candump-2020-12-27_183804.log");
+		sources.push_back("candump-2021-02-13_154133.log");
+	}
+
+	size_t bytes = make_synthetic(sources, out, size_mb << 20);
+	if (bytes == 0) {
+		cerr << "Problem creating " << out << endl;
+		return 1;
+	}
+	double mb = bytes / 1048576.0;
+	cout << "synthetic log: " << out << " (" << mb << " MB)" << endl;
+
+	// baseline: what main.cpp used to do for every line
+	{
+		auto t0 = chrono::steady_clock::now();
+		ifstream in_file(out);
+		string line, can, can_id, ts, payload;
+		size_t lines = 0, sum = 0;
+		while (getline(in_file, line)) {
+			can = line.substr(20, 4);
+			can_id = line.substr(25, 3);
+			ts = line.substr(1, 17);
+			payload = line.substr(30, 16);
+			sum += can_id[0] + payload.size();
+			lines++;
+		}
+		double s = seconds_since(t0);
+		cout << "getline+substr: " << lines << " lines in " << s << " s, "
+		     << mb / s << " MB/s, " << lines / s / 1e6 << " Mframes/s (" << sum % 10 << ")" << endl;
+	}
+
+	// mapped reader, decoding every field into a can_frame_rec
+	{
+		auto t0 = chrono::steady_clock::now();
+		mapped_file in_file(out);
+		candump_reader reader(in_file);
+		can_frame_rec f;
+		size_t frames = 0;
+		uint64_t sum = 0;
+		while (reader.next(f)) {
+			sum += f.can_id + f.len + frame_payload(f);
+			frames++;
+		}
+		double s = seconds_since(t0);
+		cout << "mapped reader:  " << frames << " frames in " << s << " s, "
+		     << mb / s << " MB/s, " << frames / s / 1e6 << " Mframes/s (" << sum % 10
+		     << "), skipped " << reader.skipped() << endl;
+	}
+
+	// sharded analysis, the serial run is the reference for the speedup
+	{
+		mapped_file in_file(out);
+		double serial = 0;
+		for (unsigned threads = 1; threads <= max(max_threads, 1u); threads *= 2) {
+			auto t0 = chrono::steady_clock::now();
+			log_analysis result;
+			analyze_log(in_file, threads, result);
+			double s = seconds_since(t0);
+			if (threads == 1)
+				serial = s;
+			cout << "analysis -j " << threads << ": " << result.frames << " frames, "
+			     << result.ids.size() << " ids in " << s << " s, " << mb / s
+			     << " MB/s, speedup " << serial / s << endl;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,651 @@
+#ifndef CAN_BINLOG_H
+#define CAN_BINLOG_H
+
+// Binary capture container for candump logs (".cbl").
+//
+// Frames are stored in chunks of up to chunk_frames frames in file order.
+// Inside a chunk the frames are grouped by CAN id and every group is laid
+// out column by column:
+//
+//	seq	u16 per frame, position of the frame within the chunk
+//	ts	zigzag varint per frame, delta to the previous frame of the group
+//		(the first one relative to the chunk base timestamp)
+//	dlc	u8 per frame, length in the low nibble plus BINLOG_* flags
+//	iface	u8 per frame, index into the interface table
+//	data	the payload bytes of all frames back to back
+//
+// The seq column puts the frames back into their original order, so
+// converting to candump text gives the input byte for byte.  After the last
+// chunk an index holds the interface names, the time range and offset of
+// every chunk and, per CAN id, the list of groups holding it.  A reader can
+// therefore jump straight to a time window or to one id.
+//
+// All integers are little endian.
+//
+//	header	"CANBLOG1" u32 version u32 chunk_frames
+//	chunk	u32 'CBCH' u32 frames u32 groups u32 body_bytes
+//		i64 t_base i64 t_min i64 t_max, then the groups:
+//		u32 can_id u32 frames u32 group_bytes, then the columns
+//	index	u32 'CBIX'
+//		u32 n, n * (u8 len, name)			interfaces
+//		u32 n, n * (u64 offset i64 t_min i64 t_max u32 frames)	chunks
+//		u32 n, n * (u32 can_id u64 frames u32 m,
+//			    m * (u32 chunk u32 group offset in the chunk))	ids
+//	trailer	u64 index offset "CBLGEND1"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "candump_reader.h"
+
+#define BINLOG_RTR	0x80	// remote frame
+#define BINLOG_RTR_LEN	0x40	// CANDUMP_RTR_LEN
+#define BINLOG_CRLF	0x20	// CANDUMP_CRLF
+
+namespace binlog_detail {
+
+constexpr char magic[8] = {'C', 'A', 'N', 'B', 'L', 'O', 'G', '1'};
+constexpr char end_magic[8] = {'C', 'B', 'L', 'G', 'E', 'N', 'D', '1'};
+constexpr uint32_t version = 1;
+constexpr uint32_t chunk_magic = 0x48434243;	// "CBCH"
+constexpr uint32_t index_magic = 0x58494243;	// "CBIX"
+constexpr size_t header_size = 16;
+constexpr size_t chunk_header_size = 40;
+constexpr size_t group_header_size = 12;
+constexpr size_t trailer_size = 16;
+
+inline void put(std::vector<uint8_t> &out, uint64_t v, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+inline void put_at(std::vector<uint8_t> &out, size_t pos, uint64_t v, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		out[pos + i] = (uint8_t)(v >> (8 * i));
+}
+
+inline void put_varint(std::vector<uint8_t> &out, int64_t v)
+{
+	uint64_t z = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+	while (z >= 0x80) {
+		out.push_back((uint8_t)(z | 0x80));
+		z >>= 7;
+	}
+	out.push_back((uint8_t)z);
+}
+
+// Bounds checked cursor over a byte range.  Reading past the end sets
+// ok to false and returns zeros, so a damaged file is detected once after a
+// whole structure has been read instead of after every field.
+struct cursor {
+	const uint8_t *p;
+	const uint8_t *e;
+	bool ok = true;
+
+	cursor(const void *b, const void *end) : p((const uint8_t *)b), e((const uint8_t *)end) {}
+
+	uint64_t get(int bytes)
+	{
+		if (e - p < bytes) {
+			ok = false;
+			p = e;
+			return 0;
+		}
+		uint64_t v = 0;
+		for (int i = 0; i < bytes; i++)
+			v |= (uint64_t)p[i] << (8 * i);
+		p += bytes;
+		return v;
+	}
+
+	int64_t varint()
+	{
+		uint64_t z = 0;
+		for (int s = 0; s < 64; s += 7) {
+			if (p == e) {
+				ok = false;
+				return 0;
+			}
+			uint8_t b = *p++;
+			z |= (uint64_t)(b & 0x7F) << s;
+			if (!(b & 0x80))
+				return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+		}
+		ok = false;
+		return 0;
+	}
+
+	const uint8_t *skip(size_t n)
+	{
+		if ((size_t)(e - p) < n) {
+			ok = false;
+			p = e;
+			return nullptr;
+		}
+		const uint8_t *r = p;
+		p += n;
+		return r;
+	}
+};
+
+// the id a frame is grouped under: RTR frames go with the data frames
+inline canid_t group_key(canid_t can_id)
+{
+	return (can_id & CAN_EFF_FLAG) ? (can_id & (CAN_EFF_FLAG | CAN_EFF_MASK)) : (can_id & CAN_SFF_MASK);
+}
+
+} // namespace binlog_detail
+
+// Writes a binary log.  Frames are buffered for one chunk; the index is
+// kept in memory and written by close().
+class binlog_writer {
+public:
+	binlog_writer() {}
+	~binlog_writer() { close(); }
+
+	binlog_writer(const binlog_writer &) = delete;
+	binlog_writer &operator=(const binlog_writer &) = delete;
+
+	bool open(const char *path, uint32_t chunk_frames = 4096)
+	{
+		close();
+		error.clear();
+		if (chunk_frames == 0 || chunk_frames > 65536)
+			return fail("chunk size must be 1..65536 frames");
+		out = fopen(path, "wb");
+		if (!out)
+			return fail(std::string("cannot create ") + path);
+		per_chunk = chunk_frames;
+		offset = 0;
+		ifaces.clear();
+		chunks.clear();
+		ids.clear();
+		pending.clear();
+		std::vector<uint8_t> h(binlog_detail::magic, binlog_detail::magic + 8);
+		binlog_detail::put(h, binlog_detail::version, 4);
+		binlog_detail::put(h, per_chunk, 4);
+		return emit(h);
+	}
+
+	// Append a frame, iface is the name of the interface it was seen on.
+	bool add(const can_frame_rec &f, std::string_view iface)
+	{
+		if (!out)
+			return false;
+		can_frame_rec r = f;
+		int i = interface_index(iface);
+		if (i < 0)
+			return fail("more than 256 interfaces");
+		r.iface = (uint8_t)i;
+		pending.push_back(r);
+		if (pending.size() == per_chunk)
+			return flush();
+		return true;
+	}
+
+	// Write the last chunk and the index.  Returns false if anything failed
+	// since open().
+	bool close()
+	{
+		if (!out)
+			return error.empty();
+		bool ok = flush() && write_index();
+		if (fclose(out) != 0 && ok)
+			ok = fail("write error");
+		out = nullptr;
+		return ok && error.empty();
+	}
+
+	std::string error;
+
+private:
+	struct block {
+		uint32_t chunk;
+		uint32_t offset;	// of the group, from the start of the chunk
+	};
+
+	struct id_entry {
+		uint64_t frames = 0;
+		std::vector<block> blocks;
+	};
+
+	struct chunk_entry {
+		uint64_t offset;
+		int64_t t_min;
+		int64_t t_max;
+		uint32_t frames;
+	};
+
+	int interface_index(std::string_view name)
+	{
+		for (size_t i = 0; i < ifaces.size(); i++)
+			if (ifaces[i] == name)
+				return (int)i;
+		if (ifaces.size() > 255)
+			return -1;
+		ifaces.emplace_back(name);
+		return (int)ifaces.size() - 1;
+	}
+
+	bool flush()
+	{
+		using namespace binlog_detail;
+		if (pending.empty())
+			return true;
+		uint32_t n = (uint32_t)pending.size();
+		order.resize(n);
+		for (uint32_t i = 0; i < n; i++)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+			return group_key(pending[a].can_id) < group_key(pending[b].can_id);
+		});
+
+		chunk_entry c;
+		c.offset = offset;
+		c.t_min = c.t_max = pending[0].ts_usec;
+		c.frames = n;
+		for (auto &f : pending) {
+			c.t_min = std::min(c.t_min, f.ts_usec);
+			c.t_max = std::max(c.t_max, f.ts_usec);
+		}
+		int64_t base = pending[0].ts_usec;
+
+		buf.clear();
+		put(buf, chunk_magic, 4);
+		put(buf, n, 4);
+		put(buf, 0, 4);		// groups
+		put(buf, 0, 4);		// body bytes
+		put(buf, (uint64_t)base, 8);
+		put(buf, (uint64_t)c.t_min, 8);
+		put(buf, (uint64_t)c.t_max, 8);
+		uint32_t groups = 0;
+		for (uint32_t g = 0; g < n;) {
+			canid_t key = group_key(pending[order[g]].can_id);
+			uint32_t end = g;
+			while (end < n && group_key(pending[order[end]].can_id) == key)
+				end++;
+			size_t start = buf.size();
+			put(buf, key, 4);
+			put(buf, end - g, 4);
+			put(buf, 0, 4);	// group bytes
+			for (uint32_t i = g; i < end; i++)
+				put(buf, order[i], 2);
+			int64_t prev = base;
+			for (uint32_t i = g; i < end; i++) {
+				put_varint(buf, pending[order[i]].ts_usec - prev);
+				prev = pending[order[i]].ts_usec;
+			}
+			for (uint32_t i = g; i < end; i++) {
+				const can_frame_rec &f = pending[order[i]];
+				uint8_t d = f.len & 0x0F;
+				if (f.can_id & CAN_RTR_FLAG)
+					d |= BINLOG_RTR;
+				if (f.flags & CANDUMP_RTR_LEN)
+					d |= BINLOG_RTR_LEN;
+				if (f.flags & CANDUMP_CRLF)
+					d |= BINLOG_CRLF;
+				buf.push_back(d);
+			}
+			for (uint32_t i = g; i < end; i++)
+				buf.push_back(pending[order[i]].iface);
+			for (uint32_t i = g; i < end; i++) {
+				const can_frame_rec &f = pending[order[i]];
+				if (!(f.can_id & CAN_RTR_FLAG))
+					buf.insert(buf.end(), f.data, f.data + std::min<uint8_t>(f.len, 8));
+			}
+			put_at(buf, start + 8, buf.size() - start - group_header_size, 4);
+
+			id_entry &e = ids[key];
+			e.frames += end - g;
+			e.blocks.push_back(block{(uint32_t)chunks.size(), (uint32_t)start});
+			groups++;
+			g = end;
+		}
+		put_at(buf, 8, groups, 4);
+		put_at(buf, 12, buf.size() - chunk_header_size, 4);
+		chunks.push_back(c);
+		pending.clear();
+		return emit(buf);
+	}
+
+	bool write_index()
+	{
+		using namespace binlog_detail;
+		uint64_t index_offset = offset;
+		buf.clear();
+		put(buf, index_magic, 4);
+		put(buf, ifaces.size(), 4);
+		for (auto &name : ifaces) {
+			size_t len = std::min<size_t>(name.size(), 255);
+			buf.push_back((uint8_t)len);
+			buf.insert(buf.end(), name.begin(), name.begin() + len);
+		}
+		put(buf, chunks.size(), 4);
+		for (auto &c : chunks) {
+			put(buf, c.offset, 8);
+			put(buf, (uint64_t)c.t_min, 8);
+			put(buf, (uint64_t)c.t_max, 8);
+			put(buf, c.frames, 4);
+		}
+		std::vector<canid_t> keys;
+		keys.reserve(ids.size());
+		for (auto &e : ids)
+			keys.push_back(e.first);
+		std::sort(keys.begin(), keys.end());
+		put(buf, keys.size(), 4);
+		for (canid_t k : keys) {
+			const id_entry &e = ids[k];
+			put(buf, k, 4);
+			put(buf, e.frames, 8);
+			put(buf, e.blocks.size(), 4);
+			for (auto &b : e.blocks) {
+				put(buf, b.chunk, 4);
+				put(buf, b.offset, 4);
+			}
+		}
+		put(buf, index_offset, 8);
+		buf.insert(buf.end(), end_magic, end_magic + 8);
+		return emit(buf);
+	}
+
+	bool emit(const std::vector<uint8_t> &bytes)
+	{
+		if (fwrite(bytes.data(), 1, bytes.size(), out) != bytes.size())
+			return fail("write error");
+		offset += bytes.size();
+		return true;
+	}
+
+	bool fail(const std::string &what)
+	{
+		if (error.empty())
+			error = what;
+		return false;
+	}
+
+	FILE *out = nullptr;
+	uint32_t per_chunk = 4096;
+	uint64_t offset = 0;
+	std::vector<std::string> ifaces;
+	std::vector<chunk_entry> chunks;
+	std::unordered_map<canid_t, id_entry> ids;
+	std::vector<can_frame_rec> pending;
+	std::vector<uint32_t> order;
+	std::vector<uint8_t> buf;
+};
+
+// Reads a binary log.  The file is mapped, only the index is decoded up
+// front; chunks are decoded when they are visited.
+class binlog_reader {
+public:
+	struct chunk_info {
+		uint64_t offset;
+		int64_t t_min;
+		int64_t t_max;
+		uint32_t frames;
+	};
+
+	struct id_info {
+		canid_t can_id;
+		uint64_t frames;
+		size_t first;	// into the block list
+		size_t count;
+	};
+
+	binlog_reader() {}
+	explicit binlog_reader(const char *path) { open(path); }
+
+	// true if the mapped data starts like a binary log
+	static bool is_binlog(const mapped_file &f)
+	{
+		return f.size() >= 8 && memcmp(f.data(), binlog_detail::magic, 8) == 0;
+	}
+
+	bool open(const char *path)
+	{
+		using namespace binlog_detail;
+		error.clear();
+		ifaces.clear();
+		chunk_list.clear();
+		id_list.clear();
+		blocks.clear();
+		if (!file.open(path))
+			return fail(std::string("cannot open ") + path);
+		if (!is_binlog(file) || file.size() < header_size + trailer_size)
+			return fail("not a binary CAN log");
+		cursor h(file.begin() + 8, file.end());
+		if (h.get(4) != version)
+			return fail("unsupported version");
+		const char *tail = file.end() - trailer_size;
+		if (memcmp(tail + 8, end_magic, 8) != 0)
+			return fail("index missing (file not closed?)");
+		cursor t(tail, file.end());
+		uint64_t index_offset = t.get(8);
+		if (index_offset < header_size || index_offset > file.size() - trailer_size)
+			return fail("bad index offset");
+
+		cursor c(file.begin() + index_offset, tail);
+		if (c.get(4) != index_magic)
+			return fail("bad index");
+		uint32_t n = (uint32_t)c.get(4);
+		for (uint32_t i = 0; i < n && c.ok; i++) {
+			size_t len = (size_t)c.get(1);
+			const uint8_t *name = c.skip(len);
+			if (name)
+				ifaces.emplace_back((const char *)name, len);
+		}
+		n = (uint32_t)c.get(4);
+		for (uint32_t i = 0; i < n && c.ok; i++) {
+			chunk_info ci;
+			ci.offset = c.get(8);
+			ci.t_min = (int64_t)c.get(8);
+			ci.t_max = (int64_t)c.get(8);
+			ci.frames = (uint32_t)c.get(4);
+			if (ci.offset >= index_offset)
+				return fail("bad chunk offset");
+			chunk_list.push_back(ci);
+		}
+		n = (uint32_t)c.get(4);
+		for (uint32_t i = 0; i < n && c.ok; i++) {
+			id_info id;
+			id.can_id = (canid_t)c.get(4);
+			id.frames = c.get(8);
+			id.count = (size_t)c.get(4);
+			id.first = blocks.size();
+			for (size_t b = 0; b < id.count && c.ok; b++) {
+				uint32_t chunk = (uint32_t)c.get(4);
+				uint32_t off = (uint32_t)c.get(4);
+				if (chunk >= chunk_list.size())
+					return fail("bad id index");
+				blocks.push_back(std::make_pair(chunk, off));
+			}
+			id_list.push_back(id);
+		}
+		if (!c.ok)
+			return fail("truncated index");
+		return true;
+	}
+
+	bool good() const { return error.empty() && file.good(); }
+	const std::vector<std::string> &interfaces() const { return ifaces; }
+	std::string_view interface_name(const can_frame_rec &f) const
+	{
+		return f.iface < ifaces.size() ? std::string_view(ifaces[f.iface]) : std::string_view("?");
+	}
+	const std::vector<chunk_info> &chunks() const { return chunk_list; }
+	// every id in the log, ascending
+	const std::vector<id_info> &ids() const { return id_list; }
+
+	uint64_t frames() const
+	{
+		uint64_t n = 0;
+		for (auto &c : chunk_list)
+			n += c.frames;
+		return n;
+	}
+
+	// Call fn(const can_frame_rec &) for every frame with from <= ts < to,
+	// in the original order.  Only chunks overlapping the window are read.
+	template <typename F>
+	bool scan(F fn, int64_t from = INT64_MIN, int64_t to = INT64_MAX)
+	{
+		std::vector<can_frame_rec> frames;
+		for (size_t i = 0; i < chunk_list.size(); i++) {
+			const chunk_info &ci = chunk_list[i];
+			if (ci.t_max < from || ci.t_min >= to)
+				continue;
+			if (!decode_chunk(ci, frames))
+				return false;
+			for (auto &f : frames)
+				if (f.ts_usec >= from && f.ts_usec < to)
+					fn(f);
+		}
+		return true;
+	}
+
+	// Call fn for every frame of one CAN id (CAN_EFF_FLAG set for 29 bit
+	// ids) with from <= ts < to, in the original order.  Only the groups
+	// of that id are read.
+	template <typename F>
+	bool scan_id(canid_t can_id, F fn, int64_t from = INT64_MIN, int64_t to = INT64_MAX)
+	{
+		canid_t key = binlog_detail::group_key(can_id);
+		auto it = std::lower_bound(id_list.begin(), id_list.end(), key,
+					   [](const id_info &a, canid_t k) { return a.can_id < k; });
+		if (it == id_list.end() || it->can_id != key)
+			return true;
+		std::vector<can_frame_rec> frames;
+		std::vector<uint16_t> seq;
+		for (size_t b = it->first; b < it->first + it->count; b++) {
+			const chunk_info &ci = chunk_list[blocks[b].first];
+			if (ci.t_max < from || ci.t_min >= to)
+				continue;
+			const uint8_t *chunk = (const uint8_t *)file.begin() + ci.offset;
+			binlog_detail::cursor c(chunk, file.end());
+			c.skip(blocks[b].second);
+			int64_t base = chunk_base(ci);
+			frames.clear();
+			seq.clear();
+			if (!decode_group(c, base, frames, seq))
+				return fail("damaged chunk");
+			// frames of one id are already in file order within a group
+			for (auto &f : frames)
+				if (f.ts_usec >= from && f.ts_usec < to)
+					fn(f);
+		}
+		return true;
+	}
+
+	std::string error;
+
+private:
+	int64_t chunk_base(const chunk_info &ci) const
+	{
+		binlog_detail::cursor c(file.begin() + ci.offset + 16, file.end());
+		return (int64_t)c.get(8);
+	}
+
+	bool decode_chunk(const chunk_info &ci, std::vector<can_frame_rec> &out)
+	{
+		using namespace binlog_detail;
+		cursor c(file.begin() + ci.offset, file.end());
+		if (c.get(4) != chunk_magic)
+			return fail("bad chunk");
+		uint32_t n = (uint32_t)c.get(4);
+		uint32_t groups = (uint32_t)c.get(4);
+		c.get(4);
+		int64_t base = (int64_t)c.get(8);
+		c.get(16);
+		if (!c.ok || n != ci.frames)
+			return fail("bad chunk");
+		out.assign(n, can_frame_rec());
+		std::vector<can_frame_rec> frames;
+		std::vector<uint16_t> seq;
+		size_t seen = 0;
+		for (uint32_t g = 0; g < groups; g++) {
+			frames.clear();
+			seq.clear();
+			if (!decode_group(c, base, frames, seq))
+				return fail("damaged chunk");
+			for (size_t i = 0; i < frames.size(); i++) {
+				if (seq[i] >= n)
+					return fail("damaged chunk");
+				out[seq[i]] = frames[i];
+			}
+			seen += frames.size();
+		}
+		if (seen != n)
+			return fail("damaged chunk");
+		return true;
+	}
+
+	// decode the group at the cursor, appending to frames / seq
+	static bool decode_group(binlog_detail::cursor &c, int64_t base,
+				 std::vector<can_frame_rec> &frames, std::vector<uint16_t> &seq)
+	{
+		using namespace binlog_detail;
+		canid_t key = (canid_t)c.get(4);
+		uint32_t n = (uint32_t)c.get(4);
+		uint32_t bytes = (uint32_t)c.get(4);
+		const uint8_t *body = c.skip(bytes);
+		if (!c.ok || n > 65536)
+			return false;
+		cursor g(body, body + bytes);
+		size_t first = frames.size();
+		frames.resize(first + n);
+		for (uint32_t i = 0; i < n; i++)
+			seq.push_back((uint16_t)g.get(2));
+		int64_t ts = base;
+		for (uint32_t i = 0; i < n; i++) {
+			can_frame_rec &f = frames[first + i];
+			memset(&f, 0, sizeof(f));
+			ts += g.varint();
+			f.ts_usec = ts;
+		}
+		const uint8_t *dlc = g.skip(n);
+		const uint8_t *iface = g.skip(n);
+		if (!g.ok)
+			return false;
+		for (uint32_t i = 0; i < n; i++) {
+			can_frame_rec &f = frames[first + i];
+			f.can_id = key;
+			f.len = dlc[i] & 0x0F;
+			f.iface = iface[i];
+			if (dlc[i] & BINLOG_CRLF)
+				f.flags |= CANDUMP_CRLF;
+			if (dlc[i] & BINLOG_RTR) {
+				f.can_id |= CAN_RTR_FLAG;
+				if (dlc[i] & BINLOG_RTR_LEN)
+					f.flags |= CANDUMP_RTR_LEN;
+			} else {
+				const uint8_t *d = g.skip(std::min<uint8_t>(f.len, 8));
+				if (!d)
+					return false;
+				memcpy(f.data, d, std::min<uint8_t>(f.len, 8));
+			}
+		}
+		return g.ok;
+	}
+
+	bool fail(const std::string &what)
+	{
+		if (error.empty())
+			error = what;
+		return false;
+	}
+
+	mapped_file file;
+	std::vector<std::string> ifaces;
+	std::vector<chunk_info> chunk_list;
+	std::vector<id_info> id_list;
+	std::vector<std::pair<uint32_t, uint32_t>> blocks;	// chunk, group offset
+};
+
+#endif // CAN_BINLOG_H
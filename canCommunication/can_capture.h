@@ -0,0 +1,287 @@
+#ifndef CAN_CAPTURE_H
+#define CAN_CAPTURE_H
+
+// SocketCAN capture engine (Linux only).
+//
+// One raw CAN socket is bound per interface.  Frames are pulled with
+// recvmmsg() in batches, so a busy bus costs one system call per batch
+// instead of one per frame.  Every frame carries the kernel receive
+// timestamp (SO_TIMESTAMPING, the hardware time if the driver provides
+// one) and the socket's drop counter (SO_RXQ_OVFL).  Frames are handed out
+// as can_frame_rec, the same record the log readers produce, so they can
+// go straight into an id_table.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+#include "candump_reader.h"
+
+class can_capture {
+public:
+	static constexpr unsigned max_batch = 256;
+
+	can_capture() {}
+	~can_capture() { close(); }
+
+	can_capture(const can_capture &) = delete;
+	can_capture &operator=(const can_capture &) = delete;
+
+	// Bind to every interface in names.  batch is the number of frames
+	// fetched per recvmmsg() call, rcvbuf (bytes, 0 = system default) the
+	// socket receive buffer.
+	bool open(const std::vector<std::string> &names, unsigned batch = 64, int rcvbuf = 0)
+	{
+		close();
+		error.clear();
+		if (names.empty() || names.size() > 256)
+			return fail("need 1 to 256 interfaces");
+		if (batch == 0 || batch > max_batch)
+			return fail("batch size must be 1..256");
+		for (auto &name : names) {
+			port p;
+			p.name = name;
+			p.fd = open_socket(name, rcvbuf);
+			if (p.fd < 0) {
+				close();
+				return false;
+			}
+			ports.push_back(p);
+			pfds.push_back(pollfd{p.fd, POLLIN, 0});
+		}
+		setup_batch(batch);
+		return true;
+	}
+
+	void close()
+	{
+		for (auto &p : ports)
+			::close(p.fd);
+		ports.clear();
+		pfds.clear();
+	}
+
+	// Wait up to timeout_ms for frames and call fn(const can_frame_rec &)
+	// for each one received.  Returns the number of frames, -1 on an error
+	// (a signal is not an error, it returns 0).
+	template <typename F>
+	int poll(F fn, int timeout_ms)
+	{
+		int r = ::poll(pfds.data(), pfds.size(), timeout_ms);
+		if (r < 0)
+			return errno == EINTR ? 0 : fail_errno("poll");
+		int total = 0;
+		for (size_t i = 0; i < ports.size() && r > 0; i++) {
+			if (!pfds[i].revents)
+				continue;
+			r--;
+			if (pfds[i].revents & (POLLERR | POLLNVAL | POLLHUP))
+				return fail("interface " + ports[i].name + " went away");
+			int n = receive(i, fn);
+			if (n < 0)
+				return -1;
+			total += n;
+		}
+		return total;
+	}
+
+	std::vector<std::string> interfaces() const
+	{
+		std::vector<std::string> names;
+		for (auto &p : ports)
+			names.push_back(p.name);
+		return names;
+	}
+
+	uint64_t frames() const { return rx_frames; }
+	uint64_t batches() const { return rx_batches; }
+	// error frames (CAN_ERR_FLAG), counted but not passed on
+	uint64_t error_frames() const { return rx_errors; }
+
+	// frames the kernel dropped because a socket queue was full
+	uint64_t drops() const
+	{
+		uint64_t n = 0;
+		for (auto &p : ports)
+			n += p.drops;
+		return n;
+	}
+
+	std::string error;
+
+private:
+	struct port {
+		std::string name;
+		int fd = -1;
+		uint32_t drops = 0;	// last SO_RXQ_OVFL value
+	};
+
+	// room for the control messages we ask for
+	static constexpr size_t control_size =
+		CMSG_SPACE(sizeof(struct scm_timestamping)) + CMSG_SPACE(sizeof(uint32_t)) +
+		CMSG_SPACE(sizeof(struct timeval));
+
+	int open_socket(const std::string &name, int rcvbuf)
+	{
+		int s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+		if (s < 0) {
+			fail_errno("socket");
+			return -1;
+		}
+		struct ifreq ifr;
+		memset(&ifr, 0, sizeof(ifr));
+		strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+		if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+			fail_errno(name);
+			::close(s);
+			return -1;
+		}
+		struct sockaddr_can addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.can_family = AF_CAN;
+		addr.can_ifindex = ifr.ifr_ifindex;
+		if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			fail_errno("bind " + name);
+			::close(s);
+			return -1;
+		}
+
+		// error frames are counted, not decoded
+		can_err_mask_t err_mask = CAN_ERR_MASK;
+		setsockopt(s, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask));
+		int one = 1;
+		setsockopt(s, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+		int stamping = SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE |
+			       SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+		if (setsockopt(s, SOL_SOCKET, SO_TIMESTAMPING, &stamping, sizeof(stamping)) < 0)
+			setsockopt(s, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one));
+		if (rcvbuf > 0 && setsockopt(s, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0)
+			setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+		return s;
+	}
+
+	void setup_batch(unsigned batch)
+	{
+		frames_buf.assign(batch, can_frame());
+		iov.resize(batch);
+		msgs.assign(batch, mmsghdr());
+		control.assign(batch * control_size, 0);
+		for (unsigned i = 0; i < batch; i++) {
+			iov[i].iov_base = &frames_buf[i];
+			iov[i].iov_len = sizeof(can_frame);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+	}
+
+	// drain what one socket has queued, at most one batch per call so a
+	// busy interface does not starve the others
+	template <typename F>
+	int receive(size_t i, F fn)
+	{
+		port &p = ports[i];
+		for (size_t m = 0; m < msgs.size(); m++) {
+			msgs[m].msg_hdr.msg_control = &control[m * control_size];
+			msgs[m].msg_hdr.msg_controllen = control_size;
+		}
+		int n = recvmmsg(p.fd, msgs.data(), (unsigned)msgs.size(), MSG_DONTWAIT, nullptr);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return 0;
+			return fail_errno("recvmmsg " + p.name);
+		}
+		rx_batches++;
+		int passed = 0;
+		for (int m = 0; m < n; m++) {
+			const can_frame &cf = frames_buf[m];
+			if (msgs[m].msg_len < sizeof(can_frame))
+				continue;
+			if (cf.can_id & CAN_ERR_FLAG) {
+				rx_errors++;
+				continue;
+			}
+			can_frame_rec f;
+			f.ts_usec = timestamp(msgs[m].msg_hdr, p);
+			f.can_id = cf.can_id;
+			f.len = cf.can_dlc > 8 ? 8 : cf.can_dlc;
+			f.iface = (uint8_t)i;
+			f.flags = 0;
+			f.reserved = 0;
+			memcpy(f.data, cf.data, sizeof(f.data));
+			if ((cf.can_id & CAN_RTR_FLAG) && f.len)
+				f.flags |= CANDUMP_RTR_LEN;
+			fn(f);
+			passed++;
+		}
+		rx_frames += passed;
+		return passed;
+	}
+
+	// kernel receive time in usec, also picks up the drop counter
+	static int64_t timestamp(const msghdr &h, port &p)
+	{
+		int64_t ts = -1;
+		for (cmsghdr *c = CMSG_FIRSTHDR(&h); c; c = CMSG_NXTHDR((msghdr *)&h, c)) {
+			if (c->cmsg_level != SOL_SOCKET)
+				continue;
+			if (c->cmsg_type == SO_TIMESTAMPING) {
+				struct scm_timestamping st;
+				memcpy(&st, CMSG_DATA(c), sizeof(st));
+				// ts[2] is the raw hardware time, ts[0] the software one
+				const struct timespec &t = (st.ts[2].tv_sec || st.ts[2].tv_nsec) ? st.ts[2] : st.ts[0];
+				ts = (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+			} else if (c->cmsg_type == SO_TIMESTAMP) {
+				struct timeval tv;
+				memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+				ts = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+			} else if (c->cmsg_type == SO_RXQ_OVFL) {
+				memcpy(&p.drops, CMSG_DATA(c), sizeof(p.drops));
+			}
+		}
+		if (ts < 0) {
+			struct timespec now;
+			clock_gettime(CLOCK_REALTIME, &now);
+			ts = (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+		}
+		return ts;
+	}
+
+	bool fail(const std::string &what)
+	{
+		error = what;
+		return false;
+	}
+
+	int fail_errno(const std::string &what)
+	{
+		error = what + ": " + strerror(errno);
+		return -1;
+	}
+
+	std::vector<port> ports;
+	std::vector<pollfd> pfds;
+	std::vector<can_frame> frames_buf;
+	std::vector<iovec> iov;
+	std::vector<mmsghdr> msgs;
+	std::vector<char> control;
+	uint64_t rx_frames = 0;
+	uint64_t rx_batches = 0;
+	uint64_t rx_errors = 0;
+};
+
+#endif // CAN_CAPTURE_H
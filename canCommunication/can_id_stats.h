@@ -0,0 +1,298 @@
+#ifndef CAN_ID_STATS_H
+#define CAN_ID_STATS_H
+
+// Per CAN id statistics, updated in O(1) for every frame.
+//
+// 11 bit ids live in a dense table indexed by the id itself, 29 bit ids in
+// an open addressing hash keyed on the numeric canid_t.  All sums are kept
+// as integers so the derived values do not depend on the order frames are
+// added in.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "candump_reader.h"
+
+// Unsigned 128 bit sum of squares in two 64 bit halves.  unsigned __int128
+// would do, but MSVC has no such type.
+struct square_sum {
+	uint64_t lo = 0;
+	uint64_t hi = 0;
+
+	void add(uint64_t h, uint64_t l)
+	{
+		lo += l;
+		hi += h + (lo < l);
+	}
+
+	// add a * a, multiplied out in 32 bit halves
+	void add_square(uint64_t a)
+	{
+		uint64_t al = a & 0xFFFFFFFFu, ah = a >> 32;
+		uint64_t cross = ah * al;
+		uint64_t l = al * al, h = ah * ah + (cross >> 31);
+		uint64_t c = cross << 33;
+		l += c;
+		h += l < c;
+		add(h, l);
+	}
+
+	void add(const square_sum &other) { add(other.hi, other.lo); }
+
+	long double value() const
+	{
+		return (long double)hi * 18446744073709551616.0L + (long double)lo;
+	}
+};
+
+struct id_stats {
+	canid_t can_id = 0;		// key, CAN_EFF_FLAG set for 29 bit ids
+	uint64_t count = 0;		// number of frames, 0 marks an unused slot
+	int64_t first_ts = 0;		// timestamp of the first and last frame (usec)
+	int64_t last_ts = 0;
+	int64_t min_period = INT64_MAX;	// inter-arrival period (usec)
+	int64_t max_period = INT64_MIN;
+	int64_t period_sum = 0;
+	square_sum period_sq;		// sum of squared periods, for the jitter
+	uint64_t payload_changes = 0;	// frames whose payload differs from the previous one
+	uint64_t first_payload = 0;
+	uint64_t last_payload = 0;
+	uint8_t first_len = 0;
+	uint8_t last_len = 0;
+
+	uint64_t periods() const { return count > 1 ? count - 1 : 0; }
+
+	double mean_period() const
+	{
+		return periods() ? (double)period_sum / periods() : 0.0;
+	}
+
+	// standard deviation of the inter-arrival period
+	double jitter() const
+	{
+		if (!periods())
+			return 0.0;
+		long double n = periods();
+		long double mean = period_sum / n;
+		long double var = period_sq.value() / n - mean * mean;
+		return var > 0 ? (double)std::sqrt(var) : 0.0;
+	}
+
+	void add(int64_t ts, uint64_t payload, uint8_t len)
+	{
+		if (count++ == 0) {
+			first_ts = last_ts = ts;
+			first_payload = last_payload = payload;
+			first_len = last_len = len;
+			return;
+		}
+		add_period(ts - last_ts);
+		if (payload != last_payload || len != last_len)
+			payload_changes++;
+		last_ts = ts;
+		last_payload = payload;
+		last_len = len;
+	}
+
+	void add_period(int64_t p)
+	{
+		if (p < min_period)
+			min_period = p;
+		if (p > max_period)
+			max_period = p;
+		period_sum += p;
+		uint64_t a = p < 0 ? -(uint64_t)p : (uint64_t)p;
+		period_sq.add_square(a);
+	}
+
+	// Fold in the statistics of the same id from a later stretch of the
+	// log.  The gap between the two stretches becomes one more period, so
+	// the result is the same as if all frames had been added here.
+	void merge(const id_stats &later)
+	{
+		if (later.count == 0)
+			return;
+		if (count == 0) {
+			*this = later;
+			return;
+		}
+		add_period(later.first_ts - last_ts);
+		if (later.first_payload != last_payload || later.first_len != last_len)
+			payload_changes++;
+		if (later.min_period < min_period)
+			min_period = later.min_period;
+		if (later.max_period > max_period)
+			max_period = later.max_period;
+		period_sum += later.period_sum;
+		period_sq.add(later.period_sq);
+		payload_changes += later.payload_changes;
+		count += later.count;
+		last_ts = later.last_ts;
+		last_payload = later.last_payload;
+		last_len = later.last_len;
+	}
+};
+
+// Aggregation table for all ids seen on a bus.
+class id_table {
+public:
+	id_table() : sff(CAN_SFF_MASK + 1), eff(64)
+	{
+		for (canid_t i = 0; i <= CAN_SFF_MASK; i++)
+			sff[i].can_id = i;
+	}
+
+	// the key used for a frame: the id plus the EFF flag, RTR frames are
+	// counted with the data frames of the same id
+	static canid_t key(canid_t can_id)
+	{
+		return (can_id & CAN_EFF_FLAG) ? (can_id & (CAN_EFF_FLAG | CAN_EFF_MASK))
+					       : (can_id & CAN_SFF_MASK);
+	}
+
+	void add(const can_frame_rec &f)
+	{
+		canid_t k = key(f.can_id);
+		if ((k & CAN_EFF_FLAG) && eff_used >= eff_limit && !find(k)) {
+			overflow++;
+			return;
+		}
+		lookup(k).add(f.ts_usec, frame_payload(f), f.len);
+	}
+
+	// Cap the number of distinct 29 bit ids add() will track, frames of
+	// further ids are only counted in overflow().  Keeps the table bounded
+	// on long runs; the 11 bit table has a fixed size anyway.
+	void set_eff_limit(size_t n) { eff_limit = n; }
+	size_t get_eff_limit() const { return eff_limit; }
+	uint64_t overflow_frames() const { return overflow; }
+
+	// find the slot for an id, creating it if necessary
+	id_stats &lookup(canid_t k)
+	{
+		if (!(k & CAN_EFF_FLAG))
+			return sff[k];
+		size_t mask = eff.size() - 1;
+		size_t i = hash(k) & mask;
+		while (eff[i].can_id != 0) {
+			if (eff[i].can_id == k)
+				return eff[i];
+			i = (i + 1) & mask;
+		}
+		// keep the load factor below one half
+		if ((eff_used + 1) * 2 > eff.size()) {
+			grow();
+			return lookup(k);
+		}
+		eff[i].can_id = k;
+		eff_used++;
+		return eff[i];
+	}
+
+	// merge a table built from the part of the log that follows this one,
+	// 29 bit ids new to this table are subject to the same limit as in add()
+	void merge(const id_table &later)
+	{
+		for (auto &s : later.sff)
+			if (s.count)
+				sff[s.can_id].merge(s);
+		for (auto &s : later.eff) {
+			if (!s.count)
+				continue;
+			if (eff_used >= eff_limit && !find(s.can_id)) {
+				overflow += s.count;
+				continue;
+			}
+			lookup(s.can_id).merge(s);
+		}
+		overflow += later.overflow;
+	}
+
+	const id_stats *find(canid_t k) const
+	{
+		if (!(k & CAN_EFF_FLAG))
+			return sff[k].count ? &sff[k] : nullptr;
+		size_t mask = eff.size() - 1;
+		for (size_t i = hash(k) & mask; eff[i].can_id != 0; i = (i + 1) & mask)
+			if (eff[i].can_id == k)
+				return &eff[i];
+		return nullptr;
+	}
+
+	// number of distinct ids
+	size_t size() const
+	{
+		size_t n = eff_used;
+		for (auto &s : sff)
+			n += s.count != 0;
+		return n;
+	}
+
+	// all used slots, 11 bit ids first, each group in ascending order
+	std::vector<const id_stats *> sorted() const
+	{
+		std::vector<const id_stats *> out;
+		out.reserve(size());
+		for (auto &s : sff)
+			if (s.count)
+				out.push_back(&s);
+		size_t n = out.size();
+		for (auto &s : eff)
+			if (s.count)
+				out.push_back(&s);
+		std::sort(out.begin() + n, out.end(),
+			  [](const id_stats *a, const id_stats *b) { return a->can_id < b->can_id; });
+		return out;
+	}
+
+private:
+	static size_t hash(canid_t k) { return (size_t)((k * 0x9E3779B1U) >> 7); }
+
+	void grow()
+	{
+		std::vector<id_stats> old(eff.size() * 2);
+		old.swap(eff);
+		size_t mask = eff.size() - 1;
+		for (auto &s : old) {
+			if (s.can_id == 0)
+				continue;
+			size_t i = hash(s.can_id) & mask;
+			while (eff[i].can_id != 0)
+				i = (i + 1) & mask;
+			eff[i] = s;
+		}
+	}
+
+	std::vector<id_stats> sff;	// indexed by the 11 bit id
+	std::vector<id_stats> eff;	// open addressing, linear probing
+	size_t eff_used = 0;
+	size_t eff_limit = SIZE_MAX;
+	uint64_t overflow = 0;		// frames of ids beyond eff_limit
+};
+
+// one line per CAN id, periods in milliseconds
+inline void print_stats(const id_table &car_log)
+{
+	printf("%-8s %10s %10s %10s %10s %10s %10s\n",
+	       "ID", "count", "min ms", "max ms", "mean ms", "jitter ms", "changes");
+	for (const id_stats *st : car_log.sorted()) {
+		if (st->can_id & CAN_EFF_FLAG)
+			printf("%08X", st->can_id & CAN_EFF_MASK);
+		else
+			printf("%03X     ", st->can_id);
+		if (st->periods())
+			printf(" %10llu %10.3f %10.3f %10.3f %10.3f %10llu\n",
+			       (unsigned long long)st->count,
+			       st->min_period / 1000.0, st->max_period / 1000.0,
+			       st->mean_period() / 1000.0, st->jitter() / 1000.0,
+			       (unsigned long long)st->payload_changes);
+		else
+			printf(" %10llu %10s %10s %10s %10s %10llu\n",
+			       (unsigned long long)st->count, "-", "-", "-", "-",
+			       (unsigned long long)st->payload_changes);
+	}
+}
+
+#endif // CAN_ID_STATS_H
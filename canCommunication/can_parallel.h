@@ -0,0 +1,87 @@
+#ifndef CAN_PARALLEL_H
+#define CAN_PARALLEL_H
+
+// Sharded analysis of a mapped candump log.
+//
+// The file is cut into newline aligned byte ranges, every worker thread
+// builds its own id_table for its range and the tables are merged in file
+// order afterwards.  Because id_stats::merge() stitches the periods across
+// the shard boundaries the result is identical to a serial run.
+
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "candump_reader.h"
+#include "can_id_stats.h"
+
+struct log_analysis {
+	id_table ids;
+	size_t frames = 0;
+	size_t skipped = 0;
+
+	void merge(const log_analysis &later)
+	{
+		ids.merge(later.ids);
+		frames += later.frames;
+		skipped += later.skipped;
+	}
+};
+
+// Cut [begin, end) into at most parts ranges, each ending after a newline.
+inline std::vector<std::pair<const char *, const char *>>
+split_lines(const char *begin, const char *end, unsigned parts)
+{
+	std::vector<std::pair<const char *, const char *>> ranges;
+	size_t size = end - begin;
+	const char *start = begin;
+	for (unsigned i = 1; i <= parts && start < end; i++) {
+		const char *stop = (i == parts) ? end : begin + size / parts * i;
+		if (stop <= start)
+			continue;
+		if (stop < end) {
+			const char *nl = (const char *)memchr(stop, '\n', end - stop);
+			stop = nl ? nl + 1 : end;
+		}
+		ranges.push_back(std::make_pair(start, stop));
+		start = stop;
+	}
+	return ranges;
+}
+
+inline void analyze_range(const char *begin, const char *end, log_analysis &out)
+{
+	candump_reader reader(begin, end);
+	can_frame_rec frame;
+	while (reader.next(frame)) {
+		out.ids.add(frame);
+		out.frames++;
+	}
+	out.skipped += reader.skipped();
+}
+
+// Analyze a whole log with the given number of threads (0 = one per core).
+inline void analyze_log(const mapped_file &file, unsigned threads, log_analysis &out)
+{
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	// small files are not worth the thread start up
+	if (threads <= 1 || file.size() < ((size_t)1 << 20)) {
+		analyze_range(file.begin(), file.end(), out);
+		return;
+	}
+
+	auto ranges = split_lines(file.begin(), file.end(), threads);
+	std::vector<log_analysis> shards(ranges.size());
+	for (auto &shard : shards)
+		shard.ids.set_eff_limit(out.ids.get_eff_limit());
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < ranges.size(); i++)
+		workers.emplace_back(analyze_range, ranges[i].first, ranges[i].second, std::ref(shards[i]));
+	for (auto &w : workers)
+		w.join();
+	for (auto &shard : shards)
+		out.merge(shard);
+}
+
+#endif // CAN_PARALLEL_H
@@ -0,0 +1,205 @@
+#ifndef CAN_RESAMPLE_H
+#define CAN_RESAMPLE_H
+
+// Aligns decoded signal streams onto a common time grid.
+//
+// Every signal keeps its recent samples in a fixed size ring.  Grid rows
+// (multiples of the period) are produced incrementally: a row at time t is
+// emitted once the input has moved past t + delay (the watermark), so the
+// resampler can sit on a live stream and hands out rows as it goes.  Per
+// signal, the value at t is
+//
+//	last	the latest sample at or before t
+//	linear	interpolated between the samples around t; if the next sample
+//		has not arrived within the delay the last value is held
+//	mean	the mean of the samples in (t - period, t]
+//
+// Samples older than the newest one of their signal, or older than a row
+// already emitted, are dropped and counted, as are samples pushed out of a
+// full ring.  Memory is the ring capacity times the number of signals.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum resample_policy { RESAMPLE_LAST, RESAMPLE_LINEAR, RESAMPLE_MEAN };
+
+// Fixed capacity ring of timestamped samples, oldest first.
+class sample_ring {
+public:
+	struct sample {
+		int64_t ts;
+		double value;
+	};
+
+	explicit sample_ring(size_t capacity = 256)
+	{
+		size_t n = 1;
+		while (n < capacity)
+			n <<= 1;
+		buf.resize(n);
+		mask = n - 1;
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	bool full() const { return count == buf.size(); }
+	const sample &operator[](size_t i) const { return buf[(head + i) & mask]; }
+	const sample &back() const { return (*this)[count - 1]; }
+
+	// append, overwriting the oldest sample when full; false if one was lost
+	bool push(int64_t ts, double value)
+	{
+		bool lost = full();
+		if (lost)
+			pop();
+		buf[(head + count) & mask] = sample{ts, value};
+		count++;
+		return !lost;
+	}
+
+	void pop()
+	{
+		head = (head + 1) & mask;
+		count--;
+	}
+
+private:
+	std::vector<sample> buf;
+	size_t mask = 0;
+	size_t head = 0;
+	size_t count = 0;
+};
+
+class resampler {
+public:
+	// period and delay in usec, delay 0 means one period
+	resampler(int64_t period_usec, int64_t delay_usec = 0, size_t ring_capacity = 256)
+		: period(period_usec > 0 ? period_usec : 1), delay(delay_usec > 0 ? delay_usec : period),
+		  capacity(ring_capacity)
+	{
+	}
+
+	// register a signal, returns its column
+	size_t add_signal(const std::string &name, resample_policy policy)
+	{
+		signals.push_back(channel{name, policy, sample_ring(capacity), INT64_MIN});
+		values.push_back(0.0);
+		valid.push_back(0);
+		return signals.size() - 1;
+	}
+
+	size_t size() const { return signals.size(); }
+	const std::string &name(size_t column) const { return signals[column].name; }
+
+	// Add a sample of one signal.  Samples of a signal must come in time
+	// order, the signals may be interleaved in any way.
+	void push(size_t column, int64_t ts, double value)
+	{
+		channel &c = signals[column];
+		if (ts < c.newest || ts <= last_row) {
+			late++;
+			return;
+		}
+		c.newest = ts;
+		if (!c.ring.push(ts, value))
+			overruns++;
+		if (!started) {
+			// the first row is the first grid point at or after the first sample
+			next = floor_div(ts + period - 1, period) * period;
+			started = true;
+		}
+	}
+
+	// Emit every row at or before watermark - delay.  fn(t, values, valid)
+	// gets the row time and one value / valid flag per column.
+	template <typename F>
+	void advance(int64_t watermark, F fn)
+	{
+		while (started && next <= watermark - delay)
+			emit(fn);
+	}
+
+	// Emit the remaining rows up to the newest sample (end of input).
+	template <typename F>
+	void flush(F fn)
+	{
+		int64_t newest = INT64_MIN;
+		for (auto &c : signals)
+			if (c.newest > newest)
+				newest = c.newest;
+		while (started && next - period < newest)
+			emit(fn);
+	}
+
+	// samples dropped because they came too late or a ring was full
+	uint64_t late_samples() const { return late; }
+	uint64_t overrun_samples() const { return overruns; }
+
+private:
+	struct channel {
+		std::string name;
+		resample_policy policy;
+		sample_ring ring;
+		int64_t newest;		// timestamp of the latest sample
+	};
+
+	static int64_t floor_div(int64_t a, int64_t b)
+	{
+		int64_t q = a / b;
+		return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+	}
+
+	template <typename F>
+	void emit(F fn)
+	{
+		int64_t t = next;
+		for (size_t i = 0; i < signals.size(); i++)
+			valid[i] = value_at(signals[i], t, values[i]);
+		fn(t, values.data(), valid.data());
+		last_row = t;
+		next += period;
+	}
+
+	bool value_at(channel &c, int64_t t, double &v)
+	{
+		sample_ring &r = c.ring;
+		if (c.policy == RESAMPLE_MEAN) {
+			while (!r.empty() && r[0].ts <= t - period)
+				r.pop();
+			double sum = 0;
+			size_t n = 0;
+			for (; n < r.size() && r[n].ts <= t; n++)
+				sum += r[n].value;
+			if (n == 0)
+				return false;
+			v = sum / n;
+			return true;
+		}
+		// keep the latest sample at or before t at the front
+		while (r.size() >= 2 && r[1].ts <= t)
+			r.pop();
+		if (r.empty() || r[0].ts > t)
+			return false;
+		v = r[0].value;
+		if (c.policy == RESAMPLE_LINEAR && r.size() >= 2 && r[0].ts < t) {
+			const sample_ring::sample &a = r[0], &b = r[1];
+			v = a.value + (b.value - a.value) * (double)(t - a.ts) / (double)(b.ts - a.ts);
+		}
+		return true;
+	}
+
+	int64_t period;
+	int64_t delay;
+	size_t capacity;
+	std::vector<channel> signals;
+	std::vector<double> values;
+	std::vector<uint8_t> valid;
+	bool started = false;
+	int64_t next = 0;		// time of the next row
+	int64_t last_row = INT64_MIN;	// time of the last row emitted
+	uint64_t late = 0;
+	uint64_t overruns = 0;
+};
+
+#endif // CAN_RESAMPLE_H
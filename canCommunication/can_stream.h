@@ -0,0 +1,341 @@
+#ifndef CAN_STREAM_H
+#define CAN_STREAM_H
+
+// Incremental candump input for the streaming mode of the analyzer.
+//
+// Reads a pipe ("-" is stdin) or a log file that candump is still writing.
+// Data is read into a fixed buffer, complete lines are decoded in place with
+// candump_reader and a partial last line is carried over to the next read,
+// so memory use does not depend on the length of the run.  Interface names
+// are copied out of the buffer into a table of their own because the
+// reader's views do not survive the next read.
+//
+// When following a file it behaves like "tail -F": at the end of the file
+// it waits for inotify events (or polls where there is no inotify), starts
+// over if the file is truncated and switches to the new file when the path
+// is moved away or deleted and created again, e.g. by log rotation.
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "candump_reader.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <poll.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+class candump_stream {
+public:
+	static constexpr size_t buffer_size = 1 << 16;	// also the longest line accepted
+
+	candump_stream() : buf(buffer_size) {}
+	~candump_stream() { close(); }
+
+	candump_stream(const candump_stream &) = delete;
+	candump_stream &operator=(const candump_stream &) = delete;
+
+	// Open a log file or "-" for stdin.  With follow a regular file is read
+	// as it grows, otherwise the stream ends at the end of the file (pipes
+	// always end when the writer closes them).
+	bool open(const char *file_path, bool follow_file)
+	{
+		close();
+		error.clear();
+		path = file_path;
+		if (path == "-") {
+			fd = 0;
+		} else if ((fd = ::open(file_path, O_RDONLY)) < 0) {
+			error = std::string("cannot open ") + file_path;
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) < 0) {
+			error = std::string("cannot stat ") + file_path;
+			close();
+			return false;
+		}
+		regular = S_ISREG(st.st_mode);
+		follow = follow_file && regular;
+		identity = st;
+		offset = 0;
+		watch_file();
+		return true;
+	}
+
+	void close()
+	{
+#ifdef __linux__
+		if (inotify >= 0)
+			::close(inotify);
+		inotify = -1;
+		wd = -1;
+#endif
+		if (fd > 0)
+			::close(fd);
+		fd = -1;
+		have = 0;
+		discarding = false;
+	}
+
+	// Read whatever is available, calling fn(const can_frame_rec &) for
+	// every frame, and wait for more until timeout_ms has passed.  Returns
+	// true when the timeout expired (or a signal arrived), false at the end
+	// of the input or on an error.
+	template <typename F>
+	bool poll(F fn, int timeout_ms)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		for (;;) {
+			if (regular || readable(0)) {
+				long n = (long)::read(fd, buf.data() + have, (unsigned)(buf.size() - have));
+				if (n > 0) {
+					have += (size_t)n;
+					offset += n;
+					consume(fn);
+					if (ms_left(deadline) <= 0)
+						return true;
+					continue;
+				}
+				if (n < 0 && errno == EINTR)
+					return true;
+				if (n < 0) {
+					error = "read error on " + path;
+					return false;
+				}
+				if (!follow) {
+					finish(fn);
+					return false;
+				}
+				if (rotated())
+					continue;
+			}
+			int left = ms_left(deadline);
+			if (left <= 0)
+				return true;
+			if (!wait(left))
+				return true;
+		}
+	}
+
+	const std::vector<std::string> &interfaces() const { return names; }
+	std::string_view interface_name(const can_frame_rec &f) const { return names[f.iface]; }
+	// lines which could not be decoded, including lines longer than the buffer
+	size_t skipped() const { return bad; }
+	// number of times the followed file was truncated or replaced
+	size_t reopened() const { return reopens; }
+
+	std::string error;
+
+private:
+	static int ms_left(std::chrono::steady_clock::time_point deadline)
+	{
+		auto d = deadline - std::chrono::steady_clock::now();
+		return (int)std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+	}
+
+	// decode the complete lines in the buffer, keep the partial one
+	template <typename F>
+	void consume(F fn)
+	{
+		const char *b = buf.data();
+		const char *nl = b + have;
+		while (nl > b && nl[-1] != '\n')
+			nl--;
+		if (nl == b) {
+			// no line end in a full buffer: drop the line
+			if (have == buf.size()) {
+				if (!discarding)
+					bad++;
+				discarding = true;
+				have = 0;
+			}
+			return;
+		}
+		const char *start = b;
+		if (discarding) {
+			start = (const char *)memchr(b, '\n', nl - b) + 1;
+			discarding = false;
+		}
+		decode(start, nl, fn);
+		have -= nl - b;
+		memmove(buf.data(), nl, have);
+	}
+
+	// a last line without a line end
+	template <typename F>
+	void finish(F fn)
+	{
+		if (have && !discarding)
+			decode(buf.data(), buf.data() + have, fn);
+		have = 0;
+		discarding = false;
+	}
+
+	template <typename F>
+	void decode(const char *b, const char *e, F fn)
+	{
+		candump_reader reader(b, e);
+		can_frame_rec f;
+		local.clear();
+		while (reader.next(f)) {
+			if (f.iface >= local.size())
+				local.resize(f.iface + 1, -1);
+			if (local[f.iface] < 0)
+				local[f.iface] = stable_index(reader.interface_name(f));
+			if (local[f.iface] < 0) {
+				bad++;
+				continue;
+			}
+			f.iface = (uint8_t)local[f.iface];
+			fn(f);
+		}
+		bad += reader.skipped();
+	}
+
+	int stable_index(std::string_view name)
+	{
+		for (size_t i = 0; i < names.size(); i++)
+			if (names[i] == name)
+				return (int)i;
+		if (names.size() > 255)
+			return -1;
+		names.emplace_back(name);
+		return (int)names.size() - 1;
+	}
+
+	// true if data is waiting on a pipe
+	bool readable(int timeout_ms)
+	{
+#ifdef _WIN32
+		(void)timeout_ms;
+		return true;	// blocking read
+#else
+		struct pollfd p = {fd, POLLIN, 0};
+		return ::poll(&p, 1, timeout_ms) > 0;
+#endif
+	}
+
+	// Sleep until there may be more data.  False if interrupted.
+	bool wait(int timeout_ms)
+	{
+		if (!regular) {
+#ifndef _WIN32
+			struct pollfd p = {fd, POLLIN, 0};
+			if (::poll(&p, 1, timeout_ms) < 0 && errno == EINTR)
+				return false;
+#endif
+			return true;
+		}
+		// re-check the path now and then, a new file at the old path
+		// does not raise events on the watch of the old one
+		if (timeout_ms > 500)
+			timeout_ms = 500;
+#ifdef __linux__
+		if (inotify >= 0) {
+			struct pollfd p = {inotify, POLLIN, 0};
+			int r = ::poll(&p, 1, timeout_ms);
+			if (r < 0)
+				return errno != EINTR;
+			if (r > 0) {
+				char events[4096];
+				while (::read(inotify, events, sizeof(events)) > 0) {
+				}
+			}
+			return true;
+		}
+#endif
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms < 100 ? timeout_ms : 100));
+		return true;
+	}
+
+	// At the end of a followed file: start over if it was truncated, switch
+	// to the file now at the path if it was replaced.  True if there may be
+	// new data to read.
+	bool rotated()
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size < offset) {
+			lseek(fd, 0, SEEK_SET);
+			restart();
+			return true;
+		}
+		if (stat(path.c_str(), &st) < 0 || same_file(st, identity))
+			return false;
+		int nfd = ::open(path.c_str(), O_RDONLY);
+		if (nfd < 0)
+			return false;
+		::close(fd);
+		fd = nfd;
+		if (fstat(fd, &identity) < 0)
+			identity = st;
+		restart();
+		watch_file();
+		return true;
+	}
+
+	void restart()
+	{
+		// the partial line of the old data will never be completed
+		if (have && !discarding)
+			bad++;
+		have = 0;
+		discarding = false;
+		offset = 0;
+		reopens++;
+	}
+
+	static bool same_file(const struct stat &a, const struct stat &b)
+	{
+		return a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+	}
+
+	void watch_file()
+	{
+#ifdef __linux__
+		if (!follow || !regular)
+			return;
+		if (inotify < 0)
+			inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify < 0)
+			return;
+		if (wd >= 0)
+			inotify_rm_watch(inotify, wd);
+		wd = inotify_add_watch(inotify, path.c_str(),
+				       IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+#endif
+	}
+
+	std::string path;
+	int fd = -1;
+	bool follow = false;
+	bool regular = true;
+	struct stat identity = {};
+	long long offset = 0;
+#ifdef __linux__
+	int inotify = -1;
+	int wd = -1;
+#endif
+
+	std::vector<char> buf;
+	size_t have = 0;
+	bool discarding = false;	// inside a line longer than the buffer
+	std::vector<int> local;		// reader interface index -> names index
+	std::vector<std::string> names;
+	size_t bad = 0;
+	size_t reopens = 0;
+};
+
+#endif // CAN_STREAM_H
@@ -0,0 +1,181 @@
+// Converter between candump text logs and the binary log format of
+// can_binlog.h.
+//
+//	g++ -std=c++17 -O2 canbinlog.cpp -o canbinlog
+//	./canbinlog pack in.log out.cbl [-c chunk_frames]
+//	./canbinlog unpack in.cbl [-o out.log] [-i ID] [-t from to]
+//	./canbinlog info in.cbl
+//
+// "unpack" writes candump text to stdout unless -o is given; -i limits the
+// output to one CAN id (hex, eight digits or above 7FF for 29 bit ids), -t to
+// a time window in seconds.  Without filters the output is byte for byte the
+// original log, as long as that was written by "candump -l".
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "candump_reader.h"
+#include "can_binlog.h"
+using namespace std;
+
+static int usage()
+{
+	cerr << "usage: canbinlog pack <in.log> <out.cbl> [-c chunk_frames]" << endl
+	     << "       canbinlog unpack <in.cbl> [-o out.log] [-i ID] [-t from to]" << endl
+	     << "       canbinlog info <in.cbl>" << endl;
+	return 2;
+}
+
+static int pack(const char *in_path, const char *out_path, uint32_t chunk_frames)
+{
+	auto t0 = chrono::steady_clock::now();
+	mapped_file in(in_path);
+	if (!in.good()) {
+		cerr << "Problem opening file " << in_path << endl;
+		return 1;
+	}
+	binlog_writer out;
+	if (!out.open(out_path, chunk_frames)) {
+		cerr << out.error << endl;
+		return 1;
+	}
+	candump_reader reader(in);
+	can_frame_rec f;
+	size_t frames = 0;
+	while (reader.next(f)) {
+		if (!out.add(f, reader.interface_name(f)))
+			break;
+		frames++;
+	}
+	if (!out.close()) {
+		cerr << out_path << ": " << out.error << endl;
+		return 1;
+	}
+	double s = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+	mapped_file packed(out_path);
+	printf("%zu frames, %zu -> %zu bytes (%.1f%%) in %.3f s\n", frames, in.size(), packed.size(),
+	       in.size() ? 100.0 * packed.size() / in.size() : 0.0, s);
+	if (reader.skipped())
+		printf("%zu lines skipped, the text log will not round-trip\n", reader.skipped());
+	return 0;
+}
+
+static bool parse_id(const char *s, canid_t &id)
+{
+	char *end;
+	unsigned long v = strtoul(s, &end, 16);
+	if (*end || end == s || v > CAN_EFF_MASK)
+		return false;
+	id = (strlen(s) == 8 || v > CAN_SFF_MASK) ? (canid_t)v | CAN_EFF_FLAG : (canid_t)v;
+	return true;
+}
+
+static int64_t parse_time(const char *s)
+{
+	return llround(strtod(s, nullptr) * 1e6);
+}
+
+static int unpack(binlog_reader &in, const char *out_path, bool by_id, canid_t id,
+		  int64_t from, int64_t to)
+{
+	FILE *out = stdout;
+	if (out_path && !(out = fopen(out_path, "wb"))) {
+		cerr << "Problem creating file " << out_path << endl;
+		return 1;
+	}
+	char line[512];
+	auto emit = [&](const can_frame_rec &f) {
+		int n = format_candump(f, in.interface_name(f), line, sizeof(line) - 2);
+		if (n < 0)
+			return;
+		if (f.flags & CANDUMP_CRLF)
+			line[n++] = '\r';
+		line[n++] = '\n';
+		fwrite(line, 1, n, out);
+	};
+	bool ok = by_id ? in.scan_id(id, emit, from, to) : in.scan(emit, from, to);
+	if (out != stdout && fclose(out) != 0)
+		ok = false;
+	if (!ok) {
+		cerr << (in.error.empty() ? "write error" : in.error) << endl;
+		return 1;
+	}
+	return 0;
+}
+
+static int info(binlog_reader &in)
+{
+	printf("%" PRIu64 " frames in %zu chunks, %zu ids\n", in.frames(), in.chunks().size(),
+	       in.ids().size());
+	if (!in.chunks().empty())
+		printf("time %.6f .. %.6f\n", in.chunks().front().t_min / 1e6, in.chunks().back().t_max / 1e6);
+	printf("interfaces:");
+	for (auto &name : in.interfaces())
+		printf(" %s", name.c_str());
+	printf("\n%-8s %10s %8s\n", "ID", "frames", "blocks");
+	for (auto &id : in.ids()) {
+		if (id.can_id & CAN_EFF_FLAG)
+			printf("%08X", id.can_id & CAN_EFF_MASK);
+		else
+			printf("%03X     ", id.can_id);
+		printf(" %10" PRIu64 " %8zu\n", id.frames, id.count);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+		return usage();
+	string_view cmd = argv[1];
+
+	if (cmd == "pack") {
+		if (argc < 4)
+			return usage();
+		uint32_t chunk_frames = 4096;
+		for (int i = 4; i < argc; i++) {
+			if (string_view(argv[i]) == "-c" && i + 1 < argc)
+				chunk_frames = (uint32_t)atoi(argv[++i]);
+			else
+				return usage();
+		}
+		return pack(argv[2], argv[3], chunk_frames);
+	}
+
+	binlog_reader in(argv[2]);
+	if (!in.good()) {
+		cerr << argv[2] << ": " << in.error << endl;
+		return 1;
+	}
+	if (cmd == "info")
+		return info(in);
+	if (cmd != "unpack")
+		return usage();
+
+	const char *out_path = nullptr;
+	bool by_id = false;
+	canid_t id = 0;
+	int64_t from = INT64_MIN, to = INT64_MAX;
+	for (int i = 3; i < argc; i++) {
+		string_view a = argv[i];
+		if (a == "-o" && i + 1 < argc) {
+			out_path = argv[++i];
+		} else if (a == "-i" && i + 1 < argc) {
+			if (!parse_id(argv[++i], id))
+				return usage();
+			by_id = true;
+		} else if (a == "-t" && i + 2 < argc) {
+			from = parse_time(argv[++i]);
+			to = parse_time(argv[++i]);
+		} else {
+			return usage();
+		}
+	}
+	return unpack(in, out_path, by_id, id, from, to);
+}
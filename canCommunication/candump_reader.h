@@ -0,0 +1,404 @@
+#ifndef CANDUMP_READER_H
+#define CANDUMP_READER_H
+
+// Zero-copy reader for candump log files ("candump -l" format):
+//
+//	(1613256099.296767) can0 358#0102800000030000
+//
+// The file is memory mapped and walked in place.  Every line is decoded
+// into a fixed size can_frame_rec; the interface name and the raw line are
+// handed out as string_views into the mapping, so no heap allocation is
+// done per line.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/can.h>
+#else
+typedef uint32_t canid_t;
+#define CAN_EFF_FLAG 0x80000000U
+#define CAN_RTR_FLAG 0x40000000U
+#define CAN_ERR_FLAG 0x20000000U
+#define CAN_SFF_MASK 0x000007FFU
+#define CAN_EFF_MASK 0x1FFFFFFFU
+#endif
+
+// Read-only mapping of a whole file.
+class mapped_file {
+public:
+	mapped_file() {}
+	explicit mapped_file(const char *path) { open(path); }
+	~mapped_file() { close(); }
+
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+
+	bool open(const char *path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+				   OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER sz;
+		if (!GetFileSizeEx(file, &sz)) {
+			close();
+			return false;
+		}
+		len = (size_t)sz.QuadPart;
+		is_open = true;
+		if (len == 0)
+			return true;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			close();
+			return false;
+		}
+		ptr = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (ptr == NULL) {
+			close();
+			return false;
+		}
+#else
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) < 0) {
+			::close(fd);
+			return false;
+		}
+		len = (size_t)st.st_size;
+		is_open = true;
+		if (len > 0) {
+			void *p = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED) {
+				::close(fd);
+				is_open = false;
+				len = 0;
+				return false;
+			}
+			// the analyzer reads front to back exactly once; the advice
+			// values are not flags, so each needs its own call
+			madvise(p, len, MADV_SEQUENTIAL);
+			madvise(p, len, MADV_WILLNEED);
+			ptr = (const char *)p;
+		}
+		// the mapping keeps its own reference to the file
+		::close(fd);
+#endif
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (ptr)
+			UnmapViewOfFile(ptr);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (ptr)
+			munmap((void *)ptr, len);
+#endif
+		ptr = nullptr;
+		len = 0;
+		is_open = false;
+	}
+
+	bool good() const { return is_open; }
+	const char *data() const { return ptr; }
+	size_t size() const { return len; }
+	const char *begin() const { return ptr; }
+	const char *end() const { return ptr + len; }
+
+private:
+	const char *ptr = nullptr;
+	size_t len = 0;
+	bool is_open = false;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+};
+
+// One decoded candump line.  Kept small and trivially copyable so it can be
+// stored in bulk (24 bytes).
+struct can_frame_rec {
+	int64_t ts_usec;	// timestamp in microseconds since the epoch
+	canid_t can_id;		// CAN id including CAN_EFF_FLAG / CAN_RTR_FLAG
+	uint8_t len;		// number of payload bytes
+	uint8_t iface;		// index into candump_reader::interfaces()
+	uint8_t flags;		// CANDUMP_* flags below
+	uint8_t reserved;
+	uint8_t data[8];
+};
+
+// the length digit of a remote frame was written ("123#R2")
+#define CANDUMP_RTR_LEN 0x01
+// the line ended in "\r\n"
+#define CANDUMP_CRLF 0x02
+
+// Payload as a little endian 64 bit word (data[0] in the low byte).
+inline uint64_t frame_payload(const can_frame_rec &f)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < f.len; i++)
+		v |= (uint64_t)f.data[i] << (8 * i);
+	return v;
+}
+
+// Write f as a candump line (without the newline) into buf, which must hold
+// at least 64 bytes.  Returns the length.  This is the exact inverse of
+// candump_reader::parse() for lines written by "candump -l".
+inline int format_candump(const can_frame_rec &f, std::string_view iface, char *buf, size_t size)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	if (size < 64 || iface.size() > size - 64)
+		return -1;
+	int64_t sec = f.ts_usec / 1000000, usec = f.ts_usec % 1000000;
+	char *p = buf;
+	*p++ = '(';
+	char tmp[24];
+	int n = 0;
+	do {
+		tmp[n++] = (char)('0' + sec % 10);
+		sec /= 10;
+	} while (sec);
+	while (n)
+		*p++ = tmp[--n];
+	*p++ = '.';
+	for (int i = 5; i >= 0; i--, usec /= 10)
+		p[i] = (char)('0' + usec % 10);
+	p += 6;
+	*p++ = ')';
+	*p++ = ' ';
+	memcpy(p, iface.data(), iface.size());
+	p += iface.size();
+	*p++ = ' ';
+	if (f.can_id & CAN_EFF_FLAG) {
+		canid_t id = f.can_id & CAN_EFF_MASK;
+		for (int i = 7; i >= 0; i--)
+			*p++ = digits[(id >> (4 * i)) & 0xF];
+	} else {
+		canid_t id = f.can_id & CAN_SFF_MASK;
+		for (int i = 2; i >= 0; i--)
+			*p++ = digits[(id >> (4 * i)) & 0xF];
+	}
+	*p++ = '#';
+	if (f.can_id & CAN_RTR_FLAG) {
+		*p++ = 'R';
+		if (f.flags & CANDUMP_RTR_LEN)
+			*p++ = (char)('0' + f.len);
+	} else {
+		for (int i = 0; i < f.len && i < 8; i++) {
+			*p++ = digits[f.data[i] >> 4];
+			*p++ = digits[f.data[i] & 0xF];
+		}
+	}
+	return (int)(p - buf);
+}
+
+namespace candump_detail {
+
+// hex digit -> value, 0xFF for anything else
+struct hex_table {
+	uint8_t v[256];
+	constexpr hex_table() : v()
+	{
+		for (int i = 0; i < 256; i++)
+			v[i] = 0xFF;
+		for (int i = 0; i < 10; i++)
+			v['0' + i] = (uint8_t)i;
+		for (int i = 0; i < 6; i++) {
+			v['A' + i] = (uint8_t)(10 + i);
+			v['a' + i] = (uint8_t)(10 + i);
+		}
+	}
+};
+
+constexpr hex_table hex{};
+
+} // namespace candump_detail
+
+// Walks a candump log in place.  The reader does not own the memory, so it
+// works on a whole mapped_file as well as on any newline aligned slice of
+// one (or on a chunk of a stream).
+class candump_reader {
+public:
+	candump_reader() {}
+	candump_reader(const char *begin, const char *end) { reset(begin, end); }
+	explicit candump_reader(const mapped_file &file) { reset(file.begin(), file.end()); }
+
+	void reset(const char *begin, const char *end)
+	{
+		cur = begin;
+		stop = end;
+		bad = 0;
+	}
+
+	// Decode the next valid line into f.  Lines that are not classic CAN
+	// candump lines (CAN FD, comments, garbage) are skipped and counted.
+	bool next(can_frame_rec &f)
+	{
+		while (cur < stop) {
+			const char *nl = (const char *)memchr(cur, '\n', stop - cur);
+			const char *eol = nl ? nl : stop;
+			std::string_view line(cur, eol - cur);
+			cur = nl ? nl + 1 : stop;
+			bool crlf = !line.empty() && line.back() == '\r';
+			if (crlf)
+				line.remove_suffix(1);
+			if (line.empty())
+				continue;
+			if (parse(line, f)) {
+				if (crlf)
+					f.flags |= CANDUMP_CRLF;
+				last = line;
+				return true;
+			}
+			bad++;
+		}
+		return false;
+	}
+
+	// the raw text of the line last returned by next()
+	std::string_view line() const { return last; }
+	// interface names seen so far, indexed by can_frame_rec::iface
+	const std::vector<std::string_view> &interfaces() const { return ifaces; }
+	std::string_view interface_name(const can_frame_rec &f) const { return ifaces[f.iface]; }
+	// number of lines which could not be decoded
+	size_t skipped() const { return bad; }
+	// current position, everything before it has been consumed
+	const char *position() const { return cur; }
+
+	// Decode a single line (without the line terminator).
+	bool parse(std::string_view line, can_frame_rec &f)
+	{
+		using candump_detail::hex;
+		const char *p = line.data();
+		const char *e = p + line.size();
+
+		// "(sec.usec)"
+		if (p == e || *p++ != '(')
+			return false;
+		int64_t sec = 0;
+		const char *start = p;
+		while (p < e && (unsigned)(*p - '0') < 10)
+			sec = sec * 10 + (*p++ - '0');
+		if (p == start || p == e || *p++ != '.')
+			return false;
+		int64_t usec = 0;
+		int digits = 0;
+		while (p < e && (unsigned)(*p - '0') < 10) {
+			if (digits < 6)
+				usec = usec * 10 + (*p - '0');
+			digits++;
+			p++;
+		}
+		if (digits == 0 || p == e || *p++ != ')')
+			return false;
+		for (; digits < 6; digits++)
+			usec *= 10;
+		f.ts_usec = sec * 1000000 + usec;
+
+		// " ifname "
+		if (p == e || *p++ != ' ')
+			return false;
+		start = p;
+		while (p < e && *p != ' ')
+			p++;
+		if (p == start || p == e)
+			return false;
+		int idx = interface_index(std::string_view(start, p - start));
+		if (idx < 0)
+			return false;
+		f.iface = (uint8_t)idx;
+		p++;
+
+		// "ID#"
+		start = p;
+		uint32_t id = 0;
+		while (p < e && hex.v[(uint8_t)*p] != 0xFF)
+			id = (id << 4) | hex.v[(uint8_t)*p++];
+		size_t idlen = p - start;
+		if (p == e || *p++ != '#')
+			return false;
+		if (idlen == 3)
+			f.can_id = id & CAN_SFF_MASK;
+		else if (idlen == 8)
+			f.can_id = (id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+		else
+			return false;
+		f.flags = 0;
+		f.reserved = 0;
+		memset(f.data, 0, sizeof(f.data));
+
+		// remote frames: "ID#R" with an optional length digit
+		if (p < e && (*p == 'R' || *p == 'r')) {
+			f.can_id |= CAN_RTR_FLAG;
+			p++;
+			f.len = 0;
+			if (p < e && (unsigned)(*p - '0') <= 8) {
+				f.len = (uint8_t)(*p++ - '0');
+				f.flags |= CANDUMP_RTR_LEN;
+			}
+			return p == e;
+		}
+
+		// "DATA", up to eight hex pairs; "##" (CAN FD) is not handled here
+		uint8_t n = 0;
+		while (p + 1 < e && n < 8) {
+			if (*p == '.') {
+				p++;
+				continue;
+			}
+			uint8_t hi = hex.v[(uint8_t)p[0]];
+			uint8_t lo = hex.v[(uint8_t)p[1]];
+			if ((hi | lo) == 0xFF)
+				return false;
+			f.data[n++] = (uint8_t)((hi << 4) | lo);
+			p += 2;
+		}
+		f.len = n;
+		return p == e;
+	}
+
+private:
+	int interface_index(std::string_view name)
+	{
+		for (size_t i = 0; i < ifaces.size(); i++)
+			if (ifaces[i] == name)
+				return (int)i;
+		if (ifaces.size() > 255)
+			return -1;
+		ifaces.push_back(name);
+		return (int)ifaces.size() - 1;
+	}
+
+	const char *cur = nullptr;
+	const char *stop = nullptr;
+	size_t bad = 0;
+	std::string_view last;
+	std::vector<std::string_view> ifaces;
+};
+
+#endif // CANDUMP_READER_H
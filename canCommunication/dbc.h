@@ -0,0 +1,371 @@
+#ifndef DBC_H
+#define DBC_H
+
+// Hand written parser for Vector DBC files.
+//
+// Only the parts needed for decoding are kept: BO_ message blocks, their
+// SG_ signals (including simple "M"/"mN" and extended "mNM" multiplexing)
+// and SG_MUL_VAL_ switch assignments.  Everything else (CM_, BA_, VAL_ ...)
+// is skipped.  The file is mapped and tokenized in place, numbers are
+// converted straight into typed descriptors.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "candump_reader.h"
+
+struct dbc_signal {
+	std::string name;
+	uint16_t start_bit = 0;		// as written in the file (MSB for Motorola, LSB for Intel)
+	uint16_t length = 0;		// in bits
+	bool little_endian = false;	// "@1" Intel, "@0" Motorola
+	bool is_signed = false;		// "-" / "+"
+	double scale = 1.0;
+	double offset = 0.0;
+	double minimum = 0.0;
+	double maximum = 0.0;
+	std::string unit;
+
+	bool is_multiplexor = false;	// "M" or "mNM"
+	bool is_multiplexed = false;	// "mN" or "mNM"
+	uint32_t mux_value = 0;		// the N of "mN"
+	int mux_switch = -1;		// index of the multiplexor signal in the message
+};
+
+struct dbc_message {
+	canid_t id = 0;			// CAN id, CAN_EFF_FLAG set for extended ids
+	std::string name;
+	uint8_t dlc = 0;
+	std::string transmitter;
+	std::vector<dbc_signal> signals;
+};
+
+class dbc_database {
+public:
+	// name and raw id of the pseudo message Vector uses for signals which
+	// do not belong to a BO_ block
+	static constexpr const char *independent_name = "VECTOR__INDEPENDENT_SIG_MSG";
+	static constexpr uint32_t independent_id = 0xC0000000U;
+
+	std::vector<dbc_message> messages;
+
+	bool load(const char *path)
+	{
+		mapped_file file(path);
+		if (!file.good()) {
+			error = std::string("cannot open ") + path;
+			return false;
+		}
+		return parse(file.begin(), file.end());
+	}
+
+	bool parse(const char *begin, const char *end)
+	{
+		messages.clear();
+		by_id.clear();
+		error.clear();
+		error_line = 0;
+
+		const char *p = begin;
+		int line_no = 0;
+		int current = -1;	// message the following SG_ lines belong to
+		while (p < end) {
+			const char *nl = (const char *)memchr(p, '\n', end - p);
+			const char *eol = nl ? nl : end;
+			std::string_view line(p, eol - p);
+			p = nl ? nl + 1 : end;
+			line_no++;
+
+			std::string_view tok = first_token(line);
+			if (tok == "BO_") {
+				if (!parse_message(line))
+					return fail(line_no, "bad BO_ line");
+				current = (int)messages.size() - 1;
+			} else if (tok == "SG_") {
+				if (current < 0)
+					current = independent_message();
+				if (!parse_signal(line, messages[current]))
+					return fail(line_no, "bad SG_ line");
+			} else if (tok == "SG_MUL_VAL_") {
+				if (!parse_mux_value(line))
+					return fail(line_no, "bad SG_MUL_VAL_ line");
+			} else {
+				// any other statement ends a BO_ block, a blank line
+				// does not
+				if (!tok.empty())
+					current = -1;
+				// statements with strings (CM_ ...) may span lines
+				while (unbalanced_quotes(line) && p < end) {
+					const char *more = (const char *)memchr(p, '\n', end - p);
+					const char *stop = more ? more + 1 : end;
+					line = std::string_view(line.data(), stop - line.data());
+					p = stop;
+					line_no++;
+				}
+			}
+		}
+		resolve_multiplexors();
+		return true;
+	}
+
+	const dbc_message *find(canid_t id) const
+	{
+		auto it = by_id.find(id);
+		return it == by_id.end() ? nullptr : &messages[it->second];
+	}
+
+	size_t signal_count() const
+	{
+		size_t n = 0;
+		for (auto &m : messages)
+			n += m.signals.size();
+		return n;
+	}
+
+	std::string error;
+	int error_line = 0;
+
+private:
+	// the cursor helpers below work on a string_view that is consumed
+	static void skip_space(std::string_view &s)
+	{
+		size_t i = 0;
+		while (i < s.size() && (s[i] == ' ' || s[i] == '\t' || s[i] == '\r'))
+			i++;
+		s.remove_prefix(i);
+	}
+
+	static std::string_view first_token(std::string_view s)
+	{
+		skip_space(s);
+		size_t i = 0;
+		while (i < s.size() && s[i] != ' ' && s[i] != '\t' && s[i] != '\r' && s[i] != ':')
+			i++;
+		return s.substr(0, i);
+	}
+
+	// identifier or number, stops at white space and DBC punctuation
+	static std::string_view word(std::string_view &s)
+	{
+		skip_space(s);
+		size_t i = 0;
+		while (i < s.size() && !strchr(" \t\r:|@(),[]\";", s[i]))
+			i++;
+		std::string_view w = s.substr(0, i);
+		s.remove_prefix(i);
+		return w;
+	}
+
+	static bool expect(std::string_view &s, char c)
+	{
+		skip_space(s);
+		if (s.empty() || s[0] != c)
+			return false;
+		s.remove_prefix(1);
+		return true;
+	}
+
+	static bool to_uint(std::string_view w, uint64_t &v)
+	{
+		if (w.empty())
+			return false;
+		v = 0;
+		for (char c : w) {
+			if ((unsigned)(c - '0') >= 10)
+				return false;
+			v = v * 10 + (c - '0');
+		}
+		return true;
+	}
+
+	static bool to_double(std::string_view w, double &v)
+	{
+		char buf[64];
+		if (w.empty() || w.size() >= sizeof(buf))
+			return false;
+		memcpy(buf, w.data(), w.size());
+		buf[w.size()] = 0;
+		char *endp;
+		v = strtod(buf, &endp);
+		return endp == buf + w.size();
+	}
+
+	static bool unbalanced_quotes(std::string_view s)
+	{
+		bool open = false;
+		for (size_t i = 0; i < s.size(); i++) {
+			if (s[i] == '\\' && open)
+				i++;
+			else if (s[i] == '"')
+				open = !open;
+		}
+		return open;
+	}
+
+	static canid_t convert_id(uint64_t raw)
+	{
+		if (raw & 0x80000000U)
+			return CAN_EFF_FLAG | (canid_t)(raw & CAN_EFF_MASK);
+		return (canid_t)(raw & CAN_EFF_MASK);
+	}
+
+	// BO_ 2024 OBD2: 8 Vector__XXX
+	bool parse_message(std::string_view s)
+	{
+		uint64_t raw, dlc;
+		word(s);
+		if (!to_uint(word(s), raw))
+			return false;
+		dbc_message m;
+		m.id = convert_id(raw);
+		m.name = std::string(word(s));
+		if (m.name.empty() || !expect(s, ':') || !to_uint(word(s), dlc))
+			return false;
+		m.dlc = (uint8_t)dlc;
+		m.transmitter = std::string(word(s));
+		messages.push_back(std::move(m));
+		if (raw != independent_id)
+			by_id[messages.back().id] = messages.size() - 1;
+		return true;
+	}
+
+	int independent_message()
+	{
+		for (size_t i = 0; i < messages.size(); i++)
+			if (messages[i].name == independent_name)
+				return (int)i;
+		dbc_message m;
+		m.id = convert_id(independent_id);
+		m.name = independent_name;
+		messages.push_back(std::move(m));
+		return (int)messages.size() - 1;
+	}
+
+	// SG_ name [M|mN|mNM] : start|len@order sign (scale,offset) [min|max] "unit" receivers
+	bool parse_signal(std::string_view s, dbc_message &msg)
+	{
+		dbc_signal sig;
+		uint64_t v;
+		word(s);
+		sig.name = std::string(word(s));
+		if (sig.name.empty())
+			return false;
+
+		std::string_view mux = word(s);
+		if (!mux.empty()) {
+			if (mux == "M") {
+				sig.is_multiplexor = true;
+			} else if (mux[0] == 'm') {
+				mux.remove_prefix(1);
+				if (!mux.empty() && mux.back() == 'M') {
+					sig.is_multiplexor = true;
+					mux.remove_suffix(1);
+				}
+				if (!to_uint(mux, v))
+					return false;
+				sig.is_multiplexed = true;
+				sig.mux_value = (uint32_t)v;
+			} else {
+				return false;
+			}
+		}
+		if (!expect(s, ':'))
+			return false;
+
+		if (!to_uint(word(s), v) || !expect(s, '|'))
+			return false;
+		// out of range positions are kept (saturated), the decoder marks
+		// signals it cannot place as unsupported
+		sig.start_bit = (uint16_t)(v > UINT16_MAX ? UINT16_MAX : v);
+		if (!to_uint(word(s), v) || !expect(s, '@'))
+			return false;
+		sig.length = (uint16_t)(v > UINT16_MAX ? UINT16_MAX : v);
+		skip_space(s);
+		if (s.size() < 2 || (s[0] != '0' && s[0] != '1') || (s[1] != '+' && s[1] != '-'))
+			return false;
+		sig.little_endian = s[0] == '1';
+		sig.is_signed = s[1] == '-';
+		s.remove_prefix(2);
+
+		if (!expect(s, '(') || !to_double(word(s), sig.scale) || !expect(s, ',') ||
+		    !to_double(word(s), sig.offset) || !expect(s, ')'))
+			return false;
+		if (!expect(s, '[') || !to_double(word(s), sig.minimum) || !expect(s, '|') ||
+		    !to_double(word(s), sig.maximum) || !expect(s, ']'))
+			return false;
+
+		if (!expect(s, '"'))
+			return false;
+		size_t q = s.find('"');
+		if (q == std::string_view::npos)
+			return false;
+		sig.unit = std::string(s.substr(0, q));
+
+		msg.signals.push_back(std::move(sig));
+		return true;
+	}
+
+	// SG_MUL_VAL_ 2024 S1_PID_0D_VehicleSpeed ParameterID_Service01 13-13;
+	bool parse_mux_value(std::string_view s)
+	{
+		uint64_t raw, lo;
+		word(s);
+		if (!to_uint(word(s), raw))
+			return false;
+		std::string_view name = word(s);
+		std::string_view sw = word(s);
+		std::string_view range = word(s);
+		size_t dash = range.find('-');
+		if (name.empty() || sw.empty() || !to_uint(range.substr(0, dash), lo))
+			return false;
+
+		dbc_message *m = nullptr;
+		for (auto &msg : messages)
+			if (msg.id == convert_id(raw))
+				m = &msg;
+		if (!m)
+			return true;	// refers to a message we do not know, ignore
+		int sig = -1, swi = -1;
+		for (size_t i = 0; i < m->signals.size(); i++) {
+			if (m->signals[i].name == name)
+				sig = (int)i;
+			if (m->signals[i].name == sw)
+				swi = (int)i;
+		}
+		if (sig < 0 || swi < 0)
+			return true;
+		m->signals[sig].mux_switch = swi;
+		m->signals[sig].mux_value = (uint32_t)lo;
+		return true;
+	}
+
+	// Multiplexed signals without an SG_MUL_VAL_ entry are switched by the
+	// plain "M" signal of their message.
+	void resolve_multiplexors()
+	{
+		for (auto &m : messages) {
+			int plain = -1;
+			for (size_t i = 0; i < m.signals.size(); i++)
+				if (m.signals[i].is_multiplexor && !m.signals[i].is_multiplexed)
+					plain = (int)i;
+			for (auto &sig : m.signals)
+				if (sig.is_multiplexed && sig.mux_switch < 0)
+					sig.mux_switch = plain;
+		}
+	}
+
+	bool fail(int line_no, const char *what)
+	{
+		error = what;
+		error_line = line_no;
+		return false;
+	}
+
+	std::unordered_map<canid_t, size_t> by_id;
+};
+
+#endif // DBC_H
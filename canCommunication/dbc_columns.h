@@ -0,0 +1,156 @@
+#ifndef DBC_COLUMNS_H
+#define DBC_COLUMNS_H
+
+// Columnar batch decoding for offline analysis.
+//
+// Frames are collected per CAN id into columns of timestamps and little
+// endian payload words.  A signal is then decoded over a whole column at
+// once: byte swap (Motorola only), shift, mask, sign extend, scale and
+// offset.  On x86 an AVX2 kernel does four frames per step; everything else
+// (and signals wider than 52 bits, which do not survive the integer to
+// double trick below) goes through the scalar kernel, which produces
+// bit for bit the same values as message_plan::decode().
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "candump_reader.h"
+#include "dbc_decode.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DBC_COLUMNS_AVX2 1
+#endif
+
+struct frame_column {
+	canid_t id = 0;
+	std::vector<int64_t> ts;	// usec
+	std::vector<uint64_t> payload;	// little endian payload words
+	std::vector<uint8_t> len;
+
+	size_t size() const { return ts.size(); }
+};
+
+// All frames of a capture, one column per CAN id.
+class column_store {
+public:
+	void add(const can_frame_rec &f)
+	{
+		canid_t k = id_key(f.can_id);
+		auto it = index.find(k);
+		size_t i;
+		if (it == index.end()) {
+			i = columns.size();
+			index[k] = i;
+			columns.emplace_back();
+			columns.back().id = k;
+		} else {
+			i = it->second;
+		}
+		frame_column &c = columns[i];
+		c.ts.push_back(f.ts_usec);
+		c.payload.push_back(payload_le(f));
+		c.len.push_back(f.len);
+	}
+
+	const frame_column *find(canid_t can_id) const
+	{
+		auto it = index.find(id_key(can_id));
+		return it == index.end() ? nullptr : &columns[it->second];
+	}
+
+	const std::vector<frame_column> &all() const { return columns; }
+
+private:
+	static canid_t id_key(canid_t id)
+	{
+		return (id & CAN_EFF_FLAG) ? (id & (CAN_EFF_FLAG | CAN_EFF_MASK)) : (id & CAN_SFF_MASK);
+	}
+
+	std::vector<frame_column> columns;
+	std::unordered_map<canid_t, size_t> index;
+};
+
+inline void decode_column_scalar(const signal_op &op, const uint64_t *payload, size_t n, double *out)
+{
+	if (op.sign) {
+		for (size_t i = 0; i < n; i++) {
+			uint64_t w = op.word ? __builtin_bswap64(payload[i]) : payload[i];
+			out[i] = generic_value<true>(w, op);
+		}
+	} else {
+		for (size_t i = 0; i < n; i++) {
+			uint64_t w = op.word ? __builtin_bswap64(payload[i]) : payload[i];
+			out[i] = generic_value<false>(w, op);
+		}
+	}
+}
+
+#ifdef DBC_COLUMNS_AVX2
+
+// Integers below 2^52 are converted by placing them in the mantissa of
+// 2^52 and subtracting 2^52 again.  Signed values are biased into that
+// range first (raw ^ sign) and the bias is subtracted as a double.  No FMA,
+// so the rounding matches the scalar kernel.
+__attribute__((target("avx2")))
+inline void decode_column_avx2(const signal_op &op, const uint64_t *payload, size_t n, double *out)
+{
+	const __m256i bswap = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+					       7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	const __m256i mask = _mm256_set1_epi64x((long long)op.mask);
+	const __m256i sign = _mm256_set1_epi64x((long long)op.sign);
+	const __m256i magic = _mm256_set1_epi64x(0x4330000000000000LL);
+	const __m128i shift = _mm_cvtsi32_si128(op.shift);
+	const __m256d two52 = _mm256_set1_pd(4503599627370496.0);
+	const __m256d bias = _mm256_set1_pd((double)op.sign);
+	const __m256d scale = _mm256_set1_pd(op.scale);
+	const __m256d offset = _mm256_set1_pd(op.offset);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i w = _mm256_loadu_si256((const __m256i *)(payload + i));
+		if (op.word)
+			w = _mm256_shuffle_epi8(w, bswap);
+		__m256i raw = _mm256_and_si256(_mm256_srl_epi64(w, shift), mask);
+		raw = _mm256_xor_si256(raw, sign);
+		__m256d v = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(raw, magic)), two52);
+		v = _mm256_sub_pd(v, bias);
+		v = _mm256_add_pd(_mm256_mul_pd(v, scale), offset);
+		_mm256_storeu_pd(out + i, v);
+	}
+	decode_column_scalar(op, payload + i, n - i, out + i);
+}
+
+inline bool have_avx2()
+{
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+
+#endif // DBC_COLUMNS_AVX2
+
+// Decode one signal over a whole column, out must hold column.size() values.
+inline void decode_column(const signal_op &op, const frame_column &column, double *out, bool simd = true)
+{
+#ifdef DBC_COLUMNS_AVX2
+	if (simd && have_avx2() && op.mask < (1ULL << 52)) {
+		decode_column_avx2(op, column.payload.data(), column.size(), out);
+		return;
+	}
+#endif
+	decode_column_scalar(op, column.payload.data(), column.size(), out);
+}
+
+// Decode every signal of a message over a column into one output column
+// per signal (indexed like plan.msg->signals).
+inline void decode_columns(const message_plan &plan, const frame_column &column,
+			   std::vector<std::vector<double>> &out, bool simd = true)
+{
+	out.resize(plan.size());
+	for (size_t s = 0; s < plan.size(); s++) {
+		out[s].resize(column.size());
+		decode_column(plan.ops()[s], column, out[s].data(), simd);
+	}
+}
+
+#endif // DBC_COLUMNS_H
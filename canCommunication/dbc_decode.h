@@ -0,0 +1,336 @@
+#ifndef DBC_DECODE_H
+#define DBC_DECODE_H
+
+// Precompiled decode plans for DBC messages.
+//
+// Every signal is reduced to "shift a 64 bit word, cut off length bits,
+// sign extend, scale and offset".  The byte order is resolved when the plan
+// is built: Intel signals are taken from the payload read as a little
+// endian word, Motorola signals from the same payload byte swapped, so the
+// only per signal data at run time is which of the two words to use and
+// the shift.  Signals are grouped by width and signedness; 8, 16 and 32 bit
+// fields use template kernels where the mask and the sign extension are a
+// plain integer cast.
+//
+// Example: "S1_PID_0C_EngineRPM m12 : 31|16@0+" (Motorola, MSB at bit 31)
+// covers payload bytes 3 and 4, i.e. bits 24..39 of the big endian word.
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "candump_reader.h"
+#include "dbc.h"
+
+inline uint64_t payload_le(const can_frame_rec &f)
+{
+	uint64_t w;
+	memcpy(&w, f.data, sizeof(w));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	w = __builtin_bswap64(w);
+#endif
+	return w;
+}
+
+// One signal, compiled.
+struct signal_op {
+	uint8_t word;		// 0: little endian payload, 1: big endian payload
+	uint8_t shift;		// position of the LSB within that word
+	uint16_t index;		// signal index in the message, also the output slot
+	uint8_t last;		// highest payload byte the signal uses
+	uint64_t mask;		// length bits
+	uint64_t sign;		// sign bit for signed signals, 0 otherwise
+	double scale;
+	double offset;
+};
+
+// Where a signal's LSB lands in the little or big endian payload word,
+// false if the signal does not fit into 64 bits.
+inline bool signal_position(const dbc_signal &sig, uint8_t &word, uint8_t &shift)
+{
+	if (sig.length == 0)
+		return false;
+	if (sig.little_endian) {
+		if (sig.start_bit + sig.length > 64)
+			return false;
+		word = 0;
+		shift = (uint8_t)sig.start_bit;
+		return true;
+	}
+	// Motorola: start_bit is the MSB, counted 7..0 within each byte
+	int msb = (7 - sig.start_bit / 8) * 8 + sig.start_bit % 8;
+	int lsb = msb - sig.length + 1;
+	if (lsb < 0)
+		return false;
+	word = 1;
+	shift = (uint8_t)lsb;
+	return true;
+}
+
+// Fixed width kernels: the cast to U masks, the cast to S sign extends.
+template <typename U, bool Signed>
+inline double field_value(uint64_t w, const signal_op &op)
+{
+	typedef typename std::make_signed<U>::type S;
+	U raw = (U)(w >> op.shift);
+	double v = Signed ? (double)(S)raw : (double)raw;
+	return v * op.scale + op.offset;
+}
+
+template <bool Signed>
+inline double generic_value(uint64_t w, const signal_op &op)
+{
+	uint64_t raw = (w >> op.shift) & op.mask;
+	double v = Signed ? (double)(int64_t)((raw ^ op.sign) - op.sign) : (double)raw;
+	return v * op.scale + op.offset;
+}
+
+inline uint64_t raw_value(const uint64_t w[2], const signal_op &op)
+{
+	return (w[op.word] >> op.shift) & op.mask;
+}
+
+// Decode plan for one message.
+class message_plan {
+public:
+	// kernel groups, see decode()
+	enum { U8, S8, U16, S16, U32, S32, GENERIC_U, GENERIC_S, GROUPS };
+
+	const dbc_message *msg = nullptr;
+
+	bool build(const dbc_message &m)
+	{
+		msg = &m;
+		for (auto &g : groups)
+			g.clear();
+		switches.clear();
+		checks.clear();
+		broken.clear();
+		need = 0;
+		bool ok = true;
+		all.assign(m.signals.size(), signal_op());
+		for (size_t i = 0; i < m.signals.size(); i++) {
+			const dbc_signal &sig = m.signals[i];
+			signal_op &op = all[i];
+			if (!signal_position(sig, op.word, op.shift)) {
+				ok = false;
+				op.mask = 0;	// decodes as offset, never valid
+			} else {
+				op.mask = sig.length == 64 ? ~0ULL : ((1ULL << sig.length) - 1);
+				op.last = op.word ? 7 - op.shift / 8 : (op.shift + sig.length - 1) / 8;
+				if (op.last >= need)
+					need = op.last + 1;
+			}
+			op.index = (uint16_t)i;
+			op.sign = (sig.is_signed && op.mask) ? (1ULL << (sig.length - 1)) : 0;
+			op.scale = sig.scale;
+			op.offset = sig.offset;
+			groups[group_of(sig, op)].push_back(op);
+			if (sig.is_multiplexor)
+				switches.push_back(op);
+		}
+		// validity checks, a switch that is itself multiplexed is checked
+		// before the signals that depend on it
+		std::vector<int> depth(m.signals.size(), -1);
+		for (size_t i = 0; i < m.signals.size(); i++)
+			mux_depth(m, (int)i, depth, 0);
+		for (int d = 1; d <= (int)m.signals.size(); d++)
+			for (size_t i = 0; i < m.signals.size(); i++)
+				if (depth[i] == d) {
+					mux_check c;
+					c.index = (uint16_t)i;
+					c.sw = (uint16_t)m.signals[i].mux_switch;
+					c.value = m.signals[i].mux_value;
+					checks.push_back(c);
+				}
+		for (size_t i = 0; i < m.signals.size(); i++)
+			if (all[i].mask == 0)
+				broken.push_back((uint16_t)i);
+		return ok;
+	}
+
+	size_t size() const { return msg ? msg->signals.size() : 0; }
+
+	// Decode every signal of f into values[], valid[] tells which signals
+	// are present (multiplexed signals whose switch does not match,
+	// signals that do not fit into the payload and signals past the end
+	// of a short frame are not).
+	void decode(const can_frame_rec &f, double *values, uint8_t *valid) const
+	{
+		uint64_t w[2];
+		w[0] = payload_le(f);
+		w[1] = __builtin_bswap64(w[0]);
+
+		run<uint8_t, false>(groups[U8], w, values);
+		run<uint8_t, true>(groups[S8], w, values);
+		run<uint16_t, false>(groups[U16], w, values);
+		run<uint16_t, true>(groups[S16], w, values);
+		run<uint32_t, false>(groups[U32], w, values);
+		run<uint32_t, true>(groups[S32], w, values);
+		for (auto &op : groups[GENERIC_U])
+			values[op.index] = generic_value<false>(w[op.word], op);
+		for (auto &op : groups[GENERIC_S])
+			values[op.index] = generic_value<true>(w[op.word], op);
+
+		if (valid)
+			validate(w, f.len, valid);
+	}
+
+	void validate(const uint64_t w[2], uint8_t len, uint8_t *valid) const
+	{
+		memset(valid, 1, size());
+		for (auto i : broken)
+			valid[i] = 0;
+		// the reader zero fills the bytes after a short DLC
+		if (len < need)
+			for (auto &op : all)
+				if (op.last >= len)
+					valid[op.index] = 0;
+		if (checks.empty())
+			return;
+		uint64_t raw[64];
+		for (size_t i = 0; i < switches.size() && i < 64; i++)
+			raw[i] = raw_value(w, switches[i]);
+		for (auto &c : checks)
+			valid[c.index] = valid[c.index] && valid[c.sw] &&
+					 switch_raw(raw, c.sw) == c.value;
+	}
+
+	// the compiled signals, indexed like msg->signals
+	const std::vector<signal_op> &ops() const { return all; }
+
+private:
+	struct mux_check {
+		uint16_t index;		// multiplexed signal
+		uint16_t sw;		// its switch
+		uint32_t value;		// switch value selecting it
+	};
+
+	template <typename U, bool Signed>
+	static void run(const std::vector<signal_op> &ops, const uint64_t w[2], double *values)
+	{
+		for (auto &op : ops)
+			values[op.index] = field_value<U, Signed>(w[op.word], op);
+	}
+
+	static int group_of(const dbc_signal &sig, const signal_op &op)
+	{
+		if (op.mask == 0)
+			return GENERIC_U;
+		switch (sig.length) {
+		case 8: return sig.is_signed ? S8 : U8;
+		case 16: return sig.is_signed ? S16 : U16;
+		case 32: return sig.is_signed ? S32 : U32;
+		}
+		return sig.is_signed ? GENERIC_S : GENERIC_U;
+	}
+
+	static int mux_depth(const dbc_message &m, int i, std::vector<int> &depth, int guard)
+	{
+		if (depth[i] >= 0)
+			return depth[i];
+		const dbc_signal &sig = m.signals[i];
+		if (!sig.is_multiplexed || sig.mux_switch < 0 || guard > 64)
+			return depth[i] = 0;
+		return depth[i] = mux_depth(m, sig.mux_switch, depth, guard + 1) + 1;
+	}
+
+	uint64_t switch_raw(const uint64_t raw[], uint16_t sw) const
+	{
+		for (size_t i = 0; i < switches.size() && i < 64; i++)
+			if (switches[i].index == sw)
+				return raw[i];
+		return ~0ULL;
+	}
+
+	std::vector<signal_op> all;
+	std::vector<signal_op> groups[GROUPS];
+	std::vector<signal_op> switches;
+	std::vector<mux_check> checks;
+	std::vector<uint16_t> broken;
+	uint8_t need = 0;	// payload bytes every supported signal fits into
+};
+
+// Plans for every message of a database, looked up by CAN id.
+class dbc_decoder {
+public:
+	explicit dbc_decoder(const dbc_database &db) : sff(CAN_SFF_MASK + 1, -1)
+	{
+		plans.resize(db.messages.size());
+		for (size_t i = 0; i < db.messages.size(); i++) {
+			plans[i].build(db.messages[i]);
+			canid_t id = db.messages[i].id;
+			if (db.messages[i].name == dbc_database::independent_name)
+				continue;
+			if (id & CAN_EFF_FLAG)
+				eff[id] = (int)i;
+			else
+				sff[id & CAN_SFF_MASK] = (int)i;
+		}
+	}
+
+	const message_plan *find(canid_t can_id) const
+	{
+		if (!(can_id & CAN_EFF_FLAG)) {
+			int i = sff[can_id & CAN_SFF_MASK];
+			return i < 0 ? nullptr : &plans[i];
+		}
+		auto it = eff.find(can_id & (CAN_EFF_FLAG | CAN_EFF_MASK));
+		return it == eff.end() ? nullptr : &plans[it->second];
+	}
+
+	const std::vector<message_plan> &all() const { return plans; }
+
+private:
+	std::vector<message_plan> plans;
+	std::vector<int> sff;
+	std::unordered_map<canid_t, int> eff;
+};
+
+// Straightforward bit by bit decoder, the reference the plans are checked
+// against.  ok is false if the signal does not fit into the payload or
+// lies past the end of a short frame.
+inline double dbc_decode_reference(const dbc_signal &sig, const can_frame_rec &f, bool *ok = nullptr)
+{
+	uint64_t raw = 0;
+	int bit = sig.start_bit;
+	bool fits = sig.length > 0;
+	int last = 0;
+	for (int i = 0; i < sig.length; i++) {
+		int pos;
+		if (sig.little_endian) {
+			pos = bit + i;
+		} else {
+			// walk from the MSB down, wrapping to the next byte
+			pos = bit;
+			if (bit % 8 == 0)
+				bit += 15;
+			else
+				bit--;
+		}
+		if (pos < 0 || pos > 63) {
+			fits = false;
+			break;
+		}
+		if (pos / 8 > last)
+			last = pos / 8;
+		uint64_t b = (f.data[pos / 8] >> (pos % 8)) & 1;
+		if (sig.little_endian)
+			raw |= b << i;
+		else
+			raw = (raw << 1) | b;
+	}
+	if (ok)
+		*ok = fits && last < f.len;
+	if (!fits)
+		return sig.offset;
+	double v = (double)raw;
+	if (sig.is_signed && sig.length < 64 && (raw >> (sig.length - 1)) & 1)
+		v = (double)(int64_t)(raw | (~0ULL << sig.length));
+	else if (sig.is_signed && sig.length == 64)
+		v = (double)(int64_t)raw;
+	return v * sig.scale + sig.offset;
+}
+
+#endif // DBC_DECODE_H
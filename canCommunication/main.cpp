@@ -4,175 +4,291 @@
 #include <fstream>
 #include <vector>
 #include <algorithm>
-#include <regex>
 #include <cassert>
+#include <chrono>
+#include <csignal>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include "candump_reader.h"
+#include "can_id_stats.h"
+#include "can_parallel.h"
+#include "can_binlog.h"
+#include "can_stream.h"
+#include "can_resample.h"
+#include "dbc_decode.h"
+#include "dbc.h"
 using namespace std;
 
 
 
-struct log {
-	string time_stamp{"0"};
-	string can{"0"};
-	string can_id{"0"};
-	string payload{"0"};
-	int can_id_count=0;
-};
-
-struct obd2 {
-	string name{"0"};
-	string bit_start{"0"};
-	string bit_len{"0"};
-	string little_endian{"0"};
-	string scale{"0"};
-	string offset{"0"};
-	string minimum{"0"};
-	string maxx{"0"};
-	string units{"0"};
-	string pid{"0"};
-};
-
-void reg(regex reg, string str)
+// load the OBD2 signal database
+int setup_obd2(dbc_database &obd2_info, const char *path, ostream &log = cout)
 {
-	smatch m;
-	regex_search(str, m, reg);
-	cout << m.str(0) << endl;
+	auto t0 = chrono::steady_clock::now();
+	if (!obd2_info.load(path)) {
+		std::cerr << "Problem opening file";
+		if (obd2_info.error_line)
+			std::cerr << " (line " << obd2_info.error_line << ": " << obd2_info.error << ")";
+		std::cerr << std::endl;
+		return 1;
+	}
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+	log << "Loaded " << obd2_info.signal_count() << " signals in " << obd2_info.messages.size()
+	     << " messages from " << path << " (" << ms << " ms)" << endl;
+	return 0;
+}
 
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int)
+{
+	stop_requested = 1;
 }
-int setup_obd2(vector<obd2> &obd2_info)
+
+// Streaming mode: follow a growing log (or read candump from a pipe) and
+// print the statistics every interval seconds and once more at the end.
+// Memory stays bounded: the input buffer is fixed and at most max_ids 29 bit
+// ids are tracked.
+int stream_log(const char *path, bool follow, int interval, size_t max_ids)
 {
-	
-	std::ifstream in_file;    
-	in_file.open("C:\\Users\\wlutz\\Documents\\repo\\willRepo\\canCommunication\\OBD2v1.4.dbc");
-	if (!in_file) {
-        std::cerr << "Problem opening file" << std::endl;
-        return 1;
-    }
-	std::string line{};
-	while (std::getline(in_file, line)) {
-		
-		obd2 temp_obd2;
-		cout << line << endl;
-		cout << endl;
-		smatch m; // flag type for determing the matching behavior 
-		regex regexa("[\\.0-9-]+(?=\\])");
-		regex_search(line, m, regexa); // searches pattern regexp in the string "line"
-		temp_obd2.maxx = m.str(0);
-		cout << "max is: " << m.str(0) << endl; // m.str(0) this will show a string representing entire matched expression
-
-		regexa = R"(\[([.0-9-]+))";
-		regex_search(line, m, regexa); // searches pattern regexp in the string "line"
-		temp_obd2.minimum = m.str(1);
-		cout << "min is: " << m.str(1) << endl; 	
-
-		regexa = "[\\.0-9-]+(?=\\))";
-		regex_search(line, m, regexa); // searches pattern regexp in the string "line"
-		temp_obd2.offset = m.str(0);
-		cout << "offset is: " << m.str(0) << endl;
-
-		regexa = R"(\(([.0-9-]+))";
-		regex_search(line, m, regexa); // searches pattern regexp in the string "line"
-		temp_obd2.scale = m.str(1);
-		cout << "scale is: " << m.str(1) << endl; 	
-
-		regexa = R"(@([\.0-9\+]+))";
-		regex_search(line, m, regexa); // searches pattern regexp in the string "line"
-		temp_obd2.little_endian = m.str(1);
-		cout << "little_indian is: " << m.str(1) << endl;
-		
-		regexa = "[0-9]+(?=\\|)";
-		regex_search(line, m, regexa); // searches pattern regexp in the string "line"
-		temp_obd2.bit_len = m.str(0);
-		cout << "bit_len is: " << m.str(0) << endl;
-
-		regexa = R"((([0-9]+)|[0-9]+)@)";
-		regex_search(line, m, regexa); // searches pattern regexp in the string "line"
-		temp_obd2.bit_start = m.str(1);
-		cout << "bit_start is: " << m.str(1)  << endl;
-
-		regexa = R"(\"(.*)\")";
-		regex_search(line, m, regexa); // searches pattern regexp in the string "line"
-		temp_obd2.units = m.str(1);
-		cout << "Units is: " << m.str(1) << endl; 
-
-		regexa = "SG_\\sS1_PID_(..)_([\\S]+)";
-		regex_search(line, m, regexa); // searches pattern regexp in the string "line"
-		temp_obd2.pid = m.str(1);
-		temp_obd2.name = m.str(2);
-		cout << "PID is: " << m.str(1) << " Name is: " << m.str(2) << endl; 
-
-		obd2_info.push_back(temp_obd2);
+	candump_stream in;
+	if (!in.open(path, follow)) {
+		std::cerr << in.error << std::endl;
+		return 1;
 	}
+	signal(SIGINT, request_stop);
+	signal(SIGTERM, request_stop);
 
+	id_table car_log;
+	car_log.set_eff_limit(max_ids);
+	uint64_t frames = 0;
+	auto count = [&](const can_frame_rec &f) {
+		car_log.add(f);
+		frames++;
+	};
+	auto snapshot = [&]() {
+		time_t now = time(nullptr);
+		char when[32];
+		strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+		printf("\n--- %s: %llu frames, %zu ids", when, (unsigned long long)frames, car_log.size());
+		if (car_log.overflow_frames())
+			printf(", %llu frames of untracked ids", (unsigned long long)car_log.overflow_frames());
+		if (in.skipped())
+			printf(", %zu lines skipped", in.skipped());
+		printf(" ---\n");
+		print_stats(car_log);
+		fflush(stdout);
+	};
 
-		
-	in_file.close();
+	const int step = interval > 0 ? interval * 1000 : 1000;
+	auto next = chrono::steady_clock::now() + chrono::milliseconds(step);
+	bool more = true;
+	while (more && !stop_requested) {
+		int left = (int)chrono::duration_cast<chrono::milliseconds>(next - chrono::steady_clock::now()).count();
+		more = in.poll(count, left > 0 ? left : 0);
+		if (interval > 0 && chrono::steady_clock::now() >= next) {
+			snapshot();
+			next += chrono::milliseconds(step);
+		}
+	}
+	if (!in.error.empty()) {
+		std::cerr << in.error << std::endl;
+		return 1;
+	}
+	snapshot();
 	return 0;
 }
 
-//bool compareFunction (car_log a, car_log b) {return a.can_id<b.can_id;} 
-//compare any way you like, here I am using the default string comparison
+// Resampling mode: decode the log with the DBC and write the selected
+// signals (all if signal_list is empty) as CSV rows on a period_ms grid.
+// Rows are written as the input advances, so this works on a pipe or a
+// followed file as well.
+int resample_log(const dbc_database &db, const char *path, bool follow, int period_ms,
+		 resample_policy policy, const char *signal_list, const char *csv_path)
+{
+	dbc_decoder decoder(db);
+	resampler grid((int64_t)period_ms * 1000);
+	string wanted = string(",") + signal_list + ",";
+	auto selected = [&](const string &msg, const string &sig) {
+		return wanted == ",," || wanted.find("," + sig + ",") != string::npos ||
+		       wanted.find("," + msg + "." + sig + ",") != string::npos;
+	};
+	// grid column of every signal, -1 if not selected; indexed like the plans
+	vector<vector<int>> columns(decoder.all().size());
+	size_t widest = 0;
+	for (size_t p = 0; p < decoder.all().size(); p++) {
+		const dbc_message &m = *decoder.all()[p].msg;
+		widest = max(widest, m.signals.size());
+		for (auto &sig : m.signals)
+			columns[p].push_back(m.name != dbc_database::independent_name && selected(m.name, sig.name)
+						     ? (int)grid.add_signal(m.name + "." + sig.name, policy) : -1);
+	}
+	if (grid.size() == 0) {
+		std::cerr << "No signals to resample" << std::endl;
+		return 1;
+	}
 
-int main() {
+	FILE *out = csv_path ? fopen(csv_path, "w") : stdout;
+	if (!out) {
+		std::cerr << "Problem creating file " << csv_path << std::endl;
+		return 1;
+	}
+	fprintf(out, "time");
+	for (size_t c = 0; c < grid.size(); c++)
+		fprintf(out, ",%s", grid.name(c).c_str());
+	fprintf(out, "\n");
 
-	vector<obd2> obd2_info;
-	setup_obd2(obd2_info);
-	vector<log> car_log;
-	
-	// I created the first element in vector and give it a can_id of 000
-	car_log.push_back(log());
+	uint64_t rows = 0;
+	auto row = [&](int64_t t, const double *v, const uint8_t *ok) {
+		fprintf(out, "%lld.%06lld", (long long)(t / 1000000), (long long)(t % 1000000));
+		for (size_t c = 0; c < grid.size(); c++) {
+			if (ok[c])
+				fprintf(out, ",%.9g", v[c]);
+			else
+				fputc(',', out);
+		}
+		fputc('\n', out);
+		rows++;
+	};
 
+	vector<double> values(widest);
+	vector<uint8_t> valid(widest);
+	int64_t watermark = INT64_MIN;
+	auto feed = [&](const can_frame_rec &f) {
+		const message_plan *plan = (f.can_id & CAN_RTR_FLAG) ? nullptr : decoder.find(f.can_id);
+		if (plan) {
+			plan->decode(f, values.data(), valid.data());
+			const vector<int> &col = columns[plan - decoder.all().data()];
+			for (size_t s = 0; s < col.size(); s++)
+				if (valid[s] && col[s] >= 0)
+					grid.push(col[s], f.ts_usec, values[s]);
+		}
+		if (f.ts_usec > watermark)
+			watermark = f.ts_usec;
+		grid.advance(watermark, row);
+	};
 
-	log temp_struct;
+	candump_stream in;
+	if (!in.open(path, follow)) {
+		std::cerr << in.error << std::endl;
+		return 1;
+	}
+	signal(SIGINT, request_stop);
+	signal(SIGTERM, request_stop);
+	while (!stop_requested && in.poll(feed, 1000))
+		fflush(out);
+	grid.flush(row);
+	if (out != stdout)
+		fclose(out);
+	else
+		fflush(out);
 
-	std::ifstream in_file;    
-    in_file.open("C:\\Users\\wlutz\\Documents\\repo\\willRepo\\canCommunication\\candump-2021-02-13_154133.log");
-    if (!in_file) {
+	std::cerr << rows << " rows of " << grid.size() << " signals every " << period_ms << " ms";
+	if (grid.late_samples() || grid.overrun_samples())
+		std::cerr << ", " << grid.late_samples() << " late and " << grid.overrun_samples()
+			  << " overrun samples dropped";
+	std::cerr << std::endl;
+	if (!in.error.empty()) {
+		std::cerr << in.error << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	std::cerr << "usage: " << prog << " [-j threads] [-f] [-s seconds] [-m max_ids]\n"
+		  << "       [-d dbc] [-r ms [-p last|linear|mean] [-S signals] [-o csv]] log\n"
+		  << "  log is a candump or binary log, - reads candump -L output from stdin\n"
+		  << "  -d defaults to OBD2v1.4.dbc in the current directory" << std::endl;
+}
+
+int main(int argc, char **argv) {
+
+	const char *dbc_path = "OBD2v1.4.dbc";	// -d: only used with -r
+	const char *log_path = nullptr;
+	unsigned threads = 1;
+	bool follow = false;		// -f: keep reading the log as it grows
+	int interval = 0;		// -s: seconds between snapshots when streaming
+	size_t max_ids = 65536;		// -m: 29 bit ids tracked when streaming
+	int resample_ms = 0;		// -r: write DBC signals as CSV on this grid
+	resample_policy policy = RESAMPLE_LAST;	// -p last|linear|mean
+	const char *signal_list = "";	// -S: comma separated signal names
+	const char *csv_path = nullptr;	// -o: CSV file instead of stdout
+	for (int i = 1; i < argc; i++) {
+		if (string_view(argv[i]) == "-j" && i + 1 < argc)
+			threads = atoi(argv[++i]);	// 0 = one thread per core
+		else if (string_view(argv[i]) == "-d" && i + 1 < argc)
+			dbc_path = argv[++i];
+		else if (string_view(argv[i]) == "-f")
+			follow = true;
+		else if (string_view(argv[i]) == "-s" && i + 1 < argc)
+			interval = atoi(argv[++i]);
+		else if (string_view(argv[i]) == "-m" && i + 1 < argc)
+			max_ids = strtoul(argv[++i], nullptr, 10);
+		else if (string_view(argv[i]) == "-r" && i + 1 < argc)
+			resample_ms = atoi(argv[++i]);
+		else if (string_view(argv[i]) == "-p" && i + 1 < argc) {
+			string_view p = argv[++i];
+			policy = p == "linear" ? RESAMPLE_LINEAR : p == "mean" ? RESAMPLE_MEAN : RESAMPLE_LAST;
+		}
+		else if (string_view(argv[i]) == "-S" && i + 1 < argc)
+			signal_list = argv[++i];
+		else if (string_view(argv[i]) == "-o" && i + 1 < argc)
+			csv_path = argv[++i];
+		else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+			usage(argv[0]);
+			return 2;
+		}
+		else
+			log_path = argv[i];
+	}
+	if (!log_path) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (resample_ms > 0) {
+		dbc_database db;
+		if (setup_obd2(db, dbc_path, cerr))
+			return 1;
+		return resample_log(db, log_path, follow, resample_ms, policy, signal_list, csv_path);
+	}
+	// "-" reads candump output from a pipe, e.g. candump -L can0 | main -
+	if (follow || interval > 0 || string_view(log_path) == "-") {
+		if (follow && interval <= 0)
+			interval = 10;
+		return stream_log(log_path, follow, interval, max_ids);
+	}
+
+	// the log is mapped and walked in place, no copy is made per line
+	mapped_file in_file(log_path);
+    if (!in_file.good()) {
         std::cerr << "Problem opening file" << std::endl;
         return 1;
     }
-    std::string line{};
-	bool flag{false};
-
-    while (std::getline(in_file, line)) {
-		//string sub = line.substr(25, 3); //get CAN_ID from string
-		temp_struct.can = line.substr(20, 4);
-		temp_struct.can_id = line.substr(25, 3); //get CAN_ID from string
-		temp_struct.time_stamp = line.substr(1, 17);
-		temp_struct.payload = line.substr(30, 16);
-		temp_struct.can_id_count = 0;
-
-		//find car.can_id in vector.  If not there then add it.
-		// for(vector<log>::iterator it = car_log.begin(); it != car_log.end(); it++)
-		// {
-		// 	// int num {3};
-		// 	// if(it->can_id==temp_struct.can_id) {
-		// 	//  	it->can_id_count++;
-		// 	// } 
-		// 	if (it == car_log.end()) {
-		// 		car_log.push_back(temp_struct);
-		// 	}
-		// }
-
-		for(auto & it:car_log)
-			if(it.can_id == temp_struct.can_id) {
-				flag = true;
-				it.can_id_count++;
-				break;
-			} else flag = false;
-			
-		// add temp_struct to car_log if it is not in car_log
-		if(!flag) {
-			car_log.push_back(temp_struct);
-			flag=false;
+
+	// statistics for every CAN id, looked up by the numeric id
+	log_analysis result;
+	if (binlog_reader::is_binlog(in_file)) {
+		// binary logs are decoded chunk by chunk, see canbinlog.cpp
+		binlog_reader bin(log_path);
+		if (!bin.good() || !bin.scan([&](const can_frame_rec &f) { result.ids.add(f); result.frames++; })) {
+			std::cerr << log_path << ": " << bin.error << std::endl;
+			return 1;
 		}
-    }
+	} else {
+		analyze_log(in_file, threads, result);
+	}
+	const id_table &car_log = result.ids;
 
 	cout << "This is how many unique CAN ID's are in the log." << endl;
-	//sort(car_log.begin(),car_log.end(),compareFunction); // sort vector alphabeticaly
-	for(auto st : car_log)
-		cout << st.can_id << " " << st.can_id_count << endl;
+	cout.flush();
+	print_stats(car_log);
     
-	cout << endl << "The number of CAN ID's in the vector: " << car_log.size() << endl;
-    in_file.close();
+	cout << endl << "The number of unique CAN ID's: " << car_log.size() << endl;
+	if (result.skipped)
+		cout << "Lines skipped: " << result.skipped << endl;
     return 0;
 }
@@ -0,0 +1,203 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \file ctbbench.cpp
+/// \brief Request round trips per second through the ctb serial port.
+///
+/// A thread plays a minimal ELM327 on the master side of a pseudo
+/// terminal and answers every command with a fixed response and prompt.
+/// The benchmark opens the slave side with ctb::SerialPort and sends
+/// requests the way obdbase does (Write, then ReadUntilEOS up to the
+/// prompt), or with -v reads the response with Readv. With -r the
+/// port's reader thread drains the device and the requests read from
+/// its ring.
+///
+///	ctbbench [-n requests] [-d answer_delay_us] [-v] [-r]
+///
+/// Before the round trips a few ctb::Fifo sequences are checked, a
+/// wrong result counts as a failed request.
+///
+/// Only the public ctb interface is used, so the same source can be
+/// built against an older ctb to compare the numbers (without -r,
+/// which needs SerialPort::StartReader).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <pty.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "ctb-0.15/ctb.h"
+#include "ctb-0.15/fifo.h"
+
+/// the answer of the fake adapter to every command
+static const char response[] = "41 0C 1A F8\r\r>";
+
+struct adapter {
+	int fd;
+	int delay_us;
+};
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/// Check clear() and reads across the end of the buffer, return the
+/// number of failed checks.
+static int check_fifo()
+{
+	int failed = 0;
+	char buf[16];
+	ctb::Fifo fifo(8);
+
+	// clear() after the reader cached the write position
+	fifo.write("ab", 2);
+	fifo.read(buf, 1);
+	fifo.write("cdef", 4);
+	fifo.clear();
+	if (fifo.read(buf, sizeof(buf)) != 0 || fifo.items() != 0) {
+		fprintf(stderr, "fifo: bytes left after clear\n");
+		failed++;
+	}
+
+	// a write and a read wrapping around the end of the buffer
+	fifo.write("0123456", 7);
+	if (fifo.read(buf, sizeof(buf)) != 7 || memcmp(buf, "0123456", 7) != 0) {
+		fprintf(stderr, "fifo: wrong bytes after clear\n");
+		failed++;
+	}
+	return failed;
+}
+
+/// The fake adapter: answer each command terminated by CR, stop on EOF.
+static void* adapter_thread(void* arg)
+{
+	adapter* a = (adapter*)arg;
+	char buf[256];
+	int n;
+
+	while ((n = read(a->fd, buf, sizeof(buf))) > 0) {
+		for (int i = 0; i < n; i++) {
+			if (buf[i] != '\r')
+				continue;
+			if (a->delay_us)
+				usleep(a->delay_us);
+			if (write(a->fd, response, sizeof(response) - 1) < 0)
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	int requests = 2000;
+	int delay_us = 0;
+	bool readv = false;
+	bool reader = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:d:vr")) != -1) {
+		switch (opt) {
+		case 'n':
+			requests = atoi(optarg);
+			break;
+		case 'd':
+			delay_us = atoi(optarg);
+			break;
+		case 'v':
+			readv = true;
+			break;
+		case 'r':
+			reader = true;
+			break;
+		default:
+			fprintf(stderr, "usage: ctbbench [-n requests] [-d answer_delay_us] [-v] [-r]\n");
+			return 2;
+		}
+	}
+
+	int master, slave;
+	char name[64];
+	if (openpty(&master, &slave, name, NULL, NULL) < 0) {
+		perror("openpty");
+		return 1;
+	}
+	// no echo and no line discipline on the adapter side
+	struct termios t;
+	tcgetattr(slave, &t);
+	cfmakeraw(&t);
+	tcsetattr(slave, TCSANOW, &t);
+
+	adapter a = { master, delay_us };
+	pthread_t tid;
+	pthread_create(&tid, NULL, adapter_thread, &a);
+
+	ctb::SerialPort port;
+	if (port.Open(name, 38400) < 0) {
+		fprintf(stderr, "cannot open %s\n", name);
+		return 1;
+	}
+	if (reader && port.StartReader() < 0) {
+		fprintf(stderr, "cannot start the reader thread\n");
+		return 1;
+	}
+
+	char cmd[] = "010C\r";
+	char eos[] = ">";
+	char answer[sizeof(response)];
+	int failed = check_fifo();
+	double worst = 0;
+	double start = now_ms();
+
+	for (int i = 0; i < requests; i++) {
+		double t0 = now_ms();
+		port.Writev(cmd, strlen(cmd), 1000);
+		if (readv) {
+			if (port.Readv(answer, sizeof(response) - 1, 1000) != (int)sizeof(response) - 1)
+				failed++;
+		} else {
+			char* buff = NULL;
+			size_t size;
+			if (port.ReadUntilEOS(buff, &size, eos, 1000, 0) != 1)
+				failed++;
+			delete[] buff;
+		}
+		double dt = now_ms() - t0;
+		if (dt > worst)
+			worst = dt;
+	}
+
+	double elapsed = now_ms() - start;
+	printf("%d requests in %.1f ms: %.0f round trips/s, mean %.3f ms, worst %.3f ms, %d failed\n",
+		   requests, elapsed, requests * 1000.0 / elapsed, elapsed / requests, worst, failed);
+
+	// the adapter thread sees EOF when the last slave descriptor closes
+	port.Close();
+	close(slave);
+	pthread_join(tid, NULL);
+	close(master);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,1174 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \file elmsim.cpp
+/// \brief An ELM327 and the ECUs behind it, on a pseudo terminal.
+///
+/// Prints the name of the slave side of a pseudo terminal, which
+/// openobd opens like the serial port of a real device, then answers
+/// the AT commands elm327.cpp sends and OBD requests of modes 01, 03,
+/// 04 and 09 until it is stopped.  The slave side is kept open, so
+/// clients can come and go.
+///
+/// The ECUs come from a model file, else a built in engine and
+/// transmission ECU are used.  A candump log (candump -l) can be
+/// replayed too: the OBD answers found in it are served in turn, one
+/// per request, and its frames are what AT MA shows.
+///
+///	elmsim [-m model] [-r candump.log] [-p protocol] [-v version]
+///	       [-d latency_us] [-j jitter_us] [-w] [-b baud] [-t]
+///	       [-l link] [-n requests]
+///
+/// -d and -j delay every OBD answer, -w adds the wait a real device
+/// does for more ECUs after the last answer (AT ST, AT AT0-2, and the
+/// answer count after the request), -b slows the output down to the
+/// given serial rate and follows AT BRD.  -t shows the frames of AT MA
+/// at the pace of the log.  -l makes a symbolic link to the terminal,
+/// -n stops after so many OBD requests.  The counts are printed on
+/// stderr at the end.
+///
+/// A model file has one statement per line, # starts a comment:
+///
+///	ecu 7E8					following lines are of the ECU with this CAN id
+///	pid 0C 1A F8			mode 01 pid and its data bytes
+///	sweep 0D 00 78 01		pid going from one value to the other and back
+///	dtc P0133				stored trouble code
+///	vin 1D4GP00R55B123456
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <poll.h>
+#include <pty.h>
+#include <string>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+typedef std::vector<unsigned char> bytes;
+
+/// the values one pid takes, one per request
+struct pidValues {
+	std::vector<bytes> values;
+	size_t next;
+};
+
+struct ecu {
+	unsigned long id;					///< CAN id of the answers
+	std::map<int, pidValues> pids;		///< mode 01
+	std::vector<unsigned short> dtcs;
+	std::string vin;
+};
+
+/// a frame of the candump log
+struct frame {
+	double time;
+	unsigned long id;
+	bool extended;
+	unsigned char length;
+	unsigned char data[8];
+};
+
+struct reply {
+	size_t ecu;
+	bytes payload;
+};
+
+struct sim {
+	int fd;
+
+	// options
+	int vehicle;			///< protocol the ECUs talk
+	double version;
+	long latency;
+	long jitter;
+	bool wait;
+	bool emulateBaud;
+	bool realtime;
+	long maxRequests;
+
+	// the device settings
+	bool echo;
+	bool linefeeds;
+	bool spaces;
+	bool headers;
+	bool autoformat;
+	int protocol;			///< as set with AT SP, 0 automatic
+	bool searched;
+	int timing;
+	int st;
+	int brt;
+	long baud;
+	std::string last;
+
+	std::vector<ecu> ecus;
+	std::vector<frame> frames;
+
+	// counts
+	long commands;
+	long requests;
+	long noData;
+	long long sent;
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static const char* protocolNames[] = {
+	"AUTO", "SAE J1850 PWM", "SAE J1850 VPW", "ISO 9141-2",
+	"ISO 14230-4 (KWP 5BAUD)", "ISO 14230-4 (KWP FAST)",
+	"ISO 15765-4 (CAN 11/500)", "ISO 15765-4 (CAN 29/500)",
+	"ISO 15765-4 (CAN 11/250)", "ISO 15765-4 (CAN 29/250)"
+};
+
+static void on_signal(int)
+{
+	stop = 1;
+}
+
+static double now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void sleep_us(double us)
+{
+	if (us <= 0)
+		return;
+	struct timespec ts;
+	ts.tv_sec = (time_t)(us / 1e6);
+	ts.tv_nsec = (long)((us - ts.tv_sec * 1e6) * 1e3);
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR && !stop)
+		;
+}
+
+static int hexval(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c = toupper((unsigned char)c);
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/// Hex digits to bytes, false if not an even number of hex digits.
+static bool parse_hex(const char* text, bytes& out)
+{
+	out.clear();
+	for (const char* p = text; *p; p++) {
+		if (isspace((unsigned char)*p))
+			continue;
+		if (hexval(p[0]) < 0 || !p[1] || hexval(p[1]) < 0)
+			return false;
+		out.push_back(hexval(p[0]) << 4 | hexval(p[1]));
+		p++;
+	}
+	return true;
+}
+
+static bool is_can(int protocol)
+{
+	return protocol >= 6 && protocol <= 9;
+}
+
+static bool is_extended(int protocol)
+{
+	return protocol == 7 || protocol == 9;
+}
+
+/// Send text to the client.  At an emulated rate each line goes out
+/// once the time to send it has passed, as a device sends the frames
+/// as they come.
+static void emit(sim& s, const std::string& text)
+{
+	size_t done = 0;
+	size_t end = text.size();
+
+	while (done < text.size()) {
+		if (s.emulateBaud) {
+			end = text.find('\r', done);
+			end = (end == std::string::npos) ? text.size() : end + 1;
+			sleep_us((end - done) * 10 * 1e6 / s.baud);
+		}
+		while (done < end) {
+			ssize_t n = write(s.fd, text.data() + done, end - done);
+			if (n < 0) {
+				if (errno == EINTR && !stop)
+					continue;
+				return;
+			}
+			done += n;
+		}
+	}
+	s.sent += text.size();
+}
+
+static const char* eol(const sim& s)
+{
+	return s.linefeeds ? "\r\n" : "\r";
+}
+
+static void put_bytes(const sim& s, std::string& out, const unsigned char* b, size_t n)
+{
+	char hex[4];
+	for (size_t i = 0; i < n; i++) {
+		snprintf(hex, sizeof(hex), "%02X", b[i]);
+		if (s.spaces && !out.empty() && out[out.size() - 1] != '\n' && out[out.size() - 1] != '\r')
+			out += ' ';
+		out += hex;
+	}
+}
+
+/// The answer id of an ECU in the form the protocol uses: 7E8 and
+/// 18DAF110 are both the engine, 7E9 and 18DAF118 the gearbox.
+static unsigned long ecu_id(unsigned long id, bool extended)
+{
+	if (extended && id <= 0x7FF)
+		return 0x18DAF100 | (0x10 + 8 * ((id - 0x7E8) & 0x07));
+	if (!extended && id > 0x7FF)
+		return 0x7E8 + ((((id & 0xFF) - 0x10) / 8) & 0x07);
+	return id;
+}
+
+/// A CAN id the way the device shows it: 7E8, or 18 DA F1 10.
+static void put_id(const sim& s, std::string& out, unsigned long id, bool extended)
+{
+	unsigned char b[4] = {
+		(unsigned char)(id >> 24), (unsigned char)(id >> 16),
+		(unsigned char)(id >> 8), (unsigned char)id
+	};
+	char hex[4];
+
+	if (extended) {
+		put_bytes(s, out, b, 4);
+	} else {
+		snprintf(hex, sizeof(hex), "%03lX", id & 0x7FF);
+		out += hex;
+	}
+}
+
+// ---------------------------------------------------------------- ECUs
+
+/// The value of a pid for the next request, false if not supported.
+static bool pid_value(ecu& e, int pid, bytes& data)
+{
+	int highest = 1;
+	if (!e.pids.empty())
+		highest = std::max(highest, e.pids.rbegin()->first);
+
+	data.clear();
+	if (pid % 0x20 == 0) {
+		// supported pids, the last bit for the next range
+		if (pid > 0 && highest <= pid)
+			return false;
+		unsigned long mask = 0;
+		for (int p = pid + 1; p <= pid + 0x20; p++) {
+			bool has = e.pids.count(p) || p == 1 ||
+				(p == pid + 0x20 && highest > pid + 0x20);
+			if (has)
+				mask |= 1UL << (pid + 0x20 - p);
+		}
+		for (int k = 3; k >= 0; k--)
+			data.push_back((mask >> (8 * k)) & 0xFF);
+		return true;
+	}
+
+	std::map<int, pidValues>::iterator it = e.pids.find(pid);
+	if (it != e.pids.end() && !it->second.values.empty()) {
+		pidValues& v = it->second;
+		data = v.values[v.next];
+		v.next = (v.next + 1) % v.values.size();
+		return true;
+	}
+
+	if (pid == 0x01) {
+		// MIL and number of codes, the tests of a spark ignition engine
+		data.push_back((e.dtcs.empty() ? 0 : 0x80) | (e.dtcs.size() & 0x7F));
+		data.push_back(0x07);
+		data.push_back(0x65);
+		data.push_back(0x00);
+		return true;
+	}
+	return false;
+}
+
+/// What each ECU answers to a request.
+static void obd_answers(sim& s, const bytes& req, std::vector<reply>& replies)
+{
+	bytes data;
+	int mode = req[0];
+
+	replies.clear();
+	for (size_t i = 0; i < s.ecus.size(); i++) {
+		ecu& e = s.ecus[i];
+		reply r;
+		r.ecu = i;
+		r.payload.push_back(mode + 0x40);
+
+		switch (mode) {
+		case 0x01:
+			// CAN takes up to six pids at once, the others one
+			for (size_t k = 1; k < req.size() && k <= (is_can(s.vehicle) ? 6u : 1u); k++) {
+				if (pid_value(e, req[k], data)) {
+					r.payload.push_back(req[k]);
+					r.payload.insert(r.payload.end(), data.begin(), data.end());
+				}
+			}
+			if (r.payload.size() == 1)
+				continue;
+			break;
+		case 0x03:
+			r.payload.push_back(e.dtcs.size());
+			for (size_t k = 0; k < e.dtcs.size(); k++) {
+				r.payload.push_back(e.dtcs[k] >> 8);
+				r.payload.push_back(e.dtcs[k] & 0xFF);
+			}
+			break;
+		case 0x04:
+			e.dtcs.clear();
+			break;
+		case 0x09:
+			if (req.size() < 2 || e.vin.empty())
+				continue;
+			r.payload.push_back(req[1]);
+			if (req[1] == 0x00) {
+				r.payload.push_back(0x40);
+				r.payload.push_back(0x00);
+				r.payload.push_back(0x00);
+				r.payload.push_back(0x00);
+			} else if (req[1] == 0x02) {
+				r.payload.push_back(0x01);
+				r.payload.insert(r.payload.end(), e.vin.begin(), e.vin.end());
+			} else {
+				continue;
+			}
+			break;
+		default:
+			continue;
+		}
+		replies.push_back(r);
+	}
+}
+
+/// Lines of a CAN answer: single frame, or first and consecutive frames.
+static void format_can(const sim& s, std::string& out, const ecu& e, const bytes& p)
+{
+	bool pci = s.headers || !s.autoformat;
+	unsigned char b[2];
+
+	if (p.size() <= 7) {
+		if (s.headers)
+			put_id(s, out, ecu_id(e.id, is_extended(s.vehicle)), is_extended(s.vehicle));
+		if (pci) {
+			b[0] = p.size();
+			put_bytes(s, out, b, 1);
+		}
+		put_bytes(s, out, &p[0], p.size());
+		out += eol(s);
+		return;
+	}
+
+	size_t at = 0;
+	for (int n = 0; at < p.size(); n++) {
+		size_t chunk = (n == 0) ? 6 : 7;
+		if (chunk > p.size() - at)
+			chunk = p.size() - at;
+		if (!pci && n == 0) {
+			char count[8];
+			snprintf(count, sizeof(count), "%03X", (unsigned)p.size());
+			out += count;
+			out += eol(s);
+		}
+		if (s.headers)
+			put_id(s, out, ecu_id(e.id, is_extended(s.vehicle)), is_extended(s.vehicle));
+		if (pci) {
+			if (n == 0) {
+				b[0] = 0x10 | ((p.size() >> 8) & 0x0F);
+				b[1] = p.size() & 0xFF;
+				put_bytes(s, out, b, 2);
+			} else {
+				b[0] = 0x20 | (n & 0x0F);
+				put_bytes(s, out, b, 1);
+			}
+		} else {
+			char index[8];
+			snprintf(index, sizeof(index), "%X:", n & 0x0F);
+			out += index;
+		}
+		put_bytes(s, out, &p[at], chunk);
+		out += eol(s);
+		at += chunk;
+	}
+}
+
+/// One line of the older protocols: three header bytes, the data and
+/// the checksum.
+static void format_legacy_line(const sim& s, std::string& out, const ecu& e, const bytes& data)
+{
+	bytes line;
+	if (s.vehicle <= 3) {
+		line.push_back(s.vehicle == 1 ? 0x41 : 0x48);
+		line.push_back(0x6B);
+	} else {
+		line.push_back(0x80 | data.size());
+		line.push_back(0xF1);
+	}
+	line.push_back(0x10 + 8 * ((ecu_id(e.id, false) - 0x7E8) & 0x07));
+	line.insert(line.end(), data.begin(), data.end());
+	unsigned char sum = 0;
+	for (size_t i = 0; i < line.size(); i++)
+		sum += line[i];
+	line.push_back(sum);
+
+	if (s.headers)
+		put_bytes(s, out, &line[0], line.size());
+	else
+		put_bytes(s, out, &line[3], data.size());
+	out += eol(s);
+}
+
+/// Answers longer than a message are split the way these protocols do:
+/// three trouble codes a line, the VIN four characters a line.
+static void format_legacy(const sim& s, std::string& out, const ecu& e, const bytes& p)
+{
+	bytes line;
+
+	if (p[0] == 0x43) {
+		size_t count = p[1];
+		for (size_t k = 0; k == 0 || k < count; k += 3) {
+			line.assign(1, 0x43);
+			for (size_t d = k; d < k + 3; d++) {
+				line.push_back(d < count ? p[2 + 2 * d] : 0);
+				line.push_back(d < count ? p[3 + 2 * d] : 0);
+			}
+			format_legacy_line(s, out, e, line);
+		}
+		return;
+	}
+	if (p[0] == 0x49 && p.size() > 7) {
+		// the data after the count, front padded to a multiple of four
+		bytes vin(p.begin() + 3, p.end());
+		vin.insert(vin.begin(), (4 - vin.size() % 4) % 4, 0);
+		for (size_t k = 0; k < vin.size(); k += 4) {
+			line.assign(p.begin(), p.begin() + 2);
+			line.push_back(k / 4 + 1);
+			line.insert(line.end(), vin.begin() + k, vin.begin() + k + 4);
+			format_legacy_line(s, out, e, line);
+		}
+		return;
+	}
+	format_legacy_line(s, out, e, p);
+}
+
+static void obd_request(sim& s, const std::string& cmd)
+{
+	std::string text(cmd);
+	int expected = 0;
+	bytes req;
+
+	// an odd digit after the request is the number of answers to wait for
+	if (text.size() > 2 && text.size() % 2) {
+		expected = hexval(text[text.size() - 1]);
+		text.erase(text.size() - 1);
+	}
+	if (!parse_hex(text.c_str(), req) || req.empty()) {
+		emit(s, std::string("?") + eol(s) + eol(s) + ">");
+		return;
+	}
+	s.requests++;
+
+	std::string out;
+	if (s.protocol == 0 && !s.searched) {
+		out += "SEARCHING...";
+		out += eol(s);
+	}
+	s.searched = true;
+
+	if (s.protocol != 0 && s.protocol != s.vehicle) {
+		out += "UNABLE TO CONNECT";
+		out += eol(s);
+		out += eol(s);
+		out += ">";
+		sleep_us(s.st * 4000.0);
+		emit(s, out);
+		return;
+	}
+
+	std::vector<reply> replies;
+	obd_answers(s, req, replies);
+	if (expected > 0 && (size_t)expected < replies.size())
+		replies.resize(expected);
+
+	long delay = s.latency;
+	if (s.jitter > 0)
+		delay += rand() % (s.jitter + 1);
+	sleep_us(delay);
+
+	for (size_t i = 0; i < replies.size(); i++) {
+		if (is_can(s.vehicle))
+			format_can(s, out, s.ecus[replies[i].ecu], replies[i].payload);
+		else
+			format_legacy(s, out, s.ecus[replies[i].ecu], replies[i].payload);
+	}
+
+	if (replies.empty()) {
+		s.noData++;
+		out += "NO DATA";
+		out += eol(s);
+		if (s.wait)
+			sleep_us(s.st * 4000.0);
+	} else if (s.wait && (expected == 0 || (size_t)expected > replies.size())) {
+		// the frames go out as they come in, then the device waits
+		// for more ECUs: with adaptive timing about as long as the
+		// answer took, but never longer than AT ST
+		double timeout = s.st * 4000.0;
+		double adaptive = (s.timing == 2 ? 1.0 : 2.0) * (delay + 1000);
+		emit(s, out);
+		out.clear();
+		sleep_us(s.timing == 0 ? timeout : std::min(timeout, adaptive));
+	}
+	out += eol(s);
+	out += ">";
+	emit(s, out);
+}
+
+// ---------------------------------------------------------------- AT
+
+static void reset(sim& s)
+{
+	s.echo = true;
+	s.linefeeds = false;
+	s.spaces = true;
+	s.headers = false;
+	s.autoformat = true;
+	s.protocol = 0;
+	s.searched = false;
+	s.timing = 1;
+	s.st = 0x32;
+	s.brt = 0x0F;
+}
+
+static std::string identity(const sim& s)
+{
+	char id[32];
+	snprintf(id, sizeof(id), "ELM327 v%.1f", s.version);
+	return id;
+}
+
+/// AT BRD: OK, the identity at the new rate, and the new rate is kept
+/// if a CR comes back within the AT BRT time.
+static void baud_switch(sim& s, int divisor)
+{
+	long old = s.baud;
+
+	emit(s, std::string("OK") + eol(s));
+	s.baud = 4000000 / divisor;
+	sleep_us(1000);
+	emit(s, identity(s) + eol(s));
+
+	double end = now_us() + s.brt * 5000.0;
+	bool confirmed = false;
+	char buf[64];
+	while (!confirmed && !stop) {
+		int left = (int)((end - now_us()) / 1000);
+		struct pollfd pfd = { s.fd, POLLIN, 0 };
+		if (left <= 0 || poll(&pfd, 1, left) <= 0)
+			break;
+		ssize_t n = read(s.fd, buf, sizeof(buf));
+		for (ssize_t i = 0; i < n; i++)
+			confirmed = confirmed || buf[i] == '\r';
+	}
+	if (confirmed) {
+		emit(s, std::string("OK") + eol(s) + eol(s) + ">");
+	} else {
+		s.baud = old;
+		emit(s, std::string(eol(s)) + ">");
+	}
+}
+
+/// AT MA: the frames of the log until the client sends anything.
+static void monitor(sim& s)
+{
+	std::string out;
+	double start = now_us();
+	double first = s.frames.empty() ? 0 : s.frames[0].time;
+
+	for (size_t i = 0; !stop; i = (i + 1) % (s.frames.empty() ? 1 : s.frames.size())) {
+		struct pollfd pfd = { s.fd, POLLIN, 0 };
+		int wait = 0;
+		if (s.frames.empty()) {
+			wait = -1;
+		} else if (s.realtime) {
+			if (i == 0) {
+				start = now_us();
+			}
+			wait = (int)((start + (s.frames[i].time - first) * 1e6 - now_us()) / 1000);
+			if (wait < 0)
+				wait = 0;
+		}
+		if (poll(&pfd, 1, wait) > 0) {
+			char buf[64];
+			if (read(s.fd, buf, sizeof(buf)) < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+		if (s.frames.empty())
+			continue;
+
+		const frame& f = s.frames[i];
+		out.clear();
+		put_id(s, out, f.id, f.extended);
+		put_bytes(s, out, f.data, f.length);
+		out += eol(s);
+		emit(s, out);
+	}
+	emit(s, std::string(eol(s)) + ">");
+}
+
+static void at_command(sim& s, const std::string& cmd)
+{
+	// settings the client may send which change nothing here
+	static const char* ignored[] = {
+		"M0", "M1", "PC", "AL", "NL", "R0", "R1", "V0", "V1", "CFC0", "CFC1",
+		"D0", "D1", "KW0", "KW1", "AR", "CRA", "CEA", "SS", "LP"
+	};
+	std::string out;
+	std::string c = cmd.substr(2);
+	int value = c.size() >= 2 ? (int)strtol(c.substr(c.size() - 2).c_str(), NULL, 16) : 0;
+
+	s.commands++;
+	if (c == "Z" || c == "WS") {
+		reset(s);
+		out = std::string(eol(s)) + eol(s) + identity(s);
+	} else if (c == "D") {
+		reset(s);
+		out = "OK";
+	} else if (c == "I") {
+		out = identity(s);
+	} else if (c == "@1") {
+		out = "OBDII to RS232 Interpreter";
+	} else if (c == "RV") {
+		out = "12.6V";
+	} else if (c == "E0" || c == "E1") {
+		s.echo = (c[1] == '1');
+		out = "OK";
+	} else if (c == "L0" || c == "L1") {
+		s.linefeeds = (c[1] == '1');
+		out = "OK";
+	} else if (c == "S0" || c == "S1") {
+		s.spaces = (c[1] == '1');
+		out = "OK";
+	} else if (c == "H0" || c == "H1") {
+		s.headers = (c[1] == '1');
+		out = "OK";
+	} else if (c == "CAF0" || c == "CAF1") {
+		s.autoformat = (c[3] == '1');
+		out = "OK";
+	} else if (c == "DP") {
+		if (s.protocol == 0)
+			out = s.searched ? std::string("AUTO, ") + protocolNames[s.vehicle] : "AUTO";
+		else
+			out = protocolNames[s.protocol];
+	} else if (c == "DPN") {
+		char num[4];
+		if (s.protocol == 0)
+			snprintf(num, sizeof(num), "A%X", s.searched ? s.vehicle : 0);
+		else
+			snprintf(num, sizeof(num), "%X", s.protocol);
+		out = num;
+	} else if ((c.compare(0, 2, "SP") == 0 || c.compare(0, 2, "TP") == 0) && c.size() >= 3) {
+		// SP A6 is automatic, starting with 6
+		int p = hexval(c[c.size() - 1]);
+		if (p < 0 || p > 9) {
+			out = "?";
+		} else {
+			s.protocol = (c[2] == 'A') ? 0 : p;
+			s.searched = false;
+			out = "OK";
+		}
+	} else if (c == "SI" || c == "FI") {
+		int p = s.protocol ? s.protocol : s.vehicle;
+		out = (p >= 3 && p <= 5) ? "BUS INIT: ...OK" : "?";
+	} else if (c.compare(0, 2, "ST") == 0 && c.size() > 2) {
+		s.st = value ? value : 0x32;
+		out = "OK";
+	} else if (c == "AT0" || c == "AT1" || c == "AT2") {
+		s.timing = c[2] - '0';
+		out = "OK";
+	} else if (c.compare(0, 3, "BRT") == 0 && c.size() > 3) {
+		s.brt = value;
+		out = "OK";
+	} else if (c.compare(0, 3, "BRD") == 0 && c.size() > 3 && s.version >= 1.2) {
+		if (value < 8) {
+			out = "?";
+		} else {
+			baud_switch(s, value);
+			return;
+		}
+	} else if (c == "MA") {
+		monitor(s);
+		return;
+	} else if (c.compare(0, 2, "SH") == 0) {
+		out = "OK";
+	} else {
+		out = "?";
+		for (size_t i = 0; i < sizeof(ignored) / sizeof(ignored[0]); i++) {
+			if (c == ignored[i])
+				out = "OK";
+		}
+	}
+
+	emit(s, out + eol(s) + eol(s) + ">");
+}
+
+static void command(sim& s, const std::string& line)
+{
+	std::string cmd;
+
+	for (size_t i = 0; i < line.size(); i++) {
+		if (!isspace((unsigned char)line[i]))
+			cmd += toupper((unsigned char)line[i]);
+	}
+	if (s.echo)
+		emit(s, line + eol(s));
+
+	// an empty line repeats the last command
+	if (cmd.empty())
+		cmd = s.last;
+	if (cmd.empty()) {
+		emit(s, ">");
+		return;
+	}
+	s.last = cmd;
+
+	if (cmd.compare(0, 2, "AT") == 0)
+		at_command(s, cmd);
+	else
+		obd_request(s, cmd);
+}
+
+// ---------------------------------------------------------------- input
+
+static ecu* find_ecu(sim& s, unsigned long id)
+{
+	for (size_t i = 0; i < s.ecus.size(); i++) {
+		if (s.ecus[i].id == id)
+			return &s.ecus[i];
+	}
+	ecu e;
+	e.id = id;
+	s.ecus.push_back(e);
+	return &s.ecus.back();
+}
+
+static bool parse_dtc(const char* text, unsigned short* code)
+{
+	static const char letters[] = "PCBU";
+	const char* l = strchr(letters, toupper((unsigned char)text[0]));
+	if (!text[0] || !l || strlen(text) != 5)
+		return false;
+	unsigned short v = (l - letters) << 14;
+	for (int i = 1; i < 5; i++) {
+		if (hexval(text[i]) < 0)
+			return false;
+		v |= hexval(text[i]) << (4 * (4 - i));
+	}
+	*code = v;
+	return true;
+}
+
+/// One statement of a model, false if it makes no sense.
+static bool model_line(sim& s, ecu*& current, const char* line)
+{
+	char word[16];
+	char rest[240] = "";
+	bytes data;
+	unsigned long id;
+	unsigned int pid;
+	int used = 0;
+
+	if (sscanf(line, "%15s %239[^\n]", word, rest) < 1)
+		return true;
+
+	if (strcmp(word, "ecu") == 0) {
+		if (sscanf(rest, "%lx", &id) != 1)
+			return false;
+		current = find_ecu(s, id);
+		return true;
+	}
+	if (!current)
+		return false;
+
+	if (strcmp(word, "pid") == 0) {
+		if (sscanf(rest, "%x %n", &pid, &used) != 1 || pid > 0xFF ||
+			!parse_hex(rest + used, data) || data.empty())
+			return false;
+		current->pids[pid].values.assign(1, data);
+		current->pids[pid].next = 0;
+		return true;
+	}
+	if (strcmp(word, "sweep") == 0) {
+		char from[32], to[32], step[32];
+		bytes a, b, d;
+		if (sscanf(rest, "%x %31s %31s %31s", &pid, from, to, step) != 4 || pid > 0xFF ||
+			!parse_hex(from, a) || !parse_hex(to, b) || !parse_hex(step, d) ||
+			a.empty() || a.size() != b.size() || a.size() > 4 || d.size() > 4)
+			return false;
+
+		// up and back down, a few thousand values at most
+		long lo = 0, hi = 0, inc = 0;
+		for (size_t k = 0; k < a.size(); k++) {
+			lo = lo << 8 | a[k];
+			hi = hi << 8 | b[k];
+		}
+		for (size_t k = 0; k < d.size(); k++)
+			inc = inc << 8 | d[k];
+		if (hi < lo)
+			std::swap(lo, hi);
+		inc = std::max(inc, (hi - lo) / 2048 + 1);
+
+		pidValues& v = current->pids[pid];
+		v.values.clear();
+		v.next = 0;
+		for (long x = lo; x <= hi; x += inc) {
+			data.clear();
+			for (int k = a.size() - 1; k >= 0; k--)
+				data.push_back((x >> (8 * k)) & 0xFF);
+			v.values.push_back(data);
+		}
+		for (size_t k = v.values.size() - 1; k > 1; k--)
+			v.values.push_back(v.values[k - 1]);
+		return true;
+	}
+	if (strcmp(word, "dtc") == 0) {
+		unsigned short code;
+		if (!parse_dtc(rest, &code))
+			return false;
+		current->dtcs.push_back(code);
+		return true;
+	}
+	if (strcmp(word, "vin") == 0) {
+		if (strlen(rest) != 17)
+			return false;
+		current->vin = rest;
+		return true;
+	}
+	return false;
+}
+
+static bool load_model(sim& s, const char* path)
+{
+	FILE* f = fopen(path, "r");
+	char line[256];
+	int number = 0;
+	ecu* current = NULL;
+
+	if (!f) {
+		perror(path);
+		return false;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		number++;
+		char* hash = strchr(line, '#');
+		if (hash)
+			*hash = 0;
+		if (!model_line(s, current, line)) {
+			fprintf(stderr, "%s:%d: cannot use '%s'\n", path, number, line);
+			fclose(f);
+			return false;
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+/// An engine running through its rev range, and a gearbox.
+static void builtin_model(sim& s)
+{
+	static const char* model[] = {
+		"ecu 7E8",
+		"pid 04 80",
+		"pid 05 7B",
+		"sweep 0C 0BB8 3E80 0064",
+		"sweep 0D 00 78 01",
+		"pid 0F 44",
+		"pid 10 01 2C",
+		"pid 11 40",
+		"pid 1F 00 8C",
+		"pid 21 00 00",
+		"pid 2F 99",
+		"pid 33 64",
+		"pid 42 31 10",
+		"pid 46 3C",
+		"dtc P0133",
+		"vin 1D4GP00R55B123456",
+		"ecu 7E9",
+		"sweep 0D 00 78 01",
+		"pid 1C 06"
+	};
+	ecu* current = NULL;
+
+	for (size_t i = 0; i < sizeof(model) / sizeof(model[0]); i++)
+		model_line(s, current, model[i]);
+}
+
+/// Takes the frames of a candump log, and the answers to OBD requests
+/// in it: the values of a single pid, the trouble codes and the VIN.
+static int load_candump(sim& s, const char* path)
+{
+	struct partial {
+		bytes data;
+		size_t expected;
+	};
+	std::map<unsigned long, partial> open;
+	FILE* f = fopen(path, "r");
+	char line[256];
+	int pidsAsked = 1;
+	int answers = 0;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		frame fr;
+		char id[16], data[40];
+		bytes b;
+
+		if (sscanf(line, "(%lf) %*s %15[0-9A-Fa-f]#%39[0-9A-Fa-f]", &fr.time, id, data) != 3 ||
+			!parse_hex(data, b) || b.size() > 8)
+			continue;
+		fr.id = strtoul(id, NULL, 16);
+		fr.extended = strlen(id) > 3;
+		fr.length = b.size();
+		std::copy(b.begin(), b.end(), fr.data);
+		s.frames.push_back(fr);
+		if (b.empty())
+			continue;
+
+		// requests, functional or to one ECU
+		if (fr.id == 0x7DF || (fr.id >= 0x7E0 && fr.id <= 0x7E7) ||
+			(fr.id & 0xFFFF00FF) == 0x18DA00F1 || fr.id == 0x18DB33F1) {
+			if ((b[0] >> 4) == 0 && b.size() > 1 && b[1] == 0x01)
+				pidsAsked = (b[0] & 0x0F) - 1;
+			continue;
+		}
+		if (!((fr.id >= 0x7E8 && fr.id <= 0x7EF) || (fr.id & 0xFFFFFF00) == 0x18DAF100))
+			continue;
+
+		// ISO 15765 reassembly of the answer
+		partial& m = open[fr.id];
+		switch (b[0] >> 4) {
+		case 0:
+			m.expected = b[0] & 0x0F;
+			m.data.assign(b.begin() + 1, b.end());
+			break;
+		case 1:
+			if (b.size() < 2)
+				continue;
+			m.expected = ((b[0] & 0x0F) << 8) | b[1];
+			m.data.assign(b.begin() + 2, b.end());
+			break;
+		case 2:
+			if (m.data.empty())
+				continue;
+			m.data.insert(m.data.end(), b.begin() + 1, b.end());
+			break;
+		default:
+			continue;
+		}
+		if (m.data.size() < m.expected || m.expected < 2)
+			continue;
+		m.data.resize(m.expected);
+
+		const bytes& p = m.data;
+		ecu* e = find_ecu(s, fr.id);
+		if (p[0] == 0x41 && pidsAsked == 1 && p[1] % 0x20 != 0 && p.size() > 2) {
+			e->pids[p[1]].values.push_back(bytes(p.begin() + 2, p.end()));
+			e->pids[p[1]].next = 0;
+			answers++;
+		} else if (p[0] == 0x43) {
+			e->dtcs.clear();
+			for (size_t k = 2; k + 1 < p.size(); k += 2)
+				e->dtcs.push_back(p[k] << 8 | p[k + 1]);
+			answers++;
+		} else if (p[0] == 0x49 && p[1] == 0x02 && p.size() >= 20) {
+			e->vin.assign(p.end() - 17, p.end());
+			answers++;
+		}
+		m.data.clear();
+	}
+	fclose(f);
+
+	// ECUs seen answering something else only
+	for (size_t i = s.ecus.size(); i-- > 0; ) {
+		if (s.ecus[i].pids.empty() && s.ecus[i].dtcs.empty() && s.ecus[i].vin.empty())
+			s.ecus.erase(s.ecus.begin() + i);
+	}
+	return answers;
+}
+
+int main(int argc, char** argv)
+{
+	sim s;
+	const char* model = NULL;
+	const char* candump = NULL;
+	const char* link = NULL;
+	int opt;
+
+	s.vehicle = 6;
+	s.version = 1.5;
+	s.latency = 0;
+	s.jitter = 0;
+	s.wait = false;
+	s.emulateBaud = false;
+	s.realtime = false;
+	s.maxRequests = 0;
+	s.baud = 38400;
+	s.commands = s.requests = s.noData = 0;
+	s.sent = 0;
+	reset(s);
+
+	while ((opt = getopt(argc, argv, "m:r:p:v:d:j:wb:tl:n:")) != -1) {
+		switch (opt) {
+		case 'm':
+			model = optarg;
+			break;
+		case 'r':
+			candump = optarg;
+			break;
+		case 'p':
+			s.vehicle = atoi(optarg);
+			break;
+		case 'v':
+			s.version = atof(optarg);
+			break;
+		case 'd':
+			s.latency = atol(optarg);
+			break;
+		case 'j':
+			s.jitter = atol(optarg);
+			break;
+		case 'w':
+			s.wait = true;
+			break;
+		case 'b':
+			s.baud = atol(optarg);
+			s.emulateBaud = true;
+			break;
+		case 't':
+			s.realtime = true;
+			break;
+		case 'l':
+			link = optarg;
+			break;
+		case 'n':
+			s.maxRequests = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: elmsim [-m model] [-r candump.log] [-p protocol] [-v version]\n"
+					"              [-d latency_us] [-j jitter_us] [-w] [-b baud] [-t]\n"
+					"              [-l link] [-n requests]\n");
+			return 2;
+		}
+	}
+	if (s.vehicle < 1 || s.vehicle > 9 || s.baud <= 0) {
+		fprintf(stderr, "protocol must be 1 to 9, baud above 0\n");
+		return 2;
+	}
+
+	if (model && !load_model(s, model))
+		return 1;
+	if (candump) {
+		int answers = load_candump(s, candump);
+		if (answers < 0)
+			return 1;
+		fprintf(stderr, "%s: %d frames, %d OBD answers\n", candump, (int)s.frames.size(), answers);
+	}
+	if (s.ecus.empty())
+		builtin_model(s);
+
+	int slave;
+	char name[64];
+	if (openpty(&s.fd, &slave, name, NULL, NULL) < 0) {
+		perror("openpty");
+		return 1;
+	}
+	// no echo and no line discipline on the adapter side
+	struct termios t;
+	tcgetattr(slave, &t);
+	cfmakeraw(&t);
+	tcsetattr(slave, TCSANOW, &t);
+
+	if (link) {
+		unlink(link);
+		if (symlink(name, link) < 0) {
+			perror(link);
+			return 1;
+		}
+	}
+	printf("%s\n", link ? link : name);
+	fflush(stdout);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	std::string pending;
+	char buf[256];
+	double start = now_us();
+
+	while (!stop && (s.maxRequests == 0 || s.requests < s.maxRequests)) {
+		ssize_t n = read(s.fd, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		for (ssize_t i = 0; i < n; i++) {
+			if (buf[i] == '\r') {
+				command(s, pending);
+				pending.clear();
+			} else if (buf[i] != '\n' && buf[i] != 0) {
+				pending += buf[i];
+			}
+		}
+	}
+
+	double elapsed = (now_us() - start) / 1e6;
+	fprintf(stderr, "%ld requests (%ld no data), %ld AT commands, %lld bytes sent in %.1f s: %.0f requests/s\n",
+			s.requests, s.noData, s.commands, s.sent, elapsed,
+			elapsed > 0 ? s.requests / elapsed : 0.0);
+
+	if (link)
+		unlink(link);
+	close(slave);
+	close(s.fd);
+	return 0;
+}
@@ -0,0 +1,408 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \file obdbench.cpp
+/// \brief Round trip latency of PID requests through elm327 and obdbase.
+///
+/// Starts elmsim for each serial rate, connects to it with elm327 and
+/// times requests of one PID (obd_pid_value) or several at once
+/// (obd_pid_values), for each number of PIDs and size of PID value.
+/// Each request is split into stages:
+///
+///	write		obdWrite, the request into the port
+///	first_byte	until the first byte of the answer can be read
+///	prompt		until the whole answer, up to the prompt, is in
+///	parse		parsing and decoding the answer
+///
+/// The median, 99th and 99.9th percentile of each, and the PIDs per
+/// second, go to stdout as JSON; a table goes to stderr.
+///
+///	obdbench [-n requests] [-b bauds] [-c pid_counts] [-s value_sizes]
+///	         [-v version] [-a] [-e elmsim] [-o file] [-r session]
+///
+/// The lists are comma separated, a rate of 0 is as fast as the pseudo
+/// terminal goes.  The defaults are -b 38400,115200,500000,0 -c 1,2,4,6
+/// -s 1,2,4.  elmsim is looked for next to obdbench.  With -r the
+/// exchanges are recorded to a session file for obdreplay, with more
+/// than one rate to one file each, named session.rate.
+///
+/// elmsim plays an adapter of the given version, 1.4 by default, which
+/// waits for more ECUs after each answer as a real one does; the
+/// adaptive timing and the response counts of elm327 are part of the
+/// measurement.  The link stays at the rate given with -b, unless -a
+/// asks to negotiate a faster one with AT BRD as openobd does; the
+/// rate reached is then reported as link_baud.
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "elm327.h"
+
+/// PIDs of the built in table with one, two and four byte values
+static const int pidsBySize[][6] = {
+	{ 0x0104, 0x0105, 0x010B, 0x010D, 0x010F, 0x0111 },
+	{ 0x010C, 0x0110, 0x011F, 0x0121, 0x0122, 0x0123 },
+	{ 0x0124, 0x0125, 0x0126, 0x0127, 0x0128, 0x0129 }
+};
+
+enum stage { STAGE_WRITE, STAGE_FIRST_BYTE, STAGE_PROMPT, STAGE_PARSE, STAGE_TOTAL, STAGES };
+
+static const char* stageNames[STAGES] = { "write", "first_byte", "prompt", "parse", "total" };
+
+static double now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/// elm327, noting when each stage of the last mode 01 request ended
+class timedElm : public elm327
+{
+public:
+	timedElm(const wxString& port) : elm327(port), request(false), answerBytes(0) {}
+
+	double writeStart, writeEnd, firstByte, prompt;
+	bool request;
+	size_t answerBytes;
+
+protected:
+	bool obdWrite(const wxString& command, int count)
+	{
+		double start = now_us();
+		bool result = elm327::obdWrite(command, count);
+
+		request = command.StartsWith(_T("01"));
+		if (request) {
+			writeStart = start;
+			writeEnd = now_us();
+		}
+		return result;
+	}
+
+	bool obdReadRaw(const char*& buf, size_t* len)
+	{
+		bool timed = request;
+
+		request = false;
+		if (timed) {
+			port->WaitReadable(5000);
+			firstByte = now_us();
+		}
+		bool result = elm327::obdReadRaw(buf, len);
+		if (timed) {
+			prompt = now_us();
+			answerBytes = *len;
+		}
+		return result;
+	}
+};
+
+static std::vector<int> parse_list(const char* text)
+{
+	std::vector<int> list;
+	const char* p = text;
+
+	while (*p) {
+		list.push_back(atoi(p));
+		p += strcspn(p, ",");
+		if (*p)
+			p++;
+	}
+	return list;
+}
+
+/// Nearest rank percentile of sorted values.
+static double percentile(const std::vector<double>& sorted, double pct)
+{
+	if (sorted.empty())
+		return 0;
+	size_t rank = (size_t)(pct / 100.0 * sorted.size() + 0.999999);
+	return sorted[std::min(sorted.size(), std::max(rank, (size_t)1)) - 1];
+}
+
+/// A model for elmsim: one ECU with all the PIDs used.
+static bool write_model(char* path)
+{
+	int fd = mkstemp(path);
+	FILE* f = (fd < 0) ? NULL : fdopen(fd, "w");
+
+	if (!f)
+		return false;
+	fprintf(f, "ecu 7E8\n");
+	for (size_t s = 0; s < 3; s++) {
+		for (size_t i = 0; i < 6; i++) {
+			fprintf(f, "pid %02X", pidsBySize[s][i] & 0xFF);
+			for (size_t b = 0; b < ((s == 2) ? 4 : s + 1); b++)
+				fprintf(f, " %02X", (unsigned)(0x40 + 16 * s + i + b));
+			fprintf(f, "\n");
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+/// Start elmsim, return the name of its terminal.
+static std::string start_sim(const std::string& elmsim, const char* model, const char* version,
+							 int baud, pid_t* child)
+{
+	int out[2];
+
+	*child = -1;
+	if (pipe(out) < 0)
+		return "";
+	*child = fork();
+	if (*child == 0) {
+		char rate[16];
+		snprintf(rate, sizeof(rate), "%d", baud);
+		dup2(out[1], 1);
+		close(out[0]);
+		close(out[1]);
+		if (baud > 0)
+			execl(elmsim.c_str(), "elmsim", "-m", model, "-v", version, "-w", "-b", rate, (char*)NULL);
+		else
+			execl(elmsim.c_str(), "elmsim", "-m", model, "-v", version, "-w", (char*)NULL);
+		_exit(127);
+	}
+	close(out[1]);
+	if (*child < 0) {
+		close(out[0]);
+		return "";
+	}
+
+	char name[128] = "";
+	FILE* f = fdopen(out[0], "r");
+	if (!f || !fgets(name, sizeof(name), f))
+		name[0] = 0;
+	if (f)
+		fclose(f);
+	name[strcspn(name, "\n")] = 0;
+	return name;
+}
+
+static void stop_sim(pid_t child)
+{
+	if (child <= 0)
+		return;
+	kill(child, SIGTERM);
+	waitpid(child, NULL, 0);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<int> bauds = parse_list("38400,115200,500000,0");
+	std::vector<int> counts = parse_list("1,2,4,6");
+	std::vector<int> sizes = parse_list("1,2,4");
+	int requests = 1000;
+	const char* output = NULL;
+	const char* session = NULL;
+	const char* version = "1.4";
+	bool negotiate = false;
+	std::string elmsim(argv[0]);
+	int opt;
+
+	elmsim = elmsim.substr(0, elmsim.rfind('/') + 1) + "elmsim";
+
+	while ((opt = getopt(argc, argv, "n:b:c:s:v:ae:o:r:")) != -1) {
+		switch (opt) {
+		case 'n':
+			requests = atoi(optarg);
+			break;
+		case 'b':
+			bauds = parse_list(optarg);
+			break;
+		case 'c':
+			counts = parse_list(optarg);
+			break;
+		case 's':
+			sizes = parse_list(optarg);
+			break;
+		case 'v':
+			version = optarg;
+			break;
+		case 'a':
+			negotiate = true;
+			break;
+		case 'e':
+			elmsim = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'r':
+			session = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: obdbench [-n requests] [-b bauds] [-c pid_counts] [-s value_sizes]\n"
+					"                [-v version] [-a] [-e elmsim] [-o file] [-r session]\n");
+			return 2;
+		}
+	}
+	for (size_t i = 0; i < counts.size(); i++) {
+		if (counts[i] < 1 || counts[i] > 6) {
+			fprintf(stderr, "1 to 6 PIDs a request\n");
+			return 2;
+		}
+	}
+	for (size_t i = 0; i < sizes.size(); i++) {
+		if (sizes[i] != 1 && sizes[i] != 2 && sizes[i] != 4) {
+			fprintf(stderr, "values are 1, 2 or 4 bytes\n");
+			return 2;
+		}
+	}
+	if (requests < 1) {
+		fprintf(stderr, "at least one request\n");
+		return 2;
+	}
+
+	char model[] = "/tmp/obdbenchXXXXXX";
+	if (!write_model(model)) {
+		perror("model");
+		return 1;
+	}
+
+	FILE* json = output ? fopen(output, "w") : stdout;
+	if (!json) {
+		perror(output);
+		return 1;
+	}
+	fprintf(json, "{\n  \"benchmark\": \"obdbench\",\n  \"requests\": %d,\n  \"runs\": [", requests);
+
+	fprintf(stderr, "%7s %4s %5s %6s %9s %9s %9s %9s %10s %7s\n", "baud", "pids", "bytes",
+			"answer", "p50 us", "p99 us", "p99.9 us", "prompt", "pids/s", "failed");
+
+	int failures = 0;
+	bool first = true;
+	for (size_t b = 0; b < bauds.size(); b++) {
+		pid_t child;
+		std::string device = start_sim(elmsim, model, version, bauds[b], &child);
+		if (device.empty()) {
+			fprintf(stderr, "cannot start %s\n", elmsim.c_str());
+			return 1;
+		}
+
+		timedElm elm(wxString::From8BitData(device.c_str()));
+		if (!elm.obd_is_connected()) {
+			fprintf(stderr, "cannot connect to %s\n", device.c_str());
+			stop_sim(child);
+			return 1;
+		}
+		int link = bauds[b];
+		if (negotiate)
+			link = elm.elmNegotiateBaudrate();
+
+		std::string recording;
+		if (session) {
+			char rate[16];
+			snprintf(rate, sizeof(rate), ".%d", bauds[b]);
+			recording = std::string(session) + (bauds.size() > 1 ? rate : "");
+			if (!elm.obd_start_recording(wxString::From8BitData(recording.c_str()))) {
+				perror(recording.c_str());
+				stop_sim(child);
+				return 1;
+			}
+		}
+
+		for (size_t s = 0; s < sizes.size(); s++) {
+			const int* set = pidsBySize[sizes[s] == 4 ? 2 : sizes[s] - 1];
+
+			for (size_t c = 0; c < counts.size(); c++) {
+				std::vector<int> pids(set, set + counts[c]);
+				std::vector<obdbase::pidInfo> results;
+				std::vector<bool> retrieved;
+				obdbase::pidInfo info;
+				std::vector<double> times[STAGES];
+				size_t answer = 0;
+				int failed = 0;
+
+				// past the tuning of the adaptive timing
+				for (int i = 0; i < 40; i++)
+					elm.obd_pid_values(pids, results, retrieved);
+
+				double start = now_us();
+				for (int i = 0; i < requests; i++) {
+					bool ok;
+					double t0 = now_us();
+					if (pids.size() == 1) {
+						ok = elm.obd_pid_value(pids[0], &info);
+					} else {
+						elm.obd_pid_values(pids, results, retrieved);
+						ok = std::count(retrieved.begin(), retrieved.end(), true) == (int)pids.size();
+					}
+					double t1 = now_us();
+					if (!ok) {
+						failed++;
+						continue;
+					}
+					times[STAGE_WRITE].push_back(elm.writeEnd - elm.writeStart);
+					times[STAGE_FIRST_BYTE].push_back(elm.firstByte - elm.writeEnd);
+					times[STAGE_PROMPT].push_back(elm.prompt - elm.firstByte);
+					times[STAGE_PARSE].push_back(t1 - elm.prompt);
+					times[STAGE_TOTAL].push_back(t1 - t0);
+					answer = elm.answerBytes;
+				}
+				double elapsed = (now_us() - start) / 1e6;
+				double rate = (requests - failed) * pids.size() / elapsed;
+				failures += failed;
+
+				for (int k = 0; k < STAGES; k++)
+					std::sort(times[k].begin(), times[k].end());
+
+				fprintf(stderr, "%7d %4d %5d %6d %9.1f %9.1f %9.1f %9.1f %10.0f %7d\n",
+						link, counts[c], sizes[s], (int)answer,
+						percentile(times[STAGE_TOTAL], 50), percentile(times[STAGE_TOTAL], 99),
+						percentile(times[STAGE_TOTAL], 99.9), percentile(times[STAGE_PROMPT], 50),
+						rate, failed);
+
+				fprintf(json, "%s\n    {\"baud\": %d, \"link_baud\": %d, \"pids\": %d, \"value_bytes\": %d, "
+						"\"answer_bytes\": %d, \"failed\": %d, \"pids_per_s\": %.1f, \"stages_us\": {",
+						first ? "" : ",", bauds[b], link, counts[c], sizes[s], (int)answer, failed, rate);
+				for (int k = 0; k < STAGES; k++) {
+					fprintf(json, "%s\n      \"%s\": {\"p50\": %.1f, \"p99\": %.1f, \"p99.9\": %.1f, \"max\": %.1f}",
+							k ? "," : "", stageNames[k], percentile(times[k], 50),
+							percentile(times[k], 99), percentile(times[k], 99.9),
+							times[k].empty() ? 0.0 : times[k].back());
+				}
+				fprintf(json, "\n    }}");
+				first = false;
+			}
+		}
+
+		if (session && !elm.obd_stop_recording()) {
+			fprintf(stderr, "%s is incomplete\n", recording.c_str());
+			failures++;
+		}
+		elm.obdDeviceDisconnect();
+		stop_sim(child);
+	}
+
+	fprintf(json, "\n  ]\n}\n");
+	if (output)
+		fclose(json);
+	unlink(model);
+	return failures ? 1 : 0;
+}
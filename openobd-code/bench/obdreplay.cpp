@@ -0,0 +1,241 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \file obdreplay.cpp
+/// \brief Feeds a recorded session through the parser as fast as it goes.
+///
+/// Reads a session file written by obdbase::obd_start_recording() (or
+/// obdbench -r) and parses every answer with the header format it was
+/// parsed with when recorded.  The values of mode 01 answers are
+/// decoded the way elm327::obd_pid_values() does.  The session is
+/// replayed -n times from memory, the answers and values per second go
+/// to stderr.
+///
+/// With -v every exchange and every value is printed to stdout, one per
+/// line, so the output of two builds for the same session can be
+/// compared with diff.
+///
+///	obdreplay [-n passes] [-v] session
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "obdbase.h"
+#include "obdParser.h"
+#include "obdRecorder.h"
+
+/// a request and its answer, as recorded
+struct exchange {
+	unsigned long long time;
+	std::string request;
+	std::string answer;
+	obdParser::headerFormat format;
+	bool prompt;
+	int mode;
+	std::vector<int> pids;		///< the PIDs of a mode 01 request
+};
+
+/// obdbase for its PID decoding only, it never opens the port
+class replayDecoder : public obdbase
+{
+public:
+	bool decode(int pid, int tokens[], obdbase::pidInfo* result)
+	{
+		return this->obd_pid_decode(pid, tokens, result);
+	}
+};
+
+static double now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/// The mode and the PIDs of a request like 010C0D or 010C0D1 (the last
+/// digit is the number of answers expected).
+static void split_request(exchange& e)
+{
+	std::vector<int> bytes;
+	const char* p = e.request.c_str();
+
+	while (obdParser::hex_value(p[0]) >= 0 && obdParser::hex_value(p[1]) >= 0) {
+		bytes.push_back(obdParser::hex_value(p[0]) * 16 + obdParser::hex_value(p[1]));
+		p += 2;
+	}
+	e.mode = bytes.empty() ? -1 : bytes[0];
+	for (size_t i = 1; e.mode == 0x01 && i < bytes.size(); i++)
+		e.pids.push_back(0x0100 | bytes[i]);
+}
+
+/// Read the exchanges with a parsed answer.
+static bool load(const char* path, std::vector<exchange>& exchanges, unsigned long long* length)
+{
+	FILE* file = fopen(path, "rb");
+	obdRecorder::sessionRecord rec;
+	std::string request;
+
+	if (!file) {
+		perror(path);
+		return false;
+	}
+	if (!obdRecorder::read_header(file, NULL)) {
+		fprintf(stderr, "%s is not a session file\n", path);
+		fclose(file);
+		return false;
+	}
+	*length = 0;
+	while (obdRecorder::read_record(file, rec)) {
+		*length = rec.time;
+		if (rec.kind == obdRecorder::RECORD_REQUEST) {
+			request = rec.data;
+			continue;
+		}
+		// AT commands and the like aren't parsed
+		if (rec.format < 0)
+			continue;
+
+		exchange e;
+		e.time = rec.time;
+		e.request = request;
+		e.answer = rec.data;
+		e.format = (obdParser::headerFormat)rec.format;
+		e.prompt = rec.kind == obdRecorder::RECORD_ANSWER;
+		split_request(e);
+		exchanges.push_back(e);
+	}
+	fclose(file);
+	return true;
+}
+
+/// Parse one answer and decode its values, as elm327 does.
+/// \return The number of values decoded
+static int replay(replayDecoder& decoder, obdParser& parser, const exchange& e, bool print)
+{
+	int values = 0;
+
+	parser.parse(e.answer.data(), e.answer.size(), e.format);
+	if (print)
+		printf("%llu %s status %d messages %d%s\n", e.time, e.request.c_str(),
+			   (int)parser.result(), parser.count(), e.prompt ? "" : " timeout");
+	if (e.mode != 0x01)
+		return 0;
+
+	for (int m = parser.find(0x41); m >= 0; m = parser.find(0x41, -1, m + 1)) {
+		const unsigned char* bytes = parser.data(m);
+		size_t length = parser.get(m).length;
+		size_t pos = 1;
+
+		while (pos < length) {
+			int pid = 0x0100 | bytes[pos];
+			size_t j = 0;
+			while (j < e.pids.size() && e.pids[j] != pid)
+				j++;
+			if (j == e.pids.size())
+				break;
+
+			int toks[8];
+			int len = obdbase::obd_pid_length(pid);
+			if (pos + len >= length || len + 2 > (int)(sizeof(toks) / sizeof(toks[0])))
+				break;
+
+			obdbase::pidInfo info;
+			toks[0] = 0x41;
+			for (int k = 0; k <= len; k++)
+				toks[k + 1] = bytes[pos + k];
+			if (decoder.decode(pid, toks, &info)) {
+				values++;
+				if (print && parser.get(m).ecu >= 0)
+					printf("%llu ecu %X pid %04X %g %g\n", e.time, parser.get(m).ecu, pid,
+						   info.resultMain, info.resultSecondary);
+				else if (print)
+					printf("%llu ecu - pid %04X %g %g\n", e.time, pid,
+						   info.resultMain, info.resultSecondary);
+			}
+			pos += len + 1;
+		}
+	}
+	return values;
+}
+
+int main(int argc, char** argv)
+{
+	int passes = 100;
+	bool verbose = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			passes = atoi(optarg);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: obdreplay [-n passes] [-v] session\n");
+			return 2;
+		}
+	}
+	if (optind + 1 != argc || passes < 1) {
+		fprintf(stderr, "usage: obdreplay [-n passes] [-v] session\n");
+		return 2;
+	}
+
+	std::vector<exchange> exchanges;
+	unsigned long long length = 0;
+	if (!load(argv[optind], exchanges, &length))
+		return 1;
+	if (exchanges.empty()) {
+		fprintf(stderr, "no parsed answers in %s\n", argv[optind]);
+		return 1;
+	}
+
+	replayDecoder decoder;
+	obdParser parser;
+	size_t bytes = 0;
+	long values = 0;
+
+	// the printed pass isn't timed
+	if (verbose) {
+		for (size_t i = 0; i < exchanges.size(); i++)
+			replay(decoder, parser, exchanges[i], true);
+	}
+	for (size_t i = 0; i < exchanges.size(); i++)
+		bytes += exchanges[i].answer.size();
+
+	double start = now_us();
+	for (int n = 0; n < passes; n++) {
+		for (size_t i = 0; i < exchanges.size(); i++)
+			values += replay(decoder, parser, exchanges[i], false);
+	}
+	double elapsed = (now_us() - start) / 1e6;
+
+	fprintf(stderr, "%zu answers (%.1f s recorded), %d passes in %.3f s: "
+			"%.0f answers/s, %.0f values/s, %.1f MB/s\n",
+			exchanges.size(), length / 1e6, passes, elapsed,
+			exchanges.size() * passes / elapsed, values / elapsed,
+			bytes * passes / elapsed / 1e6);
+	return 0;
+}
@@ -0,0 +1,244 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \file parserbench.cpp
+/// \brief Speed and robustness of the response parser.
+///
+/// Parses a set of typical ELM327 answers over and over and prints the
+/// time per answer, next to a token by token baseline that works like
+/// the string based parsing obdParser replaced.  With -f the answers
+/// are mutated at random instead (bytes changed, inserted, removed,
+/// lines cut) and each result is checked for consistency; build with
+/// -fsanitize=address,undefined to catch what the checks can't.
+///
+///	parserbench [-n iterations] [-f mutations] [-s seed]
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "obdParser.h"
+
+struct sample {
+	const char* name;
+	const char* text;
+	obdParser::headerFormat format;
+	int messages;		///< expected result
+};
+
+static const sample samples[] = {
+	{ "single", "41 0C 1A F8 \r", obdParser::HEADERS_NONE, 1 },
+	{ "no spaces", "410C1AF8\r", obdParser::HEADERS_NONE, 1 },
+	{ "six pids", "00D \r0: 41 0C 1A F8 0D 32 \r1: 04 80 05 7B 0F 44 00 \r",
+	  obdParser::HEADERS_NONE, 1 },
+	{ "two ecus", "41 00 BE 3E B8 11 \r41 00 80 00 00 01 \r", obdParser::HEADERS_NONE, 2 },
+	{ "can 11", "7E8 06 41 00 BE 3E B8 11 \r7E9 06 41 00 80 00 00 01 \r",
+	  obdParser::HEADERS_CAN_11, 2 },
+	{ "vin can 11", "7E8 10 14 49 02 01 31 44 34 \r7E8 21 47 50 30 30 52 35 35 \r"
+	  "7E8 22 42 31 32 33 34 35 36 \r", obdParser::HEADERS_CAN_11, 1 },
+	{ "can 29", "18 DA F1 10 04 41 0C 1A F8 \r18 DA F1 18 03 41 0D 32 \r",
+	  obdParser::HEADERS_CAN_29, 2 },
+	{ "j1850", "48 6B 10 41 0C 1A F8 5E \r", obdParser::HEADERS_LEGACY, 1 },
+	{ "no data", "SEARCHING...\rNO DATA\r", obdParser::HEADERS_NONE, 0 },
+};
+
+static const size_t nsamples = sizeof(samples) / sizeof(samples[0]);
+
+static double now_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+/// The way the answers were parsed before: split into string tokens,
+/// convert each one and build the header with pow().
+static int baseline(const char* text, int tokens[], int toksize)
+{
+	std::string raw(text);
+	std::vector<std::string> parts;
+	size_t pos = 0;
+	int index = 0;
+
+	for (size_t i = 0; i < raw.size(); i++) {
+		if (iscntrl((unsigned char)raw[i]))
+			raw[i] = ' ';
+	}
+	while (pos < raw.size()) {
+		size_t next = raw.find(' ', pos);
+		if (next == std::string::npos)
+			next = raw.size();
+		if (next > pos)
+			parts.push_back(raw.substr(pos, next - pos));
+		pos = next + 1;
+	}
+	for (size_t i = 0; i < parts.size() && index < toksize; i++)
+		tokens[index++] = strtol(parts[i].c_str(), NULL, 16);
+
+	int head = 0;
+	for (int i = 0; i < 2 && i < index; i++)
+		head += pow(256, 1 - i) * tokens[i];
+	return head;
+}
+
+/// Check what the parser returned makes sense, whatever the input.
+static bool consistent(const obdParser& parser)
+{
+	size_t offset = 0;
+
+	if (parser.count() < 0 || parser.count() > OBD_PARSER_MESSAGES)
+		return false;
+	for (int i = 0; i < parser.count(); i++) {
+		const obdParser::message& m = parser.get(i);
+		if (m.offset < offset || m.offset + m.length > OBD_PARSER_BYTES)
+			return false;
+		if (m.length > m.expected)
+			return false;
+		if (parser.complete(i) != (m.length == m.expected))
+			return false;
+		offset = m.offset;
+	}
+	return true;
+}
+
+static int bench(int iterations)
+{
+	obdParser parser;
+	int tokens[64];
+	volatile unsigned int sink = 0;
+	int failed = 0;
+
+	printf("%-12s %10s %10s\n", "answer", "parser ns", "baseline ns");
+	for (size_t s = 0; s < nsamples; s++) {
+		const sample& sm = samples[s];
+		size_t len = strlen(sm.text);
+
+		if (parser.parse(sm.text, len, sm.format) != sm.messages) {
+			printf("%-12s parsed %d messages, expected %d\n", sm.name,
+				   parser.count(), sm.messages);
+			failed++;
+		}
+
+		double t0 = now_us();
+		for (int i = 0; i < iterations; i++)
+			sink += parser.parse(sm.text, len, sm.format);
+		double t1 = now_us();
+		for (int i = 0; i < iterations; i++)
+			sink += baseline(sm.text, tokens, 64);
+		double t2 = now_us();
+
+		printf("%-12s %10.1f %10.1f\n", sm.name, (t1 - t0) * 1000.0 / iterations,
+			   (t2 - t1) * 1000.0 / iterations);
+	}
+	return failed;
+}
+
+static int fuzz(int mutations, unsigned int seed)
+{
+	static const char alphabet[] = "0123456789ABCDEF :\r\n>NODATSERCHIG.?";
+	obdParser parser;
+	char buf[1024];
+	int failed = 0;
+
+	srand(seed);
+	for (int i = 0; i < mutations; i++) {
+		const sample& sm = samples[rand() % nsamples];
+		size_t len = strlen(sm.text);
+		memcpy(buf, sm.text, len);
+
+		// a few edits, or a long run of random characters now and then
+		int edits = 1 + rand() % 8;
+		if (rand() % 16 == 0) {
+			len = rand() % sizeof(buf);
+			for (size_t k = 0; k < len; k++)
+				buf[k] = alphabet[rand() % (sizeof(alphabet) - 1)];
+			edits = 0;
+		}
+		for (int e = 0; e < edits; e++) {
+			size_t at = len ? rand() % len : 0;
+			switch (rand() % 4) {
+			case 0:
+				if (len)
+					buf[at] = (rand() % 2) ? alphabet[rand() % (sizeof(alphabet) - 1)]
+						: (char)rand();
+				break;
+			case 1:
+				if (len < sizeof(buf)) {
+					memmove(buf + at + 1, buf + at, len - at);
+					buf[at] = alphabet[rand() % (sizeof(alphabet) - 1)];
+					len++;
+				}
+				break;
+			case 2:
+				if (len) {
+					memmove(buf + at, buf + at + 1, len - at - 1);
+					len--;
+				}
+				break;
+			case 3:
+				len = at;
+				break;
+			}
+		}
+
+		for (int f = obdParser::HEADERS_NONE; f <= obdParser::HEADERS_LEGACY; f++) {
+			parser.parse(buf, len, (obdParser::headerFormat)f);
+			if (!consistent(parser)) {
+				printf("inconsistent result for format %d: '%.*s'\n", f, (int)len, buf);
+				failed++;
+			}
+		}
+	}
+	printf("%d mutations, %d inconsistent results\n", mutations, failed);
+	return failed;
+}
+
+int main(int argc, char** argv)
+{
+	int iterations = 200000;
+	int mutations = 0;
+	unsigned int seed = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:f:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'f':
+			mutations = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: parserbench [-n iterations] [-f mutations] [-s seed]\n");
+			return 2;
+		}
+	}
+
+	if (mutations > 0)
+		return fuzz(mutations, seed) ? 1 : 0;
+	return bench(iterations) ? 1 : 0;
+}
@@ -119,16 +119,21 @@
   data after this time. And not do this for every byte!
 
   \section Fifo Fifo cass
-  Provides a simple thread safe fifo to realize a fast and simple
-  communication pipe between two threads (and was used also as a put
-  back mechanism for the wxIOBase and it's derivated classes).\n
-  ctb::Fifo tackles the concurrently access from different threads with an
-  internal temporary pointer asignment which was atomic. From there no
-  mutex or semaphore is involved and lead to a fast access.
+  Provides a lock free ring buffer as a fast communication pipe between
+  two threads (and is used also as a put back mechanism for the IOBase
+  and it's derivated classes).\n
+  ctb::Fifo has a power of two size and keeps the read and the write
+  position as atomics on separate cache lines, so neither a mutex nor a
+  semaphore is involved. Bytes are copied in blocks (read/write) or
+  accessed in place (readSpan/consume, writeSpan/commit).
 
   Please note:\n
-  The thread safeness is limited to the put/get write/read methods but
-  which should be sufficent for a fifo.
+  Exactly one thread may write and one thread may read. clear() belongs
+  to the reading side.
+
+  SerialPort::StartReader() uses a Fifo for a thread, which drains the
+  device as soon as bytes arrive; Read() and WaitReadable() then take
+  the bytes from the Fifo.
 
 
   \latexonly \newpage \endlatexonly
@@ -9,82 +9,135 @@
 // Licence:     wxWindows licence
 /////////////////////////////////////////////////////////////////////////////
 
+#include <atomic>
 #include <sys/types.h>
 
 namespace ctb {
 
 /*!
   \class Fifo
-  A simple thread safe fifo to realize a put back mechanism for the 
-  wxIOBase and it's derivated classes.
+  A lock free ring buffer for exactly one writing and one reading
+  thread. It realizes the put back mechanism of the IOBase and it's
+  derivated classes, and takes the bytes a reader thread drains from
+  a device.
+
+  The size is a power of two, so positions wrap with a mask. The read
+  and the write position are atomics on cache lines of their own: the
+  writer publishes new bytes with a release store of the write
+  position, the reader frees them with a release store of the read
+  position, and each side loads the other's position with acquire.
+  Bytes are copied in blocks, or accessed in place with the span
+  functions.
 */
     class Fifo
     {
     protected:
-	   /*! the size of the fifo */
+	   /*! line size the positions are kept apart by */
+	   enum { cacheLine = 64 };
+
+	   /*! the internal buffer */
+	   char* m_buf;
+	   /*! the size of the buffer, a power of two */
 	   size_t m_size;
-	   /*! the start of the internal fifo buffer */
-	   char* m_begin;
-	   /*! 
-		the end of the internal fifo buffer (m_end marks the first
-		invalid byte AFTER the internal buffer)
-	   */
-	   char* m_end;
-	   /*! the current read position */
-	   char* m_rdptr;
-	   /*! the current write position */
-	   char* m_wrptr;
+	   /*! m_size - 1, masks a position into the buffer */
+	   size_t m_mask;
+	   char m_pad0[cacheLine];
+
+	   /*! bytes read ever, changed by the reader only */
+	   std::atomic<size_t> m_rdpos;
+	   /*! the write position the reader saw last */
+	   size_t m_wrseen;
+	   char m_pad1[cacheLine];
+
+	   /*! bytes written ever, changed by the writer only */
+	   std::atomic<size_t> m_wrpos;
+	   /*! the read position the writer saw last */
+	   size_t m_rdseen;
+	   char m_pad2[cacheLine];
+
+    private:
+	   Fifo(const Fifo&);
+	   Fifo& operator=(const Fifo&);
+
     public:
 	   /*!
 		\brief the constructor initialize a fifo with the given size.
-		\param size size of the fifo
+		\param size the fifo takes at least so many bytes, it is
+		rounded up to a power of two
 	   */
 	   Fifo(size_t size);
 	   /*!
 		\brief the destructor destroys all internal memory.
 	   */
-	   virtual ~Fifo();
+	   ~Fifo();
 	   /*!
-		\brief clear all internal memory and set the read and write
-		pointers to the start of the internal memory.
-		\Note This function is not thread safe! Don't use it, if another 
-		thread takes access to the fifo instance. Use a looping get() or
-		read() call instead of this.
+		\brief discard all bytes in the fifo. Only the reader may
+		call it.
 	   */
-	   virtual void clear();
+	   void clear();
 	   /*!
 		\brief fetch the next available byte from the fifo.
 		\param ch points to a charater to store the result
 		\return 1 if successful, 0 otherwise
 	   */
-	   virtual int get(char* ch);
+	   int get(char* ch);
 	   /*!
 		\brief query the fifo for it's available bytes.
-		\return count of readable bytes, storing in the fifo 
+		\return count of readable bytes, storing in the fifo
+	   */
+	   size_t items() const;
+	   /*!
+		\brief the size of the fifo, as rounded up
 	   */
-	   size_t items();
+	   size_t size() const {return m_size;};
 	   /*!
 		\brief put a character into the fifo.
 		\param ch the character to put in
 		\return 1 if successful, 0 otherwise
 	   */
-	   virtual int put(char ch);
+	   int put(char ch);
 	   /*!
 		\brief read a given count of bytes out of the fifo.
 		\param data memory to store the readed data
 		\param count number of bytes to read
-		\return On success, the number of bytes read are returned, 
+		\return On success, the number of bytes read are returned,
 		0 otherwise
 	   */
-	   virtual int read(char* data,int count);
+	   int read(char* data,int count);
 	   /*!
 		\brief write a given count of bytes into the fifo.
 		\param data start of the data to write
 		\param count number of bytes to write
-		\return On success, the number of bytes written are returned, 
+		\return On success, the number of bytes written are returned,
 		0 otherwise
 	   */
-	   virtual int write(char* data,int count);
+	   int write(const char* data,int count);
+	   /*!
+		\brief the readable bytes, which follow each other in memory
+		(the rest starts at the beginning of the buffer). For the
+		reader only.
+		\param data set to the first readable byte
+		\return count of bytes at data, 0 if the fifo is empty
+	   */
+	   size_t readSpan(const char*& data);
+	   /*!
+		\brief free bytes read in place, see readSpan().
+		\param count number of bytes, at most what readSpan returned
+	   */
+	   void consume(size_t count);
+	   /*!
+		\brief the free space, which follows each other in memory.
+		For the writer only, e.g. to read() from a device directly
+		into the fifo.
+		\param data set to the first free byte
+		\return count of free bytes at data, 0 if the fifo is full
+	   */
+	   size_t writeSpan(char*& data);
+	   /*!
+		\brief make bytes written in place readable, see writeSpan().
+		\param count number of bytes, at most what writeSpan returned
+	   */
+	   void commit(size_t count);
     };
 
 } // namespace ctb
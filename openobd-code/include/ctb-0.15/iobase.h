@@ -61,13 +61,69 @@ namespace ctb {
 		\brief internal fifo (first in, first out queue) to put back
 		already readed bytes into the reading stream. After put back a single
 		byte or sequence of characters, you can read them again with the
-		next Read call.
+		next Read call. ReadUntilEOS puts the bytes following the EOS
+		string back here and grows the fifo, if they don't fit.
 	   */
 	   Fifo* m_fifo;
 	   enum {
 		  /// fifosize of the putback fifo 
 		  fifoSize = 256
 	   };
+	   /*!
+		\brief receive buffer of ReadUntilEOS. It is kept between
+		the calls, so the same memory is used for every response.
+	   */
+	   char* m_rxbuf;
+	   /*! size of the receive buffer */
+	   size_t m_rxsize;
+	   /*! count of valid bytes in the receive buffer */
+	   size_t m_rxlen;
+	   /*!
+		count of bytes at the start of the receive buffer, which
+		belongs to the last returned string and will be discarded
+		with the next ReadUntilEOS call
+	   */
+	   size_t m_rxused;
+	   /*!
+		\brief when the bytes of the receive buffer arrived: each
+		entry holds the end of one read and its monotonic time in us
+	   */
+	   struct RxStamp {
+		  size_t end;
+		  unsigned long long us;
+	   };
+	   enum {
+		  /// reads timed per ReadUntilEOS call, later reads share the
+		  /// last entry
+		  rxStamps = 32
+	   };
+	   RxStamp m_rxstamp[rxStamps];
+	   /*! count of valid entries in m_rxstamp */
+	   int m_rxstamps;
+	   /*!
+		\brief note the arrival of the receive buffer up to end
+	   */
+	   void StampRx(size_t end);
+	   /*!
+		\brief put len bytes back in front of the bytes already in the
+		fifo, growing it if needed, so every following Read call
+		returns them first.
+	   */
+	   void PutBack(const char* buf,size_t len);
+	   /*!
+		\brief search the receive buffer for the EOS string.
+		\param from the receive buffer is already searched up to this
+		position
+		\param eos the EOS string
+		\param eoslen length of the EOS string
+		\param quota see ReadUntilEOS
+		\param quoted the current quoting state, updated while searching
+		\return the position of the EOS string, or -1 if not found.
+		In this case from is set to the position, where the next search
+		must continue.
+	   */
+	   long FindEOS(size_t& from,const char* eos,size_t eoslen,char quota,
+				 int& quoted);
 	   /*!
 		Close the interface (internally the file descriptor, which was
 		connected with the interface).
@@ -98,6 +154,9 @@ namespace ctb {
 	   */
 	   IOBase() {
 		  m_fifo = new Fifo(fifoSize);
+		  m_rxbuf = 0L;
+		  m_rxsize = m_rxlen = m_rxused = 0;
+		  m_rxstamps = 0;
 	   };
 
 	   /*!
@@ -105,6 +164,7 @@ namespace ctb {
 	   */
 	   virtual ~IOBase() {
 		  delete m_fifo;
+		  delete[] m_rxbuf;
 	   };
 	   /*!
 		\brief A little helper function to detect the class name
@@ -183,6 +243,20 @@ namespace ctb {
 	   */
 	   virtual int Read(char* buf,size_t len) = 0;
 
+	   /*!
+		\brief Wait until the interface has received data or the
+		timeout expires.
+		The default implementation cannot wait for data and just gives
+		up the processor for a millisecond. Interfaces, which can wait
+		for incoming data (like a file descriptor under Linux) should
+		override it.
+		\param timeout_in_ms maximum waiting time in milliseconds,
+		a negative value waits without limit
+		\return 1 if data may be available, 0 if the timeout expired,
+		-1 on errors
+	   */
+	   virtual int WaitReadable(long timeout_in_ms);
+
 	   /*!
 		\brief
 		ReadUntilEos read bytes from the interface until the EOS string
@@ -209,6 +283,45 @@ namespace ctb {
 						   long timeout_in_ms = 1000L,
 						   char quota = 0);
 
+	   /*!
+		\brief
+		The same as above, but without copying the received bytes.
+		The interface reads as many bytes as available at once into an
+		internal receive buffer and waits with WaitReadable() for more,
+		so it wakes up as soon as new data arrives. Bytes following the
+		EOS string are put back into the fifo (which grows, if they
+		don't fit), so the next Read, Readv or ReadUntilEOS call
+		returns them first and in order.
+		\param line points to the received bytes (without the EOS
+		string) after the call. The string is null terminated and valid
+		until the next ReadUntilEOS call. Don't delete it!
+		\param readedBytes A pointer to the variable that receives the
+		number of bytes read.
+		\param eosString is the null terminated end of string sequence.
+		\param timeout_in_ms the function returns after this time, also
+		if no eos occured.
+		\param quota defines a character between those an EOS doesn't
+		terminate the string
+		\return 1 on sucess, 0 if a timeout occurred and -1 otherwise
+	   */
+	   int ReadUntilEOS(const char*& line,
+					size_t* readedBytes,
+					const char* eosString = "\n",
+					long timeout_in_ms = 1000L,
+					char quota = 0);
+
+	   /*!
+		\brief
+		The time a byte of the string returned by the last
+		ReadUntilEOS call was read from the interface, e.g. to tell
+		when each line of a multi line answer arrived.
+		\param offset position of the byte in the string
+		\return the monotonic time in microseconds (see monotonicus),
+		0 if nothing was read yet. Bytes left over from an earlier
+		call count as read at the start of the call.
+	   */
+	   unsigned long long ArrivalTime(size_t offset) const;
+
 	   /*!
 		\brief
 		readv() attempts to read up to len bytes from the interface
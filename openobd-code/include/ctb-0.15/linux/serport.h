@@ -11,6 +11,7 @@
 
 #include "ctb-0.15/serportx.h"
 #include <linux/serial.h>
+#include <pthread.h>
 #include <termios.h>
 
 namespace ctb {
@@ -42,6 +43,28 @@ namespace ctb {
 	   */
 	   struct serial_icounter_struct save_info, last_info;
 
+	   /*!
+		\brief the bytes drained by the reader thread, NULL while
+		there is none. The thread is the only writer, the caller of
+		Read() the only reader.
+	   */
+	   Fifo* m_rxring;
+	   /*! \brief the reader thread */
+	   pthread_t m_reader;
+	   /*! \brief eventfd, signalled after every chunk put into m_rxring */
+	   int m_rxevent;
+	   /*! \brief eventfd, which asks the reader thread to stop */
+	   int m_stopevent;
+	   /*! \brief errno of the read, which ended the reader thread */
+	   std::atomic<int> m_rxerror;
+
+	   /*!
+		\brief the loop of the reader thread: poll the device and
+		read() directly into the free space of m_rxring.
+	   */
+	   void ReaderLoop();
+	   static void* ReaderThread( void* arg );
+
 	   /*!
 		\brief adaptor member function, to convert the plattform independent
 		type wxBaud into a linux conform value.
@@ -56,6 +79,9 @@ namespace ctb {
 	   /*!
 		\brief internal member function to set an unusal (non-standard)
 		baudrate. Called by SetBaudrate.
+		Uses termios2 (BOTHER) where the kernel knows it, and the custom
+		divisor of the serial driver otherwise.
+		\return zero on success, -1 if the rate can't be set
 	    */
 	   int SetBaudrateAny( int baudrate );
 
@@ -79,11 +105,15 @@ namespace ctb {
 	   int IsOpen();
 	   int Read(char* buf,size_t len);
 	   int SendBreak(int duration);
+	   int WaitReadable(long timeout_in_ms);
 
 	   int SetBaudrate( int baudrate );
 
 	   int SetParityBit( bool parity );
 
+	   int StartReader( size_t size = 65536 );
+	   void StopReader();
+
 	   int SetLineState( SerialLineState flags );
 
 	   int Write(char* buf,size_t len);
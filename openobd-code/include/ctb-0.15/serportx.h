@@ -436,6 +436,24 @@ namespace ctb {
 	    */
 	   virtual int SetParityBit( bool parity ) = 0;
 
+	   /*!
+		\brief start a thread, which drains the received bytes of the
+		open device into a Fifo as soon as they arrive. Read() and
+		WaitReadable() take them from there, so the device's own
+		buffer can't overflow while the caller is busy.
+		\param size the size of the Fifo
+		\return zero on success, -1 if the platform has no reader
+		thread or it couldn't be started
+	    */
+	   virtual int StartReader( size_t /*size*/ = 65536 ) {return -1;}
+
+	   /*!
+		\brief stop the reader thread. Bytes it received but nobody
+		read yet are put back, as far as the put back fifo takes
+		them. Close() stops the reader too.
+	    */
+	   virtual void StopReader() {}
+
 	   /*!
 		\brief check the given baudrate against a list of standard rates.
 		\ return true, if the baudrate is a standard value, false
@@ -15,5 +15,58 @@
 # include "linux/timer.h"
 #endif
 
+namespace ctb {
+
+/*!
+  \class Deadline
+  \brief A point in time on the monotonic clock, after which an
+  operation should give up.
+
+  Unlike the Timer class no thread is involved. The deadline is
+  computed once and the remaining time is passed on as the timeout of
+  the system calls, which wait for the device (like poll). So it costs
+  nothing more than reading the clock.
+*/
+    class Deadline
+    {
+    protected:
+	   /*! the deadline in milliseconds of monotonicms() */
+	   unsigned long long m_end;
+	   /*! a deadline, which never expires */
+	   bool m_infinite;
+
+    public:
+	   /*!
+		\brief creates a deadline the given time from now.
+		\param timeout_in_ms time interval in milliseconds. The
+		value 0xFFFFFFFF means wait for ever (like in Readv).
+	   */
+	   Deadline(unsigned int timeout_in_ms) {
+		  m_infinite = (timeout_in_ms == 0xFFFFFFFF);
+		  m_end = monotonicms() + timeout_in_ms;
+	   };
+	   /*!
+		\brief returns the remaining time in milliseconds, 0 if
+		the deadline has passed, and -1 for an infinite deadline
+		(the usual meaning of a negative timeout for poll).
+	   */
+	   long Left() const {
+		  if(m_infinite) {
+			 return -1;
+		  }
+		  unsigned long long now = monotonicms();
+		  if(now >= m_end) {
+			 return 0;
+		  }
+		  return (long)(m_end - now);
+	   };
+	   /*! \brief true, if the deadline has passed */
+	   bool Expired() const {
+		  return !m_infinite && (monotonicms() >= m_end);
+	   };
+    };
+
+} // namespace ctb
+
 #endif
 
@@ -135,6 +135,21 @@ namespace ctb {
 */
     void sleepms(unsigned int ms);
 
+/*!
+  \brief monotonicms
+  A plattform independent monotonic clock, not affected by changes
+  of the system time.
+  \return milliseconds since an unspecified starting point
+*/
+    unsigned long long monotonicms();
+
+/*!
+  \brief monotonicus
+  The same clock as monotonicms, with a finer resolution.
+  \return microseconds since an unspecified starting point
+*/
+    unsigned long long monotonicus();
+
 } // namespace ctb
 
 #endif
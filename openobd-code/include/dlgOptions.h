@@ -30,6 +30,7 @@ Subclass of dlgBaseOptions, which is generated by wxFormBuilder.
 
 struct obdOptions {
 	bool imperial;
+	bool headers;		///< tell the ECUs apart, no dialog entry yet
 	wxString port;
 };
 
@@ -20,6 +20,8 @@
 #ifndef _ELM327_H_
 #define _ELM327_H_
 
+#include <atomic>
+#include <map>
 #include "obdbase.h"
 
 #define PROTO_AUTOMATIC			0x00    ///< Automatic protocol
@@ -36,10 +38,20 @@
 #define PROTO_USER_1			0x0B    ///<
 #define PROTO_USER_2			0x0C    ///<
 
+#define ELM_MAX_PIDS			6       ///< PIDs per mode 01 request on CAN
+#define ELM_MULTI_REFUSALS		3       ///< batches answered only singly before giving up
+#define ELM_LATENCY_BUCKETS		8       ///< bins of the latency histogram
+#define ELM_TUNE_WINDOW			32      ///< answers measured before tuning
+#define ELM_REPORT_MS			60000   ///< how often the answer times are logged
+#define ELM_ST_DEFAULT			0x32    ///< AT ST default (x 4 ms)
+#define ELM_BAUD_CLOCK			4000000 ///< AT BRD divides this clock
+#define ELM_BRT					0x1E    ///< AT BRT wait for the switch (x 5 ms)
+
 class elm327: public obdbase
 {
 public:
 	elm327 (const wxString& serialPort);
+	~elm327 ();
 	bool obdProtocolSet (int OBDprotocol);
 	wxString obdDeviceIdentify ();
 	wxString obdProtocolGet();
@@ -51,13 +63,63 @@ public:
 	bool elmSetCanAutoformat(bool on);
 
 	double elmGetVersion();
+	bool elmIsCan();
+	void elmReportLatency();
+	bool elmSetBaudrate(int baud);
+	int elmNegotiateBaudrate();
+
+	bool obd_use_headers (bool use);
+
+	// PID functions
+	void obd_pid_values(const std::vector<int>& pids,
+						std::vector<obdbase::pidInfo>& results,
+						std::vector<bool>& retrieved);
 
 protected:
+	bool obdWrite(const wxString& command, int count);
+	bool obdReadRaw(const char*& buf, size_t* len);
+	obdParser::headerFormat obdHeaderFormat();
 
 private:
 
+    /// answer times of one PID from one ECU
+    struct latencyStats {
+        unsigned long buckets[ELM_LATENCY_BUCKETS];
+        unsigned long count;
+        unsigned long timeouts;
+        unsigned long long total;
+        unsigned long max;
+    };
+
     double version_;
+    // read by the polling thread outside of the link lock
+    std::atomic<int> protocol_;     ///< protocol number reported by AT DPN, -1 if unknown
+    std::atomic<bool> multiPid_;    ///< false once the ECU has refused multi-PID requests
+    std::atomic<int> multiRefused_; ///< batches in a row answered only PID by PID
+    bool baudSwitch_;   ///< false once the device has refused AT BRD
+    bool headers_;      ///< the answers show their headers (AT H1)
+
+    // adaptive timing
+    std::map<int, std::map<int, latencyStats> > latency_;  ///< ECU (-1 without headers) -> pid -> times
+    unsigned long window_[ELM_TUNE_WINDOW];
+    size_t windowCount_;
+    bool tuned_;
+    int retune_;        ///< before the next request: 1 tune, -1 untune
+    int responders_;    ///< ECUs answering a request, 0 if not known
+    std::vector<int> pendingPids_;
+    unsigned long long requestTime_;    ///< monotonic time in us
+    unsigned long long reported_;       ///< when the answer times were last logged
+    bool pendingSingle_;    ///< the answer fits in one CAN frame
+    bool pendingCounted_;   ///< the request carries a response count
+
+	obdParser::headerFormat elmHeaderFormat();
+	void elmRecordLatency(const char* response, size_t len);
+	void elmTune();
+	void elmUntune();
 	wxString elmSendAtCommand (const wxString& command);
+	int elmPidRequest(const std::vector<int>& pids, size_t first, size_t count,
+					  std::vector<obdbase::pidInfo>& results,
+					  std::vector<bool>& retrieved);
 };
 
 #endif // _ELM327_H_
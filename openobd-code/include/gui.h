@@ -54,6 +54,7 @@ class obdBaseFrame : public wxFrame
 		wxMenuItem* menuViewPIDS;
 		wxMenu* m_menu5;
 		wxMenuItem* menuConnect;
+		wxMenuItem* menuRecord;
 		wxMenu* m_menu3;
 		wxAuiNotebook* m_auinotebook1;
 		
@@ -64,6 +65,7 @@ class obdBaseFrame : public wxFrame
 		virtual void onMenuViewMIL( wxCommandEvent& event ) { event.Skip(); }
 		virtual void onMenuViewPIDs( wxCommandEvent& event ) { event.Skip(); }
 		virtual void onMenuConnect( wxCommandEvent& event ) { event.Skip(); }
+		virtual void onMenuRecord( wxCommandEvent& event ) { event.Skip(); }
 		virtual void onMenuPrefs( wxCommandEvent& event ) { event.Skip(); }
 		virtual void onMenuAbout( wxCommandEvent& event ) { event.Skip(); }
 		
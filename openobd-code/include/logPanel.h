@@ -25,6 +25,10 @@
 Subclass of logBasePanel, which is generated by wxFormBuilder.
 */
 
+#include <time.h>
+#include <vector>
+#include <wx/thread.h>
+#include <wx/timer.h>
 #include "gui.h"
 
 /** Implementing logBasePanel */
@@ -35,9 +39,43 @@ public:
 
 	/** Constructor */
 	logPanel( wxWindow* parent );
+	~logPanel();
 
 	void appendLog(wxString& logText, logType type);
-	void SaveFile(wxString& path);
+	bool SaveFile(wxString& path);
+
+protected:
+	void onLogPending( wxCommandEvent& event );
+	void onRepaintTimer( wxTimerEvent& event );
+
+private:
+	struct logEntry {
+		wxString text;
+		logType type;
+		time_t time;
+	};
+
+	// the last messages of all threads; message n of all ever logged
+	// is kept at n % size until it is overwritten
+	wxCriticalSection historyLock;
+	std::vector<logEntry> history;
+	unsigned long appended;
+	bool repaintPosted;
+
+	// the messages up to painted are in the panel, shown of them are
+	// still there
+	unsigned long painted;
+	size_t shown;
+	wxTimer repaintTimer;
+
+	// the timestamp of the last message formatted
+	time_t stampTime;
+	wxString stamp;
+
+	void repaint();
+	unsigned long copyHistory(unsigned long from, unsigned long to,
+							  std::vector<logEntry>& entries);
+	const wxString& timestamp(time_t rawtime);
 };
 
 #endif // __logPanel__
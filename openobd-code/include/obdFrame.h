@@ -49,6 +49,7 @@ protected:
 	void onMenuExport( wxCommandEvent& event );
 	void onMenuQuit( wxCommandEvent& event );
 	void onMenuConnect( wxCommandEvent& event );
+	void onMenuRecord( wxCommandEvent& event );
 	void onMenuPrefs( wxCommandEvent& event );
 	void onMenuAbout( wxCommandEvent& event );
 	void onMenuViewLog( wxCommandEvent& event );
@@ -0,0 +1,93 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _OBDPARSER_H_
+#define _OBDPARSER_H_
+
+#include <cstddef>
+
+#define OBD_PARSER_BYTES		512     ///< data bytes of all messages of one answer
+#define OBD_PARSER_MESSAGES		16      ///< messages of one answer
+
+/// \class obdParser
+/// \brief Splits the text answer of the device into binary messages.
+///
+/// Works on the bytes as read from the port; the data of all messages
+/// goes into a fixed array, so parsing never allocates.  A message is
+/// the answer of one ECU, reassembled from all of its lines (or CAN
+/// frames).  Anything that doesn't fit is dropped and the message left
+/// incomplete.
+class obdParser
+{
+public:
+
+    /// how the device shows the headers of the answers
+    enum headerFormat {
+        HEADERS_NONE,       ///< AT H0: 41 0C 1A F8, multi frame as 00A / 0: .. / 1: ..
+        HEADERS_CAN_11,     ///< AT H1 on 11 bit CAN: 7E8 04 41 0C 1A F8
+        HEADERS_CAN_29,     ///< AT H1 on 29 bit CAN: 18 DA F1 10 04 41 0C 1A F8
+        HEADERS_LEGACY      ///< AT H1 on J1850/ISO: 48 6B 10 41 0C 1A F8 cs
+    };
+
+    /// what the device said besides the data
+    enum status {
+        STATUS_OK,          ///< data only
+        STATUS_NO_DATA,     ///< NO DATA, no ECU answered
+        STATUS_ERROR        ///< an error message or a line that isn't data
+    };
+
+    struct message {
+        int ecu;                    ///< CAN id or source address, -1 without headers
+        unsigned short offset;      ///< position of the first byte in the data
+        unsigned short length;      ///< bytes received
+        unsigned short expected;    ///< bytes announced
+        unsigned char sequence;     ///< next consecutive frame number
+        unsigned int end;           ///< position in the answer behind its last line
+    };
+
+    obdParser ();
+
+    int parse (const char* buf, size_t len, obdParser::headerFormat format = HEADERS_NONE);
+    int count () const;
+    obdParser::status result () const;
+    const obdParser::message& get (int index) const;
+    const unsigned char* data (int index) const;
+    bool complete (int index) const;
+    int find (int service, int pid = -1, int from = 0) const;
+
+    static int hex_value (char c);
+
+private:
+
+    unsigned char data_[OBD_PARSER_BYTES];
+    obdParser::message messages_[OBD_PARSER_MESSAGES];
+    size_t used_;           ///< bytes of data_ given to messages
+    int count_;
+    int pending_;           ///< message announced by a byte count line, -1 if none
+    size_t lineEnd_;        ///< position in the answer behind the line parsed
+    obdParser::status status_;
+
+    void parse_line (const char* p, const char* end, obdParser::headerFormat format);
+    void parse_text (const char* p, const char* end);
+    int add_message (int ecu, size_t expected);
+    void append (int index, const char*& p, const char* end, size_t bytes);
+    int open_message (int ecu) const;
+};
+
+#endif // _OBDPARSER_H_
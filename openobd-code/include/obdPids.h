@@ -0,0 +1,198 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _OBDPIDS_H_
+#define _OBDPIDS_H_
+
+#include <list>
+#include <map>
+#include <string>
+
+struct sqlite3;
+
+#define PID_DTC_STATUS		0x0101
+#define PID_DTCFRZF         0x0102
+#define PID_FUELSYS         0x0103  ///< Fuel system status
+#define PID_LOAD_PCT        0x0104  ///< Calculated load value
+#define PID_ECT             0x0105  ///< Engine Coolant Temperature
+#define PID_BANK1_STFT		0x0106
+#define PID_BANK1_LTFT		0x0107
+#define PID_BANK2_STFT		0x0108
+#define PID_BANK2_LTFT		0x0109
+#define PID_FRP             0x010A  ///< Fuel rail pressure (Gauge)
+#define PID_MAP             0x010B  ///< Intake manifold absolute pressure
+#define PID_RPM             0x010C  ///< Engine RPM
+#define PID_VSS             0x010D  ///< Vehicle speed sensor
+#define PID_SPARKADV        0x010E  ///< Timing advance for #1 cylinder
+#define PID_IAT             0x010F  ///< Intake Air Temperature
+#define PID_MAF             0x0110  ///< Air Flow Rate from Mass Air Flow Sensor
+#define PID_TP              0x0111  ///< Absolute Throttle Position
+#define PID_AIR_STAT        0x0112  ///< Commanded Secondary Air Status
+#define PID_O2SLOC          0x0113  ///< Location of Oxygen sensors
+#define PID_O2S11           0x0114
+#define PID_O2S12           0x0115
+#define PID_O2S13           0x0116
+#define PID_O2S14           0x0117
+#define PID_O2S21           0x0118
+#define PID_O2S22           0x0119
+#define PID_O2S23           0x011A
+#define PID_O2S24           0x011B
+#define PID_OBDSUP          0x011C  ///< OBD supported by vehicle
+#define PID_PTO_STAT        0x011E  ///< Auxilliary Input Status
+#define PID_RUNTM           0x011F  ///< Engine runtime
+#define PID_MIL_DIST		0x0121  ///< Distance travelled with MIL illuminated
+#define PID_FRP_REL         0x0122  ///< Fuel rail pressure (relative to manifold)
+#define PID_FRP_ATMO        0x0123  ///< Fuel rail pressure (relative to atmosphere)
+#define PID_EGR_PCT         0x012C  ///< Commanded EGR
+#define PID_EGR_ERR         0x012D  ///< EGR Error
+#define PID_EVAP_PCT        0x012E  ///< Commanded Evaporative Purge
+#define PID_FLI             0x012F  ///< Fuel level input
+#define PID_WARM_UPS        0x0130  ///< Warm-ups since trouble codes cleared
+#define PID_CLR_DIST        0x0131  ///< Distance since trouble codes cleared
+#define PID_EVAP_VP         0x0132  ///< Evap system vapour pressure
+#define PID_BARO            0x0133  ///< Barometric pressure
+#define PID_CATEMP11        0x013C  ///< Catalyst temperature Bank 1, Sensor 1
+#define PID_CATEMP21        0x013D  ///< Catalyst temperature Bank 2, Sensor 1
+#define PID_CATEMP12        0x013E  ///< Catalyst temperature Bank 1, Sensor 2
+#define PID_CATEMP22        0x013F  ///< Catalyst temperature Bank 2, Sensor 2
+#define PID_VPWR            0x0142  ///< Control module voltage
+#define PID_LOAD_ABS        0x0143  ///< Absolute load value
+#define PID_EQ_RAT          0x0144  ///< Commanded equivalence ratio
+#define PID_TP_R            0x0145  ///< Relative throttle position
+#define PID_AAT             0x0146  ///< Ambient air temp
+#define PID_TP_B            0x0147  ///< Absolute throttle position B
+#define PID_TP_C            0x0148  ///< Absolute throttle position C
+#define PID_APP_D           0x0149  ///< Accelerator pedal position D
+#define PID_APP_E           0x014A  ///< Accelerator pedal position E
+#define PID_APP_F           0x014B  ///< Accelerator pedal position F
+#define PID_TAC_PCT         0x014C  ///< Commanded throttle actuator control
+#define PID_MIL_TIME		0x014D  ///< Time run with MIL lit
+#define PID_CLR_TIME        0x014E  ///< Time run since MIL cleared
+#define PID_FUEL_TYP        0x0151  ///< Type of fuel in use
+#define PID_ALCH_PCT        0x0152  ///< Alcohol fuel percentage
+#define PID_EVAP_VPA        0x0153  ///< Absolute Evap System Vapour Pressure
+#define PID_EVAP_OTHER      0x0154
+#define PID_FRP_ABS         0x0159  ///< Fuel rail pressure (absolute)
+#define PID_APP_R           0x015A  ///< Relative Accelerator Pedal Position
+
+#define PID_VIN				0x0902  ///< Vehicle Identification Number
+
+/// how the data bytes of a PID become its value
+enum pidKind {
+    PID_KIND_RAW,       ///< length known, not decoded (bit fields)
+    PID_KIND_VALUE,     ///< one value
+    PID_KIND_DOUBLE,    ///< two values, e.g. sensor voltage and fuel trim
+    PID_KIND_STRING     ///< decoded to text by obdbase
+};
+
+/// \brief A value within the data bytes
+///
+/// raw * scale + offset, where raw are size bytes from byte first on,
+/// most significant first.
+struct pidField {
+    unsigned char first;
+    unsigned char size;
+    bool isSigned;
+    double scale;
+    double offset;
+};
+
+/// \brief How to decode one PID
+struct pidDescriptor {
+    int pid;                ///< mode and pid, e.g. 0x010C
+    unsigned char bytes;    ///< data bytes of the answer, 0 if variable
+    unsigned char kind;     ///< a pidKind
+    pidField main;
+    pidField secondary;     ///< PID_KIND_DOUBLE only
+    double imperialScale;   ///< imperial = main * imperialScale + imperialOffset
+    double imperialOffset;
+    const char* units;
+    const char* unitsImperial;
+};
+
+/// \brief Big endian value of the first n bytes
+constexpr long obd_pid_raw (const int* data, int n)
+{
+    return (n == 0) ? 0 : (obd_pid_raw(data, n - 1) << 8) | (data[n - 1] & 0xFF);
+}
+
+/// \brief Two's complement of a value of size bytes
+constexpr long obd_pid_signed (long raw, int size)
+{
+    return ((raw >> (8 * size - 1)) & 1) ? raw - (1L << (8 * size)) : raw;
+}
+
+/// \brief Decode a field from the data bytes of an answer
+///
+/// \param[in] field The field
+/// \param[in] data The data bytes, after the mode and pid bytes
+constexpr double obd_pid_field (const pidField& field, const int* data)
+{
+    return (field.isSigned ? obd_pid_signed(obd_pid_raw(data + field.first, field.size), field.size)
+                           : obd_pid_raw(data + field.first, field.size))
+           * field.scale + field.offset;
+}
+
+/// \class obdPidMap
+/// \brief The PIDs of one mode an ECU supports, a bit per pid.
+class obdPidMap
+{
+public:
+    obdPidMap ();
+
+    void set (int pid);
+    bool test (int pid) const;
+    bool empty () const;
+    void set_range (int base, unsigned long mask);
+    std::string to_hex () const;
+    bool from_hex (const char* hex);
+
+private:
+    unsigned int bits_[8];
+};
+
+/// \class obdPidRegistry
+/// \brief Finds the descriptor of a PID.
+///
+/// Starts with the built in table, more PIDs can be added or built in
+/// ones replaced.  Add PIDs before polling starts: lookups don't lock.
+class obdPidRegistry
+{
+public:
+    obdPidRegistry ();
+
+    const pidDescriptor* find (int pid) const;
+    bool add (const pidDescriptor& descriptor);
+    int load_db (sqlite3* db);
+    int load_dbc (const char* path);
+
+    static obdPidRegistry& get ();
+
+private:
+    const pidDescriptor* mode01_[256];      ///< direct lookup of mode 01
+    std::map<int, const pidDescriptor*> others_;
+    std::list<pidDescriptor> added_;        ///< the descriptors added, never moved
+    std::list<std::string> strings_;        ///< their units
+
+    void set (const pidDescriptor* descriptor);
+    static bool fits (const pidField& field, int bytes);
+    const char* keep (const char* text);
+};
+
+#endif // _OBDPIDS_H_
@@ -0,0 +1,92 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _OBDQUEUE_H_
+#define _OBDQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/// \class obdQueue
+/// \brief A lock-free queue for one producer and one consumer thread.
+///
+/// The elements live in a fixed ring, so pushing and popping never
+/// allocates.  The element type must be copyable without sharing any
+/// memory between the copies (no reference counted strings), because
+/// the consumer reads a slot while the producer goes on writing others.
+template <typename T>
+class obdQueue
+{
+public:
+    /// \param[in] capacity Number of elements, rounded up to a power of two
+    obdQueue(size_t capacity = 256) : head_(0), tail_(0)
+    {
+        size_t n = 2;
+        while (n < capacity) {
+            n *= 2;
+        }
+        ring_.resize(n);
+        mask_ = n - 1;
+    }
+
+    /// \brief Append an element, producer thread only
+    /// \return False if the queue is full
+    bool push(const T& item)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_) {
+            return false;
+        }
+        ring_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// \brief Remove the oldest element, consumer thread only
+    /// \return False if the queue is empty
+    bool pop(T& item)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = ring_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> ring_;
+    size_t mask_;
+    // written by the consumer and the producer respectively, kept on
+    // separate cache lines (padding rather than alignas, which plain
+    // new doesn't honour before C++17)
+    char pad0_[64];
+    std::atomic<size_t> head_;
+    char pad1_[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_;
+};
+
+#endif // _OBDQUEUE_H_
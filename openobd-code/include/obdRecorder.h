@@ -0,0 +1,86 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _OBDRECORDER_H_
+#define _OBDRECORDER_H_
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <wx/thread.h>
+#include "ctb-0.15/fifo.h"
+
+#define OBD_SESSION_MAGIC		"OBDSESS1"  ///< first bytes of a session file
+#define OBD_SESSION_VERSION		1           ///< layout of the records
+#define OBD_SESSION_HEADER		24          ///< bytes of the file header
+#define OBD_RECORD_HEADER		16          ///< bytes of a record before its data
+#define OBD_RECORDER_BUFFER		(1 << 20)   ///< bytes kept in memory for the writer
+#define OBD_RECORDER_FLUSH_MS	250         ///< the writer wakes up at least this often
+
+class obdRecorder
+{
+public:
+
+    /// what a record holds
+    enum recordKind {
+        RECORD_REQUEST = 1,     ///< a command as sent, without the CR
+        RECORD_ANSWER = 2,      ///< the answer up to the prompt, without it
+        RECORD_TIMEOUT = 3      ///< what arrived before the prompt didn't
+    };
+
+    /// a record as read back from a session file
+    struct sessionRecord {
+        unsigned long long time;    ///< microseconds since the session started
+        int kind;
+        int format;                 ///< obdParser::headerFormat of an answer, -1 if not parsed
+        std::string data;
+    };
+
+    obdRecorder ();
+    ~obdRecorder ();
+
+    // writing, called with the link lock held
+    bool open (const char* path);
+    bool close ();
+    bool is_open ();
+    void record (int kind, int format, const char* data, size_t len);
+
+    // reading a session back
+    static bool read_header (FILE* file, unsigned long long* started);
+    static bool read_record (FILE* file, obdRecorder::sessionRecord& result);
+
+    // the writer loop, runs in the background thread
+    void run ();
+
+private:
+
+    // filled by the recording thread, emptied by the writer
+    ctb::Fifo buffer;
+    FILE* file;
+    wxThread* thread;
+    wxSemaphore wake;
+    std::atomic<bool> stopRequested;
+    std::atomic<bool> failed;
+    unsigned long long start;   ///< monotonic time of open() in us
+
+    void append (const char* data, size_t len);
+    void drain ();
+};
+
+#endif // _OBDRECORDER_H_
@@ -0,0 +1,93 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _OBDSCHEDULER_H_
+#define _OBDSCHEDULER_H_
+
+#include <atomic>
+#include <vector>
+#include <wx/thread.h>
+#include "obdbase.h"
+#include "obdQueue.h"
+
+class obdScheduler
+{
+public:
+
+    /// a PID value as published to the consumer
+    struct sample {
+        int pid;
+        bool valid;
+        int pid_flag;
+        double resultMain;
+        double resultSecondary;
+        char resultString[48];      ///< UTF-8, a copy so no memory is shared
+        unsigned long long time;    ///< monotonic time in ms
+    };
+
+    obdScheduler (obdbase* device);
+    ~obdScheduler ();
+
+    // control, called by the GUI thread
+    bool start ();
+    void stop ();
+    bool is_running ();
+    void discover (int mode);
+    void set_rate (int pid, double hz);
+    double get_rate (int pid);
+    static double default_rate (int pid);
+
+    // results, called by the single consumer
+    bool pop (obdScheduler::sample& result);
+    unsigned long dropped ();
+
+    // the polling loop, runs in the worker thread
+    void run ();
+
+private:
+
+    struct entry {
+        int pid;
+        double hz;
+        unsigned long long period;  ///< ms between two requests
+        unsigned long long due;     ///< time of the next request
+    };
+
+    obdbase* device;
+    wxThread* thread;
+
+    // configuration, shared with the worker thread
+    wxMutex configLock;
+    std::vector<entry> entries;
+    int discoverMode;
+
+    // worker thread state
+    wxSemaphore wake;
+    std::atomic<bool> stopRequested;
+    std::vector<int> batch;
+    std::vector<size_t> order;
+
+    // results, the worker thread is the only producer
+    obdQueue<obdScheduler::sample> results;
+    std::atomic<unsigned long> droppedCount;
+
+    void publish (int pid, bool valid, const obdbase::pidInfo& info, unsigned long long now);
+};
+
+#endif // _OBDSCHEDULER_H_
@@ -25,7 +25,9 @@
 Subclass of pidBasePanel, which is generated by wxFormBuilder.
 */
 
+#include <map>
 #include <sqlite3.h>
+#include <wx/timer.h>
 #include "gui.h"
 #include "obdbase.h"
 
@@ -35,15 +37,25 @@ class pidPanel : public pidBasePanel
 protected:
 	// Handlers for pidBasePanel events.
 	void onRefreshClick( wxCommandEvent& event );
+	void onDrainTimer( wxTimerEvent& event );
 
 public:
 	/** Constructor */
 	pidPanel( wxWindow* parent, obdbase* device, sqlite3* sql  );
+	~pidPanel();
 	void updateDevice(obdbase* device);
 
 private:
     obdbase* obd;
     sqlite3* db;
+
+    // picks up the values polled in the background
+    wxTimer drainTimer;
+    std::map<int, long> rows;
+    bool polling;   ///< Refresh has been clicked, poll the next device too
+
+    long addRow(int pid);
+    void startPolling();
 };
 
 #endif // __pidPanel__
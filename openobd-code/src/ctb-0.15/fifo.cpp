@@ -8,124 +8,132 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <stddef.h>
+#include <string.h>
 #include "ctb-0.15/fifo.h"
 
 namespace ctb {
 
     Fifo::Fifo(size_t size) :
-	   m_size(size)
+	   m_rdpos(0),
+	   m_wrseen(0),
+	   m_wrpos(0),
+	   m_rdseen(0)
     {
-	   m_begin = new char[size];
-	   m_end = m_begin + m_size;
-	   m_rdptr = m_wrptr = m_begin;
+	   m_size = 1;
+	   while(m_size < size) {
+		  m_size <<= 1;
+	   }
+	   m_mask = m_size - 1;
+	   m_buf = new char[m_size];
     };
 
     Fifo::~Fifo()
     {
-	   delete m_begin;
+	   delete[] m_buf;
     };
 
     void Fifo::clear()
     {
-	   m_rdptr = m_wrptr = m_begin;
+	   // the reader's copy of the write position must not stay behind
+	   // the read position
+	   size_t wr = m_wrpos.load(std::memory_order_acquire);
+	   m_wrseen = wr;
+	   m_rdpos.store(wr,std::memory_order_release);
     };
 
     int Fifo::get(char* ch)
     {
-	   if(m_rdptr != m_wrptr) {
-		  *ch = *m_rdptr++;
-		  if(m_rdptr >= m_end) {
-			 m_rdptr = m_begin;
-		  }
-		  return 1;
-	   }
-	   return 0;
+	   return read(ch,1);
     };
 
-    size_t Fifo::items()
+    size_t Fifo::items() const
     {
-	   char* tmp_wrptr = m_wrptr;
-	   // the rdptr will only changed by the reader. If we suppose, that
-	   // the caller of the items() method is identical with the reader,
-	   // this should be thread save.
-	   char* tmp_rdptr = m_rdptr;
-
-	   // if the write pointer is identical with the read, there are no
-	   // more data in the Fifo
-	   if(tmp_wrptr == tmp_rdptr) {
-		  return 0;
-	   }
-	   // the write pointer is greater as the read pointer, so we just
-	   // can calculate the difference for the remaining data
-	   if(tmp_wrptr > tmp_rdptr) {
-		  return (tmp_wrptr - tmp_rdptr);
-	   }
-	   // the write pointer has circulate and stands against the read
-	   // pointer
-	   else {
-		  return (m_size - (tmp_rdptr - tmp_wrptr));
-	   }
+	   // exact for the reader, a lower bound for everybody else
+	   size_t rd = m_rdpos.load(std::memory_order_acquire);
+	   return m_wrpos.load(std::memory_order_acquire) - rd;
     };
 
     int Fifo::put(char ch)
     {
-	   // for a thread safe operation, the write of a data byte must be
-	   // atomic. So we first assign the current position of the write
-	   // pointer to a temporary pointer.
-	   // Increment it for the comparison with the end of the internal 
-	   // buffer and the read pointer
-	   char* tmp_wrptr = m_wrptr + 1;
-	   if(tmp_wrptr >= m_end) {
-		  tmp_wrptr = m_begin;
+	   return write(&ch,1);
+    };
+
+    size_t Fifo::readSpan(const char*& data)
+    {
+	   size_t rd = m_rdpos.load(std::memory_order_relaxed);
+	   // the writer's position is only loaded, if the bytes seen
+	   // before are used up
+	   if(m_wrseen == rd) {
+		  m_wrseen = m_wrpos.load(std::memory_order_acquire);
 	   }
-	   if(tmp_wrptr == m_rdptr) {
-		  return 0;
+	   size_t avail = m_wrseen - rd;
+	   size_t offset = rd & m_mask;
+	   data = m_buf + offset;
+	   return (avail < m_size - offset) ? avail : m_size - offset;
+    };
+
+    void Fifo::consume(size_t count)
+    {
+	   m_rdpos.store(m_rdpos.load(std::memory_order_relaxed) + count,
+				  std::memory_order_release);
+    };
+
+    size_t Fifo::writeSpan(char*& data)
+    {
+	   size_t wr = m_wrpos.load(std::memory_order_relaxed);
+	   if(wr - m_rdseen == m_size) {
+		  m_rdseen = m_rdpos.load(std::memory_order_acquire);
 	   }
-	   // this don't changes the write pointer!
-	   *m_wrptr = ch;
-	   // that's the trick! The following assignment is atomic and cannot
-	   // interrupted within a read access by the read thread
-	   m_wrptr = tmp_wrptr;
-	   return 1;
+	   size_t space = m_size - (wr - m_rdseen);
+	   size_t offset = wr & m_mask;
+	   data = m_buf + offset;
+	   return (space < m_size - offset) ? space : m_size - offset;
+    };
+
+    void Fifo::commit(size_t count)
+    {
+	   m_wrpos.store(m_wrpos.load(std::memory_order_relaxed) + count,
+				  std::memory_order_release);
     };
-    
+
     int Fifo::read(char* data,int n)
     {
 	   int nresult = 0;
-	   while(n--) {
-		  // the same as get()
-		  if(m_rdptr != m_wrptr) {
-			 *data = *m_rdptr++;
-			 if(m_rdptr >= m_end) {
-				m_rdptr = m_begin;
-			 }
-		  }
-		  else {
+	   // at most two spans: up to the end of the buffer and from its
+	   // beginning
+	   for(int i = 0; i < 2 && nresult < n; i++) {
+		  const char* span;
+		  size_t len = readSpan(span);
+		  if(!len) {
 			 break;
 		  }
-		  nresult++;
-		  data++;
+		  if(len > (size_t)(n - nresult)) {
+			 len = n - nresult;
+		  }
+		  memcpy(data + nresult,span,len);
+		  consume(len);
+		  nresult += (int)len;
 	   }
 	   return nresult;
     };
 
-    int Fifo::write(char* data,int n)
+    int Fifo::write(const char* data,int n)
     {
 	   int nresult = 0;
-	   while(n--) {
-		  // the same as put()
-		  char* tmp_wrptr = m_wrptr + 1;
-		  if(tmp_wrptr >= m_end) {
-			 tmp_wrptr = m_begin;
-		  }
-		  if(tmp_wrptr == m_rdptr) {
+	   for(int i = 0; i < 2 && nresult < n; i++) {
+		  char* span;
+		  size_t len = writeSpan(span);
+		  if(!len) {
 			 break;
 		  }
-		  *m_wrptr = *data++;
-		  m_wrptr = tmp_wrptr;
-		  nresult++;
+		  if(len > (size_t)(n - nresult)) {
+			 len = n - nresult;
+		  }
+		  memcpy(span,data + nresult,len);
+		  commit(len);
+		  nresult += (int)len;
 	   }
 	   return nresult;
     };
 
-} // namespace ctb    
+} // namespace ctb
@@ -20,20 +20,20 @@ namespace ctb {
     {
 	   char *cp = buf;
 	   int n = 0;
-	   int timeout = 0;
 	   size_t toread = len;
+	   Deadline deadline(timeout_in_ms);
 
-	   Timer t(timeout_in_ms,&timeout,NULL);
-	   if(timeout_in_ms != 0xFFFFFFFF) {
-		  t.start();
-	   }
-
-	   while(!timeout && (toread > 0)) {
+	   while(toread > 0) {
 		  if((n = Read(cp,toread)) < 0) {
 			 break;
 		  }
 		  if(!n) {
-			 sleepms(1);
+			 // nothing received, wait for more data until the
+			 // deadline has passed
+			 long left = deadline.Left();
+			 if(!left || (WaitReadable(left) < 0)) {
+				break;
+			 }
 		  }
 		  toread -= n;
 		  cp += n;
@@ -74,84 +74,197 @@ namespace ctb {
 	   return(len - toread);
     };
 
-    int IOBase::ReadUntilEOS(char*& readbuf,
+    int IOBase::WaitReadable(long timeout_in_ms)
+    {
+	   if(m_fifo->items() > 0) {
+		  return 1;
+	   }
+	   // we cannot wait for incoming data here, so just poll
+	   if(timeout_in_ms != 0) {
+		  sleepms(1);
+	   }
+	   return 1;
+    };
+
+    long IOBase::FindEOS(size_t& from,
+					const char* eos,
+					size_t eoslen,
+					char quota,
+					int& quoted)
+    {
+	   const char* buf = m_rxbuf;
+	   size_t len = m_rxlen;
+
+	   if(!quota) {
+		  // a multi character eos may start in the already searched
+		  // part of the buffer
+		  size_t i = (from >= eoslen - 1) ? from - (eoslen - 1) : 0;
+		  while(i + eoslen <= len) {
+			 const char* p = (const char*)memchr(buf + i,*eos,
+										 len - eoslen + 1 - i);
+			 if(!p) {
+				break;
+			 }
+			 i = p - buf;
+			 if(memcmp(p,eos,eoslen) == 0) {
+				return (long)i;
+			 }
+			 i++;
+		  }
+		  from = len;
+		  return -1;
+	   }
+	   // with a quota character every byte must be inspected
+	   for(size_t i = from; i < len; i++) {
+		  if(!quoted && (buf[i] == *eos)) {
+			 if(i + eoslen > len) {
+				// maybe the rest of the eos is still coming
+				from = i;
+				return -1;
+			 }
+			 if(memcmp(buf + i,eos,eoslen) == 0) {
+				return (long)i;
+			 }
+		  }
+		  if(buf[i] == quota) {
+			 quoted ^= 1;
+		  }
+	   }
+	   from = len;
+	   return -1;
+    };
+
+    int IOBase::ReadUntilEOS(const char*& line,
 						 size_t* readedBytes,
-						 char* eosString,
+						 const char* eosString,
 						 long timeout_in_ms,
 						 char quota)
     {
-	   int n = 0;
-	   int timeout = 0;
-	   int bufsize = DELTA_BUFSIZE;
-	   int result = 0;
+	   size_t eoslen = strlen(eosString);
+	   size_t searched = 0;
 	   int quoted = 0;
-	   char* buf = new char[bufsize];
-	   char* des = buf;
-	   char* eos = eosString;
-	   char ch;
-
-	   Timer t(timeout_in_ms,&timeout,NULL);
-	   t.start();
-
-	   while(!timeout) {
-		  if(des >= &buf[bufsize]) {
-			 // buffer full, realloc more memory
-			 char* tmp = new char[bufsize + DELTA_BUFSIZE + 1];
-			 memcpy(tmp,buf,bufsize);
-			 delete buf;
-			 buf = tmp;
-			 des = &buf[bufsize];
-			 bufsize += DELTA_BUFSIZE;
-		  }
-		  // read next byte
-		  n = Read(&ch,1);
+	   int result = 0;
+	   long pos = -1;
+	   Deadline deadline(timeout_in_ms < 0 ? 0 : (unsigned int)timeout_in_ms);
+
+	   // discard the string returned by the last call, the bytes
+	   // behind it are in the fifo
+	   m_rxlen = m_rxused = 0;
+	   if(!m_rxbuf) {
+		  m_rxsize = DELTA_BUFSIZE;
+		  m_rxbuf = new char[m_rxsize + 1];
+	   }
+	   m_rxstamps = 0;
+
+	   while(1) {
+		  if(eoslen && (pos = FindEOS(searched,eosString,eoslen,
+							    quota,quoted)) >= 0) {
+			 result = 1;
+			 break;
+		  }
+		  if(m_rxlen == m_rxsize) {
+			 // buffer full, double it (the spare byte at the end
+			 // takes the terminating null)
+			 char* tmp = new char[2 * m_rxsize + 1];
+			 memcpy(tmp,m_rxbuf,m_rxlen);
+			 delete[] m_rxbuf;
+			 m_rxbuf = tmp;
+			 m_rxsize *= 2;
+		  }
+		  // read everything available at once
+		  int n = Read(m_rxbuf + m_rxlen,m_rxsize - m_rxlen);
 		  if(n < 0) {
 			 // an error occured
 			 result = -1;
 			 break;
 		  }
-		  else if(n == 0) {
-			 // no data available, give up the processor for some time
-			 // to reduce the cpu last
-			 sleepms(10);
+		  if(n > 0) {
+			 m_rxlen += n;
+			 StampRx(m_rxlen);
 			 continue;
 		  }
-		  // if eos is composed of more than one char, and the current
-		  // byte doesn't match the next eos character, we handle the
-		  // readed byte as a normal char (and not an eos)
-		  if((eos != eosString) && (ch != *eos)) {
-			 // FIXME!
-			 // write all characters, which was matched the eos string
-			 // until now (with the first wrong character all received
-			 // eos characters are invalid and must handled as normal
-			 // characters).
-
-			 // This doesn't work right and is only a little workaround
-			 // because the received eos chars are lost
-			 PutBack(ch);
-			 // because we doesn't match the eos string, we must 'reset' 
-			 // the eos match
-			 eos = eosString;
-			 continue;
+		  // no data available, sleep until some arrives
+		  long left = deadline.Left();
+		  if(!left) {
+			 break;
 		  }
-		  else {
-			 if((ch == *eos) && !quoted) {
-				if(*++eos == 0) {
-				    // the eos string is complete
-				    result = 1;
-				    break;
-				}
-				continue;
-			 }
+		  if(WaitReadable(left) < 0) {
+			 result = -1;
+			 break;
 		  }
-		  if(ch == quota) {
-			 quoted ^= 1;
+	   }
+
+	   size_t len = (result == 1) ? (size_t)pos : m_rxlen;
+	   m_rxused = (result == 1) ? len + eoslen : m_rxlen;
+
+	   // give the bytes following the eos back to the input stream
+	   size_t rest = m_rxlen - m_rxused;
+	   if(rest) {
+		  PutBack(m_rxbuf + m_rxused,rest);
+		  m_rxlen = m_rxused;
+	   }
+	   m_rxbuf[len] = 0;
+	   line = m_rxbuf;
+	   *readedBytes = len;
+	   return result;
+    };
+
+    void IOBase::PutBack(const char* buf,size_t len)
+    {
+	   size_t items = m_fifo->items();
+	   if(!items && (len <= m_fifo->size())) {
+		  m_fifo->write(buf,(int)len);
+		  return;
+	   }
+	   // the bytes still in the fifo came later, so they go behind
+	   // the new ones; a fifo too small is replaced by a bigger one
+	   Fifo* fifo = new Fifo((len + items > (size_t)fifoSize) ?
+						len + items : (size_t)fifoSize);
+	   fifo->write(buf,(int)len);
+	   const char* span;
+	   size_t n;
+	   while((n = m_fifo->readSpan(span)) > 0) {
+		  fifo->write(span,(int)n);
+		  m_fifo->consume(n);
+	   }
+	   delete m_fifo;
+	   m_fifo = fifo;
+    };
+
+    void IOBase::StampRx(size_t end)
+    {
+	   if(m_rxstamps == rxStamps) {
+		  // out of entries, the bytes of the last one count as read
+		  // now
+		  m_rxstamps--;
+	   }
+	   m_rxstamp[m_rxstamps].end = end;
+	   m_rxstamp[m_rxstamps].us = monotonicus();
+	   m_rxstamps++;
+    };
+
+    unsigned long long IOBase::ArrivalTime(size_t offset) const
+    {
+	   for(int i = 0; i < m_rxstamps; i++) {
+		  if(offset < m_rxstamp[i].end) {
+			 return m_rxstamp[i].us;
 		  }
-		  *des++ = ch;
 	   }
-	   *des = 0;
-	   readbuf = buf;
-	   *readedBytes = des - buf;
+	   return m_rxstamps ? m_rxstamp[m_rxstamps - 1].us : 0;
+    };
+
+    int IOBase::ReadUntilEOS(char*& readbuf,
+						 size_t* readedBytes,
+						 char* eosString,
+						 long timeout_in_ms,
+						 char quota)
+    {
+	   const char* line;
+	   int result = ReadUntilEOS(line,readedBytes,(const char*)eosString,
+						    timeout_in_ms,quota);
+	   // the caller owns (and deletes) a copy
+	   readbuf = new char[*readedBytes + 1];
+	   memcpy(readbuf,line,*readedBytes + 1);
 	   return result;
     };
 
@@ -159,20 +272,20 @@ namespace ctb {
     {
 	   char *cp = buf;
 	   int n = 0;
-	   int timeout = 0;
 	   size_t towrite = len;
+	   Deadline deadline(timeout_in_ms);
 
-	   Timer t(timeout_in_ms,&timeout,NULL);
-	   if(timeout_in_ms != 0xFFFFFFFF) {
-		  t.start();
-	   }
-
-	   while(!timeout && (towrite > 0)) {
+	   while(towrite > 0) {
 		  if((n = Write(cp,towrite)) < 0) {
 			 // an error occurs
 			 break;
 		  }
 		  if(!n) {
+			 // the output queue is full, it drains with the
+			 // baudrate anyway
+			 if(deadline.Expired()) {
+				break;
+			 }
 			 sleepms(1);
 		  }
 		  towrite -= n;
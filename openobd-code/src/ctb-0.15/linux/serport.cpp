@@ -11,14 +11,46 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <unistd.h>
+#include <asm/ioctls.h>
 
 #define CMSPAR	  010000000000		/* mark or space (stick) parity */
 
+/*
+  The kernel's termios2 takes the baudrate as a plain number (with the
+  BOTHER speed flag), so any rate the UART can generate is possible.
+  glibc's termios.h and the kernel's asm/termbits.h don't go together,
+  so the struct is repeated here. Only for the architectures using the
+  generic layout, the others fall back to the custom divisor.
+*/
+#if defined(TCGETS2) && !defined(__powerpc__) && !defined(__alpha__) && \
+    !defined(__mips__) && !defined(__sparc__)
+# define CTB_TERMIOS2
+# ifndef BOTHER
+#  define BOTHER	  0010000
+# endif
+# define CTB_NCCS	  19
+# define CTB_IBSHIFT	  16
+
+struct termios2 {
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t c_line;
+    cc_t c_cc[CTB_NCCS];
+    speed_t c_ispeed;
+    speed_t c_ospeed;
+};
+#endif
+
 namespace ctb {
 
     const char* COM1 = "/dev/ttyS0";
@@ -43,9 +75,12 @@ namespace ctb {
     const char* COM20 = "/dev/ttyS19";
 
     SerialPort::SerialPort() :
-	   SerialPort_x()
+	   SerialPort_x(),
+	   m_rxerror(0)
     {
 	   fd = -1;
+	   m_rxring = 0L;
+	   m_rxevent = m_stopevent = -1;
     };
 
     SerialPort::~SerialPort()
@@ -64,6 +99,7 @@ namespace ctb {
 	   case 4800: return B4800;
 	   case 9600: return B9600;
 	   case 19200: return B19200;
+	   case 38400: return B38400;
 	   case 57600: return B57600;
 	   case 115200: return B115200;
 	   case 230400: return B230400;
@@ -71,7 +107,8 @@ namespace ctb {
 	   case 921600: return B921600;
 
 		  // NOTE! The speed of 38400 is required, if you want to set
-		  //       an non-standard baudrate. See below!
+		  //       an non-standard baudrate with the custom divisor.
+		  //       SetBaudrateAny sets the real rate afterwards.
 	   default: return B38400;
 	   }
     };
@@ -81,6 +118,8 @@ namespace ctb {
 	   int err = 0;
 	   // only close an open file handle
 	   if(fd < 0) return EBADF;
+	   // the reader thread must not use the fd any longer
+	   StopReader();
 	   // With some systems, it is recommended to flush the serial port's 
 	   // Output before closing it, in order to avoid a possible hang of
 	   // the process...
@@ -312,6 +351,17 @@ namespace ctb {
 	   if(m_fifo->items() > 0) {
 		  return m_fifo->read(buf,len);
 	   }
+	   if(m_rxring) {
+		  // the error is loaded first: the thread puts its last bytes
+		  // into the ring before, so an empty ring is really empty
+		  int err = m_rxerror.load(std::memory_order_acquire);
+		  int n = m_rxring->read(buf,(int)len);
+		  if(!n && err) {
+			 errno = err;
+			 return -1;
+		  }
+		  return n;
+	   }
 	   // Read() (using read() ) will return an 'error' EAGAIN as it is 
 	   // set to non-blocking. This is not a true error within the 
 	   // functionality of Read, and thus should be handled by the caller.
@@ -320,6 +370,142 @@ namespace ctb {
 	   return n;
     };
 
+    int SerialPort::WaitReadable(long timeout_in_ms)
+    {
+	   // put back bytes are available immediately
+	   if(m_fifo->items() > 0) {
+		  return 1;
+	   }
+	   if(m_rxring && (m_rxring->items() > 0 ||
+				    m_rxerror.load(std::memory_order_acquire))) {
+		  return 1;
+	   }
+	   struct pollfd pfd;
+	   // with a reader thread, wait for its signal instead of the device
+	   pfd.fd = m_rxring ? m_rxevent : fd;
+	   pfd.events = POLLIN;
+	   pfd.revents = 0;
+	   int n = poll(&pfd,1,timeout_in_ms < 0 ? -1 : (int)timeout_in_ms);
+	   if(n < 0) {
+		  // a signal isn't an error, the caller simply tries again
+		  return (errno == EINTR) ? 1 : -1;
+	   }
+	   if((n > 0) && m_rxring) {
+		  // reset the event, the ring tells what arrived
+		  uint64_t count;
+		  ssize_t r = read(m_rxevent,&count,sizeof(count));
+		  (void)r;
+	   }
+	   return (n > 0) ? 1 : 0;
+    };
+
+    // adds one to the counter of an eventfd, which wakes its poll()
+    static void Signal( int efd )
+    {
+	   uint64_t one = 1;
+	   ssize_t n = write(efd,&one,sizeof(one));
+	   (void)n;
+    };
+
+    void* SerialPort::ReaderThread( void* arg )
+    {
+	   ((SerialPort*)arg)->ReaderLoop();
+	   return 0L;
+    };
+
+    void SerialPort::ReaderLoop()
+    {
+	   struct pollfd pfd[2];
+	   pfd[0].fd = fd;
+	   pfd[0].events = POLLIN;
+	   pfd[1].fd = m_stopevent;
+	   pfd[1].events = POLLIN;
+
+	   while(1) {
+		  char* span;
+		  size_t space = m_rxring->writeSpan(span);
+		  // a full ring must be drained by the caller first, so only
+		  // wait for the stop request and look again shortly
+		  int n = space ? poll(pfd,2,-1) : poll(pfd + 1,1,1);
+		  if(n < 0) {
+			 if(errno == EINTR) continue;
+			 m_rxerror.store(errno,std::memory_order_release);
+			 Signal(m_rxevent);
+			 break;
+		  }
+		  if(pfd[1].revents) {
+			 break;
+		  }
+		  if(!space || !n) {
+			 continue;
+		  }
+		  int got = read(fd,span,space);
+		  if(got > 0) {
+			 m_rxring->commit(got);
+			 Signal(m_rxevent);
+			 continue;
+		  }
+		  if((got < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+			 continue;
+		  }
+		  if((got == 0) && !(pfd[0].revents & POLLHUP)) {
+			 continue;
+		  }
+		  // the device is gone (a hangup reads as end of file)
+		  m_rxerror.store(got < 0 ? errno : EIO,std::memory_order_release);
+		  Signal(m_rxevent);
+		  break;
+	   }
+    };
+
+    int SerialPort::StartReader( size_t size )
+    {
+	   if(fd < 0) {
+		  return -1;
+	   }
+	   if(m_rxring) {
+		  return 0;
+	   }
+	   m_rxevent = eventfd(0,EFD_NONBLOCK);
+	   m_stopevent = eventfd(0,0);
+	   m_rxerror.store(0);
+	   m_rxring = new Fifo(size);
+	   if(m_rxevent < 0 || m_stopevent < 0 ||
+		 pthread_create(&m_reader,0L,ReaderThread,this)) {
+		  if(m_rxevent >= 0) close(m_rxevent);
+		  if(m_stopevent >= 0) close(m_stopevent);
+		  m_rxevent = m_stopevent = -1;
+		  delete m_rxring;
+		  m_rxring = 0L;
+		  return -1;
+	   }
+	   return 0;
+    };
+
+    void SerialPort::StopReader()
+    {
+	   if(!m_rxring) {
+		  return;
+	   }
+	   Signal(m_stopevent);
+	   pthread_join(m_reader,0L);
+	   close(m_rxevent);
+	   close(m_stopevent);
+	   m_rxevent = m_stopevent = -1;
+
+	   // the thread is gone, so the bytes not read yet can be moved
+	   // behind the put back ones
+	   const char* span;
+	   size_t len;
+	   while((len = m_rxring->readSpan(span)) > 0) {
+		  int n = m_fifo->write(span,(int)len);
+		  m_rxring->consume(len);
+		  if((size_t)n < len) break;
+	   }
+	   delete m_rxring;
+	   m_rxring = 0L;
+    };
+
     int SerialPort::SendBreak(int duration)
     {
 	   // the parameter is equal with linux
@@ -359,17 +545,48 @@ namespace ctb {
 
     int SerialPort::SetBaudrateAny( int baudrate )
     {
+	   if( baudrate <= 0 ) {
+		  return -1;
+	   }
+
+#ifdef CTB_TERMIOS2
+	   struct termios2 t2;
+
+	   if( ioctl( fd, TCGETS2, &t2 ) == 0 ) {
+		  // the input speed follows the output speed
+		  t2.c_cflag &= ~( CBAUD | ( CBAUD << CTB_IBSHIFT ) );
+		  t2.c_cflag |= BOTHER;
+		  t2.c_ispeed = baudrate;
+		  t2.c_ospeed = baudrate;
+		  if( ioctl( fd, TCSETS2, &t2 ) == 0 ) {
+			 m_dcs.baud = baudrate;
+			 // keep the termios copy in step for later changes
+			 tcgetattr( fd, &t );
+			 return 0;
+		  }
+	   }
+#endif
+
+	   // older kernels and drivers: B38400 plus a custom divisor
 	   struct serial_struct ser_info; 
 
-	   int result = ioctl( fd, TIOCGSERIAL, &ser_info ); 
+	   if( ioctl( fd, TIOCGSERIAL, &ser_info ) < 0 ) {
+		  return -1;
+	   }
+	   if( cfsetspeed( &t, B38400 ) < 0 || tcsetattr( fd, TCSANOW, &t ) < 0 ) {
+		  return -1;
+	   }
 
 	   ser_info.flags = ASYNC_SPD_CUST | ASYNC_LOW_LATENCY;
 
 	   ser_info.custom_divisor = ser_info.baud_base / baudrate; 
 
-	   result = ioctl( fd, TIOCSSERIAL, &ser_info );
+	   if( ioctl( fd, TIOCSSERIAL, &ser_info ) < 0 ) {
+		  return -1;
+	   }
+	   m_dcs.baud = baudrate;
 
-	   return result;
+	   return 0;
     }
 
     int SerialPort::SetBaudrateStandard( int baudrate )
@@ -390,6 +607,9 @@ namespace ctb {
 
     int SerialPort::SetBaudrate( int baudrate )
     {
+	   // send the pending output with the old rate
+	   tcdrain( fd );
+
 	   return IsStandardRate( baudrate ) ?
 		  SetBaudrateStandard( baudrate ) :
 		  SetBaudrateAny( baudrate );
@@ -9,6 +9,7 @@
 
 
 #include "ctb-0.15/timer.h"
+#include <time.h>
 #include <unistd.h>
 
 namespace ctb {
@@ -94,4 +95,18 @@ namespace ctb {
 	   usleep(ms * 1000);
     };
 
+    unsigned long long monotonicms()
+    {
+	   struct timespec ts;
+	   clock_gettime(CLOCK_MONOTONIC,&ts);
+	   return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    };
+
+    unsigned long long monotonicus()
+    {
+	   struct timespec ts;
+	   clock_gettime(CLOCK_MONOTONIC,&ts);
+	   return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    };
+
 } // namespace ctb
@@ -82,4 +82,22 @@ namespace ctb {
 	   timeEndPeriod(1);
     };
 
+    unsigned long long monotonicms()
+    {
+	   LARGE_INTEGER freq, now;
+	   QueryPerformanceFrequency(&freq);
+	   QueryPerformanceCounter(&now);
+	   return (unsigned long long)(now.QuadPart / (freq.QuadPart / 1000));
+    };
+
+    unsigned long long monotonicus()
+    {
+	   LARGE_INTEGER freq, now;
+	   QueryPerformanceFrequency(&freq);
+	   QueryPerformanceCounter(&now);
+	   // whole seconds first, the counter times a million overflows
+	   unsigned long long ticks = now.QuadPart, hz = freq.QuadPart;
+	   return ticks / hz * 1000000 + ticks % hz * 1000000 / hz;
+    };
+
 } // namespace ctb
@@ -30,6 +30,11 @@
     #include <wx/wx.h>
 #endif
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <wx/tokenzr.h>
+
 #include "elm327.h"
 #include "obdbase.h"
 #include "logPanel.h"
@@ -40,10 +45,32 @@ using namespace ctb;
 
 elm327::elm327 (const wxString& serialPort) : obdbase(serialPort)
 {
+	this->version_ = 0.0;
+	this->protocol_ = -1;
+	this->multiPid_ = true;
+	this->multiRefused_ = 0;
+	this->baudSwitch_ = true;
+	this->headers_ = false;
+	this->windowCount_ = 0;
+	this->tuned_ = false;
+	this->retune_ = 0;
+	this->responders_ = 0;
+	this->requestTime_ = 0;
+	this->reported_ = monotonicus();
+	this->pendingSingle_ = false;
+	this->pendingCounted_ = false;
 	this->obdInitSlow();
 	this->elmSetEcho(false);
 	this->elmSetHeaders(false);
-	this->version_ = 0.0;
+}
+
+/// \brief Disconnect, the base class destructor can't
+///
+/// Reports the answer times and resets the device state, see
+/// obdDeviceDisconnect().
+elm327::~elm327 ()
+{
+	this->obdDeviceDisconnect();
 }
 
 /// \brief Request a change of protocol
@@ -71,6 +98,7 @@ bool elm327::obdProtocolSet (int OBDprotocol)
 
 		// preform an init
 		this->obdInitSlow();
+		this->protocol_ = -1;
 	}
 	return result;
 }
@@ -143,8 +171,25 @@ void elm327::obdInitFast ()
 /// \since 0.5.1
 void elm327::obdDeviceDisconnect()
 {
+    if (this->obd_is_connected()) {
+        this->elmReportLatency();
+    }
     obdbase::obdDeviceDisconnect();
+
+    // the polling thread has stopped, but other threads may still
+    // be in the middle of a request
+    wxMutexLocker lock(linkLock);
     version_ = 0.0;
+    protocol_ = -1;
+    multiPid_ = true;
+    multiRefused_ = 0;
+    baudSwitch_ = true;
+    latency_.clear();
+    windowCount_ = 0;
+    tuned_ = false;
+    retune_ = 0;
+    responders_ = 0;
+    reported_ = monotonicus();
 }
 
 wxString elm327::elmSendAtCommand (const wxString& command)
@@ -152,6 +197,9 @@ wxString elm327::elmSendAtCommand (const wxString& command)
 	wxString result;
 	wxString fullCmd;
 
+	// one exchange at a time
+	wxMutexLocker lock(linkLock);
+
 	// Build the full command
 	fullCmd = _T("AT") + command;
 
@@ -164,6 +212,22 @@ wxString elm327::elmSendAtCommand (const wxString& command)
 	return result;
 }
 
+/// \brief Show the headers of the answers, to tell the ECUs apart
+///
+/// \see obdbase::obd_use_headers()
+/// \since 0.5.2
+bool elm327::obd_use_headers (bool use)
+{
+    if (use == headers_) {
+        return true;
+    }
+    if (!this->elmSetHeaders(use)) {
+        return false;
+    }
+    this->obdForgetEcus();
+    return true;
+}
+
 /// \brief Turn on or off the header responses
 ///
 /// \param show If we wish to see the headers or not
@@ -186,6 +250,7 @@ bool elm327::elmSetHeaders (bool show)
 	// check we have a good result
 	if (result.Cmp(_T("OK")) == 0) {
 	    retVal = true;
+	    this->headers_ = show;
 	}
 
 	// return our success
@@ -264,3 +329,649 @@ double elm327::elmGetVersion()
     // return teh version
     return this->version_;
 }
+
+/// \brief Determine if the device talks to the ECU over CAN
+///
+/// Asks the device for the protocol number in use, which is only
+/// known once the device has talked to the ECU.
+///
+/// \return True for one of the ISO 15765 (CAN) protocols
+/// \since 0.5.2
+bool elm327::elmIsCan()
+{
+    if (this->protocol_ < 0 && this->obd_is_connected()) {
+        wxString cmd(_T("DPN"));
+        wxString response = this->elmSendAtCommand(cmd);
+        long num;
+
+        // an 'A' in front marks an automatically chosen protocol
+        if (response.StartsWith(_T("A"))) {
+            response = response.Mid(1);
+        }
+        // 0 means the protocol search hasn't happened yet, so ask again
+        if (response.ToLong(&num, 16) && num > 0) {
+            this->protocol_ = num;
+        }
+    }
+
+    return (this->protocol_ >= PROTO_15765_11_500 &&
+            this->protocol_ <= PROTO_15765_29_250);
+}
+
+/// \brief Switch the serial link to another rate
+///
+/// Uses AT BRD: the device answers OK, changes its rate and sends its
+/// identity at the new rate.  Once the whole identity line has arrived,
+/// a CR confirms the new rate; otherwise the device goes back to the
+/// old rate after the AT BRT time, and so does the port.
+///
+/// \param[in] baud The new rate, between 15686 and 500000 baud
+/// \return True if both ends now use the new rate
+/// \since 0.5.2
+bool elm327::elmSetBaudrate(int baud)
+{
+    const char* answer;
+    size_t size;
+    char cr[] = "\r";
+    int divisor;
+    int rate;
+    int old = this->baudrate;
+    bool result = false;
+
+    if (!this->obd_is_connected() || old == 0 || baud <= 0) {
+        return false;
+    }
+
+    // the device divides its clock, the divisor must fit in a byte and
+    // be at least 8
+    divisor = (ELM_BAUD_CLOCK + baud / 2) / baud;
+    if (divisor < 8 || divisor > 0xFF) {
+        return false;
+    }
+
+    // the rate the device really sends at; a standard rate within 2%
+    // is used as it is, the UART of the PC may not do other rates
+    rate = ELM_BAUD_CLOCK / divisor;
+    if (SerialPort::IsStandardRate(baud) && abs(rate - baud) * 50 < baud) {
+        rate = baud;
+    }
+
+    if (logger) {
+        wxString msg;
+        msg.Printf(_("Asking to change the baud rate to %d\n"), rate);
+        logger->appendLog(msg, logPanel::LOG_OUT);
+    }
+
+    // one exchange at a time
+    wxMutexLocker lock(linkLock);
+
+    // give the PC time to switch and answer
+    this->elmSendAtCommand(wxString::Format(_T("BRT %02X"), ELM_BRT));
+
+    wxString cmd = wxString::Format(_T("ATBRD %02X"), divisor);
+    if (!this->obdWrite(cmd, cmd.length())) {
+        return false;
+    }
+
+    // older devices answer '?', then the prompt
+    if (port->ReadUntilEOS(answer, &size, "OK", OBD_PROBE_MS, 0) != 1) {
+        if (strchr(answer, '?')) {
+            baudSwitch_ = false;
+        }
+        port->ReadUntilEOS(answer, &size, ">", OBD_PROBE_MS, 0);
+        return false;
+    }
+
+    // the identity line, e.g. "ELM327 v1.4"; what came before was sent
+    // while the rates didn't match
+    if (port->SetBaudrate(rate) == 0 &&
+        port->ReadUntilEOS(answer, &size, "ELM", ELM_BRT * 5, 0) == 1 &&
+        port->ReadUntilEOS(answer, &size, "\r", ELM_BRT * 5, 0) == 1 &&
+        port->Writev(cr, 1, OBD_PROBE_MS) == 1 &&
+        port->ReadUntilEOS(answer, &size, ">", OBD_PROBE_MS, 0) == 1) {
+        this->baudrate = rate;
+        result = true;
+    } else {
+        // the device falls back after the AT BRT time and sends a prompt
+        port->SetBaudrate(old);
+        port->ReadUntilEOS(answer, &size, ">", ELM_BRT * 5 + OBD_PROBE_MS, 0);
+    }
+
+    if (logger) {
+        wxString msg;
+        if (result) {
+            msg.Printf(_("Baud rate is now %d\n"), rate);
+            logger->appendLog(msg, logPanel::LOG_IN);
+        } else {
+            msg.Printf(_("Baud rate %d failed, staying at %d\n"), rate, old);
+            logger->appendLog(msg, logPanel::LOG_ERROR);
+        }
+    }
+    return result;
+}
+
+/// \brief Switch the serial link to the fastest rate that works
+///
+/// Tries the fast rates one after the other, from the fastest down,
+/// until both the device and the port manage one.  Does nothing for
+/// devices older than version 1.2, which don't know AT BRD.  Called
+/// once connected and given the logger, so the outcome is logged.
+///
+/// \return The rate of the link afterwards
+/// \since 0.5.2
+int elm327::elmNegotiateBaudrate()
+{
+    static const int rates[] = { 500000, 230400, 115200 };
+
+    if (this->elmGetVersion() < 1.2) {
+        return this->obd_baudrate();
+    }
+
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        if (!baudSwitch_ || this->obd_baudrate() >= rates[i]) {
+            break;
+        }
+        if (this->elmSetBaudrate(rates[i])) {
+            break;
+        }
+    }
+
+    return this->obd_baudrate();
+}
+
+/// \brief Get the values of several PIDs
+///
+/// On CAN up to six mode 01 PIDs are requested at once.  Other
+/// protocols are asked for one PID after the other.  A batch without
+/// a usable answer is asked for again one PID at a time; only when
+/// the ECU answers those, ELM_MULTI_REFUSALS times in a row, are
+/// multi-PID requests given up for the connection.
+///
+/// \see obdbase::obd_pid_values()
+/// \since 0.5.2
+void elm327::obd_pid_values(const std::vector<int>& pids,
+                            std::vector<obdbase::pidInfo>& results,
+                            std::vector<bool>& retrieved)
+{
+    size_t i = 0;
+
+    if (!this->multiPid_ || !this->elmIsCan()) {
+        obdbase::obd_pid_values(pids, results, retrieved);
+        return;
+    }
+
+    results.resize(pids.size());
+    retrieved.assign(pids.size(), false);
+
+    while (i < pids.size()) {
+        // collect the following mode 01 PIDs of known length
+        size_t count = 0;
+        while (this->multiPid_ && i + count < pids.size() && count < ELM_MAX_PIDS &&
+               obd_pid_length(pids[i + count]) > 0) {
+            count++;
+        }
+
+        if (count < 2) {
+            retrieved[i] = this->obd_pid_value(pids[i], &results[i]);
+            i++;
+        } else if (this->elmPidRequest(pids, i, count, results, retrieved) > 0) {
+            this->multiRefused_ = 0;
+            i += count;
+        } else {
+            // no usable answer; this may be a NO DATA or a bus error as
+            // well as an ECU which won't take several PIDs at once
+            bool answered = false;
+            size_t last = i + count;
+            for (; i < last; i++) {
+                retrieved[i] = this->obd_pid_value(pids[i], &results[i]);
+                answered = answered || retrieved[i];
+            }
+
+            if (answered && ++this->multiRefused_ >= ELM_MULTI_REFUSALS) {
+                if (logger) {
+                    wxString msg = _("The ECU doesn't answer multi-PID requests, asking for single PIDs\n");
+                    logger->appendLog(msg, logPanel::LOG_ERROR);
+                }
+                this->multiPid_ = false;
+            }
+        }
+    }
+}   // obd_pid_values()
+
+/// \brief Request several mode 01 PIDs in one message
+///
+/// With headers off the device prints a multi frame response as the
+/// byte count followed by the frames, each prefixed by its index
+/// ("0: 41 0C 1A F8 0D"). Both are skipped, the data bytes are then
+/// a 41 followed by pid / value records in any order.  A further 41
+/// starts the response of another ECU.
+///
+/// \param[in] pids The pids requested
+/// \param[in] first Index of the first pid to request
+/// \param[in] count Number of pids to request
+/// \param[out] results Receives the calculated values
+/// \param[out] retrieved Set for each pid with a valid result
+/// \return The number of records found in the answers
+/// \since 0.5.2
+int elm327::elmPidRequest(const std::vector<int>& pids, size_t first, size_t count,
+                          std::vector<obdbase::pidInfo>& results,
+                          std::vector<bool>& retrieved)
+{
+    obdParser parser;
+    obdParser::headerFormat format;
+    const char* raw;
+    size_t size;
+    wxString cmd(_T("01"));
+    wxString msg;
+    size_t last = first + count;
+    int found = 0;
+
+    for (size_t j = first; j < last; j++) {
+        cmd += wxString::Format(_T("%02X"), pids[j] & 0xFF);
+    }
+
+    if (logger) {
+        msg.Printf(_("Requesting PIDs: %s\n"), cmd.c_str());
+        logger->appendLog(msg, logPanel::LOG_OUT);
+    }
+
+    {
+        // one exchange at a time, the answer lives in the port buffer
+        // until the next read
+        wxMutexLocker lock(linkLock);
+
+        format = this->obdAnswerFormat();
+        if (!this->obdWrite(cmd, cmd.length())) {
+            return 0;
+        }
+        this->obdReadRaw(raw, &size);
+
+        // write the raw response to the log if needed
+        if (logger && logExtra) {
+            msg.Printf(_("Raw data: %s\n"), obdPrintable(raw, size).c_str());
+            logger->appendLog(msg, logPanel::LOG_IN);
+        }
+
+        parser.parse(raw, size, format);
+    }
+
+    // each answer is 0x41 followed by pid and data records, with
+    // headers on every ECU's records are kept
+    for (int m = parser.find(0x41); m >= 0; m = parser.find(0x41, -1, m + 1)) {
+        const unsigned char* bytes = parser.data(m);
+        size_t length = parser.get(m).length;
+        int ecu = parser.get(m).ecu;
+        size_t pos = 1;
+
+        while (pos < length) {
+            // look the pid up among those requested
+            int pid = 0x0100 | bytes[pos];
+            size_t j = first;
+            while (j < last && pids[j] != pid) {
+                j++;
+            }
+            if (j == last) {
+                break;
+            }
+
+            int toks[8];
+            int len = obd_pid_length(pid);
+            if (pos + len >= length || len + 2 > (int)(sizeof(toks) / sizeof(toks[0]))) {
+                break;
+            }
+
+            // decode the record as if it was a single response
+            obdbase::pidInfo info;
+            toks[0] = 0x41;
+            for (int k = 0; k <= len; k++) {
+                toks[k + 1] = bytes[pos + k];
+            }
+            bool decoded = this->obd_pid_decode(pid, toks, &info);
+            found++;
+            pos += len + 1;
+            if (!decoded) {
+                continue;
+            }
+
+            if (logger) {
+                if (ecu >= 0) {
+                    msg.Printf(_("Result for PID(%#.4x) from %X: %f\n"), pid, ecu, info.resultMain);
+                } else {
+                    msg.Printf(_("Result for PID(%#.4x): %f\n"), pid, info.resultMain);
+                }
+                logger->appendLog(msg, logPanel::LOG_IN);
+            }
+            if (this->useImperial) {
+                this->convertToImperial(pid, &info);
+            }
+            this->obdStoreEcuValue(ecu, pid, info);
+
+            // the first ECU answering is the result
+            if (!retrieved[j]) {
+                results[j] = info;
+                retrieved[j] = true;
+            }
+        }
+    }
+
+    return found;
+}   // elmPidRequest()
+
+/// \brief Send a command to the device
+///
+/// Remembers when a mode 01 request was sent, to measure the answer
+/// time.  Once the timing is tuned, a request whose answers fit into
+/// single CAN frames gets the number of expected answers appended, so
+/// the device returns as soon as they are in instead of waiting for
+/// its timeout.
+///
+/// \see obdbase::obdWrite()
+/// \since 0.5.2
+bool elm327::obdWrite(const wxString& command, int count)
+{
+    wxString cmd(command);
+    int payload = 1;
+    long pid;
+
+    // a timing change decided on reading the last answer; it couldn't
+    // be sent then, the caller was still using the read buffer
+    if (retune_ != 0) {
+        int retune = retune_;
+        retune_ = 0;
+        if (retune > 0) {
+            this->elmTune();
+        } else {
+            this->elmUntune();
+        }
+    }
+
+    // the answer times so far, every now and then
+    if (!latency_.empty() && monotonicus() - reported_ >= ELM_REPORT_MS * 1000ULL) {
+        this->elmReportLatency();
+    }
+
+    pendingPids_.clear();
+    pendingSingle_ = false;
+    pendingCounted_ = false;
+
+    // mode 01 requests: "01" followed by one or more pids
+    if (command.StartsWith(_T("01")) && command.length() >= 4 && command.length() % 2 == 0) {
+        for (size_t i = 2; i < command.length(); i += 2) {
+            if (!command.Mid(i, 2).ToLong(&pid, 16)) {
+                pendingPids_.clear();
+                break;
+            }
+            pid |= 0x0100;
+            pendingPids_.push_back(pid);
+            payload += obd_pid_length(pid) ? obd_pid_length(pid) + 1 : 8;
+        }
+    }
+
+    if (!pendingPids_.empty()) {
+        // a single CAN frame carries 7 bytes of data
+        pendingSingle_ = (payload <= 7);
+
+        // the response count needs version 1.3
+        if (tuned_ && pendingSingle_ && responders_ > 0 && responders_ < 16 &&
+            version_ >= 1.3 &&
+            protocol_ >= PROTO_15765_11_500 && protocol_ <= PROTO_15765_29_250) {
+            cmd += wxString::Format(_T("%X"), responders_);
+            pendingCounted_ = true;
+        }
+        requestTime_ = monotonicus();
+    }
+
+    return obdbase::obdWrite(cmd, pendingCounted_ ? cmd.length() : count);
+}
+
+/// \brief Read the answer of the device
+///
+/// \see obdbase::obdReadRaw()
+/// \since 0.5.2
+bool elm327::obdReadRaw(const char*& buf, size_t* len)
+{
+    bool prompt = obdbase::obdReadRaw(buf, len);
+
+    if (!pendingPids_.empty()) {
+        this->elmRecordLatency(buf, *len);
+    }
+
+    return prompt;
+}
+
+/// \brief How the answers show their headers
+///
+/// With headers on, the layout depends on the protocol, which is asked
+/// for if not yet known.
+///
+/// \see obdbase::obdHeaderFormat()
+/// \since 0.5.2
+obdParser::headerFormat elm327::obdHeaderFormat()
+{
+    if (headers_) {
+        this->elmIsCan();
+    }
+    return this->elmHeaderFormat();
+}
+
+/// \brief The header format for the protocol known so far
+obdParser::headerFormat elm327::elmHeaderFormat()
+{
+    if (!headers_) {
+        return obdParser::HEADERS_NONE;
+    }
+
+    switch (protocol_) {
+        case PROTO_15765_11_500:
+        case PROTO_15765_11_250:
+            return obdParser::HEADERS_CAN_11;
+        case PROTO_15765_29_500:
+        case PROTO_15765_29_250:
+            return obdParser::HEADERS_CAN_29;
+        default:
+            return obdParser::HEADERS_LEGACY;
+    }
+}
+
+/// \brief Account the answer times of a request
+///
+/// The time of an ECU runs from the request to the arrival of its last
+/// frame; the prompt only follows once the device's own timeout has run
+/// out.  Fills the histogram of each pid requested for each ECU that
+/// answered, and once enough answers are in, tunes the timing of the
+/// device to the slowest ECU.  A pid which has answered before and now
+/// times out undoes the tuning.  Either is done before the next
+/// request, see obdWrite().
+///
+/// \param[in] response The answer of the device
+/// \param[in] len Length of the answer
+void elm327::elmRecordLatency(const char* response, size_t len)
+{
+    // limits of the histogram bins in ms, the last one is open
+    static const unsigned long limits[ELM_LATENCY_BUCKETS - 1] = {
+        5, 10, 20, 50, 100, 200, 500
+    };
+    std::vector<int> pids;
+    obdParser parser;
+    int ecus[OBD_PARSER_MESSAGES];
+    unsigned long times[OBD_PARSER_MESSAGES];
+    int responders = 0;
+    unsigned long slowest = 0;
+    bool knownPid = false;
+
+    pids.swap(pendingPids_);
+    parser.parse(response, len, this->elmHeaderFormat());
+
+    // the last frame of each ECU, without headers all answers are one
+    for (int m = 0; m < parser.count(); m++) {
+        const obdParser::message& message = parser.get(m);
+        unsigned long long arrived = port->ArrivalTime(message.end ? message.end - 1 : 0);
+        unsigned long ms = (arrived > requestTime_) ? (unsigned long)((arrived - requestTime_) / 1000) : 0;
+        int r = 0;
+
+        while (r < responders && ecus[r] != message.ecu) {
+            r++;
+        }
+        if (r == responders) {
+            ecus[r] = message.ecu;
+            times[r] = ms;
+            responders++;
+        } else if (ms > times[r]) {
+            times[r] = ms;
+        }
+        slowest = std::max(slowest, ms);
+    }
+
+    if (responders == 0) {
+        for (size_t i = 0; i < pids.size(); i++) {
+            bool counted = false;
+            std::map<int, std::map<int, latencyStats> >::iterator ecu;
+            for (ecu = latency_.begin(); ecu != latency_.end(); ecu++) {
+                std::map<int, latencyStats>::iterator it = ecu->second.find(pids[i]);
+                if (it != ecu->second.end()) {
+                    knownPid = knownPid || it->second.count > 0;
+                    it->second.timeouts++;
+                    counted = true;
+                }
+            }
+            if (!counted) {
+                latency_[-1][pids[i]].timeouts++;
+            }
+        }
+
+        // an answer may have been cut off by a timeout set too short
+        if (tuned_ && knownPid) {
+            retune_ = -1;
+        }
+        return;
+    }
+
+    for (int r = 0; r < responders; r++) {
+        std::map<int, latencyStats>& byPid = latency_[ecus[r]];
+        int bucket = 0;
+
+        while (bucket < ELM_LATENCY_BUCKETS - 1 && times[r] >= limits[bucket]) {
+            bucket++;
+        }
+        for (size_t i = 0; i < pids.size(); i++) {
+            latencyStats& stats = byPid[pids[i]];
+            stats.buckets[bucket]++;
+            stats.count++;
+            stats.total += times[r];
+            if (times[r] > stats.max) {
+                stats.max = times[r];
+            }
+        }
+    }
+
+    if (!tuned_) {
+        // count the ECUs answering, each single frame answer is a
+        // message of its own
+        if (pendingSingle_ && !pendingCounted_) {
+            int answers = 0;
+            for (int m = parser.find(0x41); m >= 0; m = parser.find(0x41, -1, m + 1)) {
+                answers++;
+            }
+            responders_ = std::max(responders_, answers);
+        }
+
+        window_[windowCount_ % ELM_TUNE_WINDOW] = slowest;
+        windowCount_++;
+        if (windowCount_ >= ELM_TUNE_WINDOW) {
+            retune_ = 1;
+        }
+    }
+}
+
+/// \brief Set the device timing from the answer times measured
+///
+/// AT ST is the longest time the device waits for an answer, it is set
+/// to twice the slowest answer seen.  If the answer times are steady,
+/// the more aggressive adaptive timing AT AT2 is used, else AT AT1.
+void elm327::elmTune()
+{
+    unsigned long sorted[ELM_TUNE_WINDOW];
+    unsigned long median;
+    unsigned long slowest;
+    bool steady;
+    int st;
+
+    std::copy(window_, window_ + ELM_TUNE_WINDOW, sorted);
+    std::sort(sorted, sorted + ELM_TUNE_WINDOW);
+    median = sorted[ELM_TUNE_WINDOW / 2];
+    slowest = sorted[ELM_TUNE_WINDOW - 1];
+    steady = (slowest <= 2 * median);
+
+    // in units of 4 ms, at least 32 ms
+    st = (int)((2 * slowest + 8 + 3) / 4);
+    st = std::max(0x08, std::min(0xFF, st));
+
+    tuned_ = true;
+    this->elmSendAtCommand(steady ? _T("AT2") : _T("AT1"));
+    this->elmSendAtCommand(wxString::Format(_T("ST %02X"), st));
+
+    if (logger) {
+        wxString msg;
+        msg.Printf(_("Adaptive timing: median %lu ms, slowest %lu ms, using AT%d and ST %02X (%d ms), %d answers per request\n"),
+                   median, slowest, steady ? 2 : 1, st, st * 4, responders_);
+        logger->appendLog(msg, logPanel::LOG_OTHER);
+    }
+    this->elmReportLatency();
+}
+
+/// \brief Return to the default timing of the device
+///
+/// Measuring starts again and leads to a new, more careful tuning.
+void elm327::elmUntune()
+{
+    tuned_ = false;
+    windowCount_ = 0;
+    this->elmSendAtCommand(_T("AT1"));
+    this->elmSendAtCommand(wxString::Format(_T("ST %02X"), ELM_ST_DEFAULT));
+
+    if (logger) {
+        wxString msg = _("Adaptive timing: a PID timed out, back to the default timing\n");
+        logger->appendLog(msg, logPanel::LOG_ERROR);
+    }
+}
+
+/// \brief Write the answer times of each ECU and PID to the log
+///
+/// Called every ELM_REPORT_MS while requests go out, after tuning and
+/// on disconnect.
+///
+/// \since 0.5.2
+void elm327::elmReportLatency()
+{
+    static const wxChar* labels[ELM_LATENCY_BUCKETS] = {
+        _T("<5"), _T("<10"), _T("<20"), _T("<50"),
+        _T("<100"), _T("<200"), _T("<500"), _T(">=500")
+    };
+    wxMutexLocker lock(linkLock);
+    std::map<int, std::map<int, latencyStats> >::iterator ecu;
+    std::map<int, latencyStats>::iterator it;
+
+    reported_ = monotonicus();
+    if (!logger) {
+        return;
+    }
+
+    for (ecu = latency_.begin(); ecu != latency_.end(); ecu++) {
+        wxString name = (ecu->first < 0) ? wxString(_T("-")) : wxString::Format(_T("%X"), ecu->first);
+
+        for (it = ecu->second.begin(); it != ecu->second.end(); it++) {
+            const latencyStats& stats = it->second;
+            wxString msg;
+
+            msg.Printf(_("Latency ECU %s PID(%#.4x): %lu answers, mean %lu ms, max %lu ms, %lu timeouts |"),
+                       name.c_str(), it->first, stats.count,
+                       stats.count ? (unsigned long)(stats.total / stats.count) : 0UL,
+                       stats.max, stats.timeouts);
+            for (int i = 0; i < ELM_LATENCY_BUCKETS; i++) {
+                msg += wxString::Format(_T(" %s: %lu"), labels[i], stats.buckets[i]);
+            }
+            msg += _T("\n");
+            logger->appendLog(msg, logPanel::LOG_OTHER);
+        }
+    }
+}
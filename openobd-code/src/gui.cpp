@@ -48,6 +48,10 @@ obdBaseFrame::obdBaseFrame( wxWindow* parent, wxWindowID id, const wxString& tit
 	menuConnect = new wxMenuItem( m_menu5, wxID_ANY, wxString( _("&Connect to interface") ) , _("Connect to OBD-II interface"), wxITEM_NORMAL );
 	m_menu5->Append( menuConnect );
 	
+	menuRecord = new wxMenuItem( m_menu5, wxID_ANY, wxString( _("&Record session...") ) , _("Record the conversation with the OBD-II interface to a session file"), wxITEM_CHECK );
+	m_menu5->Append( menuRecord );
+	menuRecord->Enable( false );
+	
 	wxMenuItem* menuPrefs;
 	menuPrefs = new wxMenuItem( m_menu5, wxID_ANY, wxString( _("Preferences") ) , _("Change preferences"), wxITEM_NORMAL );
 	m_menu5->Append( menuPrefs );
@@ -80,6 +84,7 @@ obdBaseFrame::obdBaseFrame( wxWindow* parent, wxWindowID id, const wxString& tit
 	this->Connect( menuViewMIL->GetId(), wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuViewMIL ) );
 	this->Connect( menuViewPIDS->GetId(), wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuViewPIDs ) );
 	this->Connect( menuConnect->GetId(), wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuConnect ) );
+	this->Connect( menuRecord->GetId(), wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuRecord ) );
 	this->Connect( menuPrefs->GetId(), wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuPrefs ) );
 	this->Connect( menuAbout->GetId(), wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuAbout ) );
 }
@@ -93,6 +98,7 @@ obdBaseFrame::~obdBaseFrame()
 	this->Disconnect( wxID_ANY, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuViewMIL ) );
 	this->Disconnect( wxID_ANY, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuViewPIDs ) );
 	this->Disconnect( wxID_ANY, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuConnect ) );
+	this->Disconnect( wxID_ANY, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuRecord ) );
 	this->Disconnect( wxID_ANY, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuPrefs ) );
 	this->Disconnect( wxID_ANY, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler( obdBaseFrame::onMenuAbout ) );
 }
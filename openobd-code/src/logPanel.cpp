@@ -19,44 +19,231 @@
 
 #include "logPanel.h"
 #include <time.h>
+#include <wx/ffile.h>
+
+#define LOG_HISTORY		20000	///< messages kept for the export
+#define LOG_SHOWN		2000	///< messages the panel shows at least
+#define LOG_REPAINT_MS	200		///< the panel is repainted at most this often
+#define LOG_EXPORT_BATCH	1000	///< messages copied at once when exporting
+
+// posted to the panel when something was logged since the last repaint
+BEGIN_DECLARE_EVENT_TYPES()
+	DECLARE_LOCAL_EVENT_TYPE(wxEVT_LOG_PENDING, -1)
+END_DECLARE_EVENT_TYPES()
+DEFINE_LOCAL_EVENT_TYPE(wxEVT_LOG_PENDING)
 
 logPanel::logPanel( wxWindow* parent )
 :
-logBasePanel( parent )
+logBasePanel( parent ),
+history( LOG_HISTORY ),
+appended( 0 ),
+repaintPosted( false ),
+painted( 0 ),
+shown( 0 ),
+repaintTimer( this ),
+stampTime( 0 )
 {
+	this->Connect(wxEVT_LOG_PENDING, wxCommandEventHandler(logPanel::onLogPending));
+	this->Connect(wxEVT_TIMER, wxTimerEventHandler(logPanel::onRepaintTimer));
+}
 
+logPanel::~logPanel()
+{
+	repaintTimer.Stop();
 }
 
+/// \brief Add a message to the log
+///
+/// May be called from any thread.  The message only goes into the
+/// history, the GUI thread shows everything new in one go at most
+/// every LOG_REPAINT_MS, so logging costs the same however busy the
+/// link is.
 void logPanel::appendLog(wxString& logText, logType type)
 {
 	time_t rawtime;
-	wxString timestamp;
-	wxColour colour;
+	bool post;
 
 	time ( &rawtime );
-	wxDateTime now(rawtime);
 
-	switch (type) {
-		case LOG_IN:
-			colour.Set(_T("BLUE"));
-			break;
-		case LOG_OUT:
-			colour.Set(_T("GREEN"));
-			break;
-		case LOG_ERROR:
-			colour.Set(_T("RED"));
-			break;
-		case LOG_OTHER:
-			colour.Set(_T("BLACK"));
-			break;
+	{
+		wxCriticalSectionLocker lock(historyLock);
+		logEntry& entry = history[appended % LOG_HISTORY];
+
+		// a deep copy, the string must not share memory with the caller
+		entry.text = wxString(logText.c_str());
+		entry.type = type;
+		entry.time = rawtime;
+		appended++;
+
+		post = !repaintPosted;
+		repaintPosted = true;
+	}
+
+	// one event is enough for everything logged until the repaint
+	if (post) {
+		wxCommandEvent event(wxEVT_LOG_PENDING);
+		this->AddPendingEvent(event);
+	}
+}
+
+void logPanel::onLogPending( wxCommandEvent& WXUNUSED(event) )
+{
+	if (!repaintTimer.IsRunning()) {
+		repaintTimer.Start(LOG_REPAINT_MS, wxTIMER_ONE_SHOT);
 	}
-	timestamp = now.Format(_T("[%c] "));
-	m_richText1->BeginTextColour(colour);
-	m_richText1->AppendText(timestamp + logText);
 }
 
-void logPanel::SaveFile(wxString& path)
+void logPanel::onRepaintTimer( wxTimerEvent& WXUNUSED(event) )
 {
-	m_richText1->SaveFile(path, wxRICHTEXT_TYPE_TEXT);
+	this->repaint();
 }
 
+/// \brief Copy messages out of the history
+///
+/// The caller holds historyLock.  Messages already overwritten are
+/// skipped.
+///
+/// \param[in] from The number of the first message
+/// \param[in] to The number of the message after the last one
+/// \param[out] entries The copies are appended here
+/// \return The number of the message after the last one copied
+unsigned long logPanel::copyHistory(unsigned long from, unsigned long to,
+									std::vector<logEntry>& entries)
+{
+	if (appended > LOG_HISTORY && from < appended - LOG_HISTORY) {
+		from = appended - LOG_HISTORY;
+	}
+	for (; from < to; from++) {
+		const logEntry& entry = history[from % LOG_HISTORY];
+		logEntry copy;
+
+		// deep copies again, the slot is reused by other threads
+		copy.text = wxString(entry.text.c_str());
+		copy.type = entry.type;
+		copy.time = entry.time;
+		entries.push_back(copy);
+	}
+	return from;
+}
+
+/// \brief Show the messages logged since the last repaint
+///
+/// Messages of the same kind are added with one AppendText call.  The
+/// panel keeps between LOG_SHOWN and twice as many messages; when it is
+/// full it is cleared and refilled with the newest LOG_SHOWN.
+void logPanel::repaint()
+{
+	std::vector<logEntry> entries;
+	bool refill = false;
+
+	{
+		wxCriticalSectionLocker lock(historyLock);
+		unsigned long from = painted;
+
+		if (shown + (appended - painted) > 2 * LOG_SHOWN) {
+			refill = true;
+			from = (appended > LOG_SHOWN) ? appended - LOG_SHOWN : 0;
+		}
+		this->copyHistory(from, appended, entries);
+		painted = appended;
+		repaintPosted = false;
+	}
+
+	if (entries.empty()) {
+		return;
+	}
+
+	m_richText1->Freeze();
+	if (refill) {
+		m_richText1->Clear();
+		shown = 0;
+	}
+
+	wxString chunk;
+	for (size_t i = 0; i < entries.size(); i++) {
+		chunk += this->timestamp(entries[i].time) + entries[i].text;
+		if (i + 1 < entries.size() && entries[i + 1].type == entries[i].type) {
+			continue;
+		}
+
+		wxColour colour;
+		switch (entries[i].type) {
+			case LOG_IN:
+				colour.Set(_T("BLUE"));
+				break;
+			case LOG_OUT:
+				colour.Set(_T("GREEN"));
+				break;
+			case LOG_ERROR:
+				colour.Set(_T("RED"));
+				break;
+			case LOG_OTHER:
+				colour.Set(_T("BLACK"));
+				break;
+		}
+		m_richText1->BeginTextColour(colour);
+		m_richText1->AppendText(chunk);
+		m_richText1->EndTextColour();
+		chunk.Empty();
+	}
+	shown += entries.size();
+
+	m_richText1->Thaw();
+	m_richText1->ShowPosition(m_richText1->GetLastPosition());
+}
+
+/// \brief The timestamp of a message
+///
+/// Formatting is slow, so the last one is kept; a busy link logs many
+/// messages within the same second.
+const wxString& logPanel::timestamp(time_t rawtime)
+{
+	if (stamp.empty() || rawtime != stampTime) {
+		wxDateTime when(rawtime);
+
+		stampTime = rawtime;
+		stamp = when.Format(_T("[%c] "));
+	}
+	return stamp;
+}
+
+/// \brief Write the log history to a text file
+///
+/// Everything still in the history is written, not just what the panel
+/// shows.  The history is copied in batches, so the other threads can
+/// go on logging meanwhile; what they log after the export started is
+/// left out.
+///
+/// \param[in] path The file
+/// \return False if the file can't be written
+bool logPanel::SaveFile(wxString& path)
+{
+	std::vector<logEntry> entries;
+	unsigned long next = 0;
+	unsigned long end;
+	wxFFile file(path, _T("w"));
+
+	if (!file.IsOpened()) {
+		return false;
+	}
+
+	{
+		wxCriticalSectionLocker lock(historyLock);
+		end = appended;
+	}
+
+	while (next < end) {
+		{
+			wxCriticalSectionLocker lock(historyLock);
+			unsigned long to = (end - next > LOG_EXPORT_BATCH) ? next + LOG_EXPORT_BATCH : end;
+			next = this->copyHistory(next, to, entries);
+		}
+		for (size_t i = 0; i < entries.size(); i++) {
+			if (!file.Write(this->timestamp(entries[i].time) + entries[i].text, wxConvUTF8)) {
+				return false;
+			}
+		}
+		entries.clear();
+	}
+	return file.Close();
+}
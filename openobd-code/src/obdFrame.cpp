@@ -88,11 +88,20 @@ obdBaseFrame( parent )
         wxMessageDialog dialog(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
         dialog.ShowModal();
         sqlite3_close(db);
+        db = NULL;
+    }
+
+    // formulas of PIDs beyond the built in ones
+    obdPidRegistry::get().load_db(db);
+    wxFileName dbcName( wxStandardPaths::Get().GetUserDataDir(), _T("openobd"), _T("dbc"));
+    if (dbcName.FileExists()) {
+        obdPidRegistry::get().load_dbc(dbcName.GetFullPath().mb_str());
     }
 
 	// setup the options
 	wxConfigBase *pConfig = wxConfigBase::Get();
 	options.imperial = pConfig->Read(_T("/Options/Imperial"), 0l);
+	options.headers = pConfig->Read(_T("/Options/Headers"), 0l);
 #if defined (WIN32)
 	options.port = pConfig->Read(_T("/Options/Port"), _T("COM1"));
 #else
@@ -107,12 +116,16 @@ obdBaseFrame( parent )
 
 obdFrame::~obdFrame()
 {
+   // while the log is still there, e.g. for the answer times of elm327
+   if (obd->obd_is_connected()) {
+       obd->obdDeviceDisconnect();
+   }
    sqlite3_close(db);
 }
 
 void obdFrame::onMenuExport( wxCommandEvent& WXUNUSED(event) )
 {
-	wxString filter = wxRichTextBuffer::GetExtWildcard(false, true);
+	wxString filter(_("Text files (*.txt)|*.txt|All files (*)|*"));
     wxString path;
     wxString filename;
 
@@ -129,9 +142,12 @@ void obdFrame::onMenuExport( wxCommandEvent& WXUNUSED(event) )
     {
         wxString path = dialog.GetPath();
 
-        if (!path.empty())
+        if (!path.empty() && !log->SaveFile(path))
         {
-			log->SaveFile(path);
+            wxString msg;
+            msg.Printf(_("Cannot write the log to %s"), path.c_str());
+            wxMessageDialog error(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
+            error.ShowModal();
         }
     }
 }
@@ -200,12 +216,17 @@ bool obdFrame::connectDevice()
     if (elm->obd_is_connected()) {
 		obd = elm;
 		obd->obd_set_logger (log);
+		obd->obd_set_database (db);
 		this->updateMenus(true);
 		logText.Printf(_("Connected to device on %s\n"), options.port.c_str());
         log->appendLog(logText, type);
 
+        // a faster link, now that the outcome shows in the log
+        elm->elmNegotiateBaudrate();
+
         // restore our imperial preferences
 		obd->obd_use_imperial(options.imperial);
+		obd->obd_use_headers(options.headers);
 
 		retVal = true;
     } else {
@@ -256,6 +277,43 @@ void obdFrame::onMenuConnect( wxCommandEvent& WXUNUSED(event) )
 	}
 }
 
+/// \brief Start or stop recording the session to a file
+///
+/// The file can be played back with obdreplay.
+void obdFrame::onMenuRecord( wxCommandEvent& WXUNUSED(event) )
+{
+	wxString filter(_("Session files (*.session)|*.session|All files (*)|*"));
+	wxString msg;
+
+	if (obd->obd_is_recording()) {
+		if (!obd->obd_stop_recording()) {
+			msg = _("The session file is incomplete, not everything could be written");
+			wxMessageDialog error(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
+			error.ShowModal();
+		}
+		menuRecord->Check(false);
+		return;
+	}
+
+	wxFileDialog dialog(this,
+		_("Record the session to"),
+		wxEmptyString,
+		wxEmptyString,
+		filter,
+		wxFD_SAVE | wxOVERWRITE_PROMPT);
+
+	if (dialog.ShowModal() == wxID_OK && !dialog.GetPath().empty()) {
+		wxString path = dialog.GetPath();
+
+		if (!obd->obd_start_recording(path)) {
+			msg.Printf(_("Cannot record the session to %s"), path.c_str());
+			wxMessageDialog error(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
+			error.ShowModal();
+		}
+	}
+	menuRecord->Check(obd->obd_is_recording());
+}
+
 void obdFrame::onMenuPrefs( wxCommandEvent& WXUNUSED(event) )
 {
 	dlgOptions* dlg = new dlgOptions (this, obd, &options);
@@ -320,6 +378,10 @@ void obdFrame::updateMenus(bool connected)
 		statusText = _("Not connected");
     }
 
+    // a recording ends with the connection
+    menuRecord->Enable(connected);
+    menuRecord->Check(connected && obd->obd_is_recording());
+
     // mil panel
     menuViewMIL->Enable(menuViewMIL->IsChecked() || connected);
 
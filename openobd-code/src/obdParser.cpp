@@ -0,0 +1,370 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "obdParser.h"
+
+/// value of each character as a hex digit, 0xFF if it isn't one
+static const unsigned char hexTable[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+/// \brief Read a number of hex digits, skipping anything else
+static int read_hex (const char*& p, const char* end, int digits)
+{
+    unsigned int value = 0;
+
+    while (digits > 0 && p < end) {
+        unsigned char v = hexTable[(unsigned char)*p++];
+        if (v != 0xFF) {
+            value = value * 16 + v;
+            digits--;
+        }
+    }
+    return (int)(value & 0x7FFFFFFF);
+}
+
+static bool starts_with (const char* p, const char* end, const char* text)
+{
+    size_t len = strlen(text);
+    return (size_t)(end - p) >= len && memcmp(p, text, len) == 0;
+}
+
+obdParser::obdParser ()
+{
+    used_ = 0;
+    count_ = 0;
+    pending_ = -1;
+    lineEnd_ = 0;
+    status_ = STATUS_OK;
+}
+
+/// \brief Parse the answer of the device
+///
+/// \param[in] buf The answer, without the prompt
+/// \param[in] len Length of the answer
+/// \param[in] format How the headers are shown
+/// \return The number of messages found
+/// \since 0.5.2
+int obdParser::parse (const char* buf, size_t len, obdParser::headerFormat format)
+{
+    const char* p = buf;
+    const char* end = buf + len;
+
+    used_ = 0;
+    count_ = 0;
+    pending_ = -1;
+    status_ = STATUS_OK;
+
+    while (p < end) {
+        const char* eol = p;
+        while (eol < end && *eol != '\r' && *eol != '\n') {
+            eol++;
+        }
+        lineEnd_ = eol - buf;
+        this->parse_line(p, eol, format);
+        p = eol + 1;
+    }
+
+    return count_;
+}
+
+/// \brief Number of messages of the last answer parsed
+int obdParser::count () const
+{
+    return count_;
+}
+
+/// \brief What the device said besides the data
+obdParser::status obdParser::result () const
+{
+    return status_;
+}
+
+const obdParser::message& obdParser::get (int index) const
+{
+    return messages_[index];
+}
+
+/// \brief The bytes of a message
+const unsigned char* obdParser::data (int index) const
+{
+    return data_ + messages_[index].offset;
+}
+
+/// \brief Check all bytes announced for a message have arrived
+bool obdParser::complete (int index) const
+{
+    return messages_[index].length == messages_[index].expected;
+}
+
+/// \brief Find the answer to a request
+///
+/// \param[in] service The service byte expected, the mode + 0x40
+/// \param[in] pid The pid byte expected, -1 for requests without one
+/// \param[in] from Index of the first message to look at
+/// \return The index of the message, -1 if none matches
+/// \since 0.5.2
+int obdParser::find (int service, int pid, int from) const
+{
+    for (int i = from; i < count_; i++) {
+        const message& m = messages_[i];
+        const unsigned char* bytes = data_ + m.offset;
+
+        if (m.length >= (pid < 0 ? 1 : 2) && bytes[0] == service &&
+            (pid < 0 || bytes[1] == pid)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/// \brief Value of a hex digit
+///
+/// \return 0 to 15, -1 if the character isn't a hex digit
+int obdParser::hex_value (char c)
+{
+    unsigned char v = hexTable[(unsigned char)c];
+    return (v == 0xFF) ? -1 : v;
+}
+
+void obdParser::parse_line (const char* p, const char* end, obdParser::headerFormat format)
+{
+    const char* colon = NULL;
+    size_t digits = 0;
+    size_t bytes;
+    int index;
+
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    while (end > p && end[-1] == ' ') {
+        end--;
+    }
+    if (p == end) {
+        return;
+    }
+
+    // a line of hex digits and spaces is data, anything else is text;
+    // without headers a frame number may lead the line
+    for (const char* q = p; q < end; q++) {
+        if (hexTable[(unsigned char)*q] != 0xFF) {
+            digits++;
+        } else if (*q == ':' && !colon && format == HEADERS_NONE) {
+            colon = q;
+        } else if (*q != ' ') {
+            this->parse_text(p, end);
+            return;
+        }
+    }
+
+    if (format == HEADERS_NONE) {
+        if (colon) {
+            // "n: data" continues the message announced by the byte count
+            if (colon - p != 1 || (digits - 1) % 2) {
+                status_ = STATUS_ERROR;
+                return;
+            }
+            int frame = hexTable[(unsigned char)*p];
+            bytes = (digits - 1) / 2;
+            index = pending_;
+            if (index < 0) {
+                index = pending_ = this->add_message(-1, bytes);
+            }
+            if (index >= 0 && frame != messages_[index].sequence) {
+                // a frame is missing, the message can't be completed
+                pending_ = -1;
+                return;
+            }
+            p = colon + 1;
+            this->append(index, p, end, bytes);
+            if (index >= 0) {
+                messages_[index].sequence = (frame + 1) & 0x0F;
+            }
+            return;
+        }
+        if (digits == 3) {
+            // the byte count of a multi frame message
+            pending_ = this->add_message(-1, read_hex(p, end, 3));
+            return;
+        }
+        if (digits % 2) {
+            status_ = STATUS_ERROR;
+            return;
+        }
+        pending_ = -1;
+        bytes = digits / 2;
+        this->append(this->add_message(-1, bytes), p, end, bytes);
+        return;
+    }
+
+    if (format == HEADERS_LEGACY) {
+        // three header bytes, the data and the checksum
+        if (digits < 8 || digits % 2) {
+            status_ = STATUS_ERROR;
+            return;
+        }
+        read_hex(p, end, 4);
+        int ecu = read_hex(p, end, 2);
+        bytes = digits / 2 - 4;
+        this->append(this->add_message(ecu, bytes), p, end, bytes);
+        return;
+    }
+
+    // CAN: the id, then the ISO 15765 protocol control byte
+    size_t idDigits = (format == HEADERS_CAN_11) ? 3 : 8;
+    if (digits < idDigits + 2 || (digits - idDigits) % 2) {
+        status_ = STATUS_ERROR;
+        return;
+    }
+    int ecu = read_hex(p, end, (int)idDigits);
+    int pci = read_hex(p, end, 2);
+    bytes = (digits - idDigits) / 2 - 1;
+
+    switch (pci >> 4) {
+        case 0: {
+            // single frame
+            size_t length = pci & 0x0F;
+            this->append(this->add_message(ecu, length), p, end,
+                         bytes < length ? bytes : length);
+            break;
+        }
+        case 1: {
+            // first frame, twelve bits of length
+            if (bytes < 1) {
+                status_ = STATUS_ERROR;
+                break;
+            }
+            size_t length = ((pci & 0x0F) << 8) | read_hex(p, end, 2);
+            bytes--;
+            index = this->add_message(ecu, length);
+            this->append(index, p, end, bytes < length ? bytes : length);
+            if (index >= 0) {
+                messages_[index].sequence = 1;
+            }
+            break;
+        }
+        case 2: {
+            // consecutive frame of a message of the same ECU
+            index = this->open_message(ecu);
+            if (index < 0 || (pci & 0x0F) != messages_[index].sequence) {
+                break;
+            }
+            size_t left = messages_[index].expected - messages_[index].length;
+            this->append(index, p, end, bytes < left ? bytes : left);
+            messages_[index].sequence = (messages_[index].sequence + 1) & 0x0F;
+            break;
+        }
+        default:
+            // flow control, the device deals with it
+            break;
+    }
+}
+
+void obdParser::parse_text (const char* p, const char* end)
+{
+    if (starts_with(p, end, "NO DATA")) {
+        if (status_ == STATUS_OK) {
+            status_ = STATUS_NO_DATA;
+        }
+        return;
+    }
+
+    // progress reports of the protocol search
+    if (starts_with(p, end, "SEARCHING")) {
+        return;
+    }
+    if (starts_with(p, end, "BUS INIT") && end[-1] == 'K') {
+        return;
+    }
+
+    status_ = STATUS_ERROR;
+}
+
+/// \brief Start a message and reserve room for its bytes
+///
+/// \return The index of the message, -1 if there is no room left
+int obdParser::add_message (int ecu, size_t expected)
+{
+    if (count_ == OBD_PARSER_MESSAGES) {
+        return -1;
+    }
+
+    message& m = messages_[count_];
+    m.ecu = ecu;
+    m.offset = (unsigned short)used_;
+    m.length = 0;
+    m.expected = (unsigned short)expected;
+    m.sequence = 0;
+    m.end = (unsigned int)lineEnd_;
+
+    // a message cut short stays incomplete
+    if (expected > OBD_PARSER_BYTES - used_) {
+        expected = OBD_PARSER_BYTES - used_;
+    }
+    used_ += expected;
+
+    return count_++;
+}
+
+/// \brief Decode bytes into the room of a message
+///
+/// Bytes beyond the room reserved are skipped.
+void obdParser::append (int index, const char*& p, const char* end, size_t bytes)
+{
+    if (index < 0) {
+        return;
+    }
+
+    message& m = messages_[index];
+    m.end = (unsigned int)lineEnd_;
+    size_t room = ((index + 1 < count_) ? messages_[index + 1].offset : used_) - m.offset;
+    unsigned char* out = data_ + m.offset;
+
+    for (size_t i = 0; i < bytes && m.length < room; i++) {
+        out[m.length++] = (unsigned char)read_hex(p, end, 2);
+    }
+}
+
+/// \brief The message of an ECU still waiting for frames
+int obdParser::open_message (int ecu) const
+{
+    for (int i = count_ - 1; i >= 0; i--) {
+        if (messages_[i].ecu == ecu) {
+            return (messages_[i].length < messages_[i].expected) ? i : -1;
+        }
+    }
+    return -1;
+}
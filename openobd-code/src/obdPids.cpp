@@ -0,0 +1,659 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \file obdPids.cpp
+/// \brief What the PIDs mean: data length, formula and units.
+///
+/// Every PID with a numeric value is decoded by the same kernel,
+/// obd_pid_field(), from its descriptor.  The built in descriptors are
+/// checked against reference answers at compile time, see the end of
+/// this file.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sqlite3.h>
+
+#include "obdPids.h"
+
+#define DEG         "\xc2\xb0"      // degree sign, UTF-8
+
+#define NO_FIELD    { 0, 0, false, 0, 0 }
+
+// conversion of the main value to imperial: scale, offset and units
+#define TO_F        1.8, 32, DEG "F"
+#define TO_MPH      0.6213712, 0, "mph"
+#define TO_MILES    0.6213712, 0, "miles"
+#define TO_PSI      0.1450377, 0, "psi"
+#define TO_INHG     0.2952998, 0, "inHg"
+#define PA_TO_INH2O 0.0040146309, 0, "inH2O"
+#define KPA_TO_INH2O 4.0146309, 0, "inH2O"
+#define TO_LBMIN    0.1322760, 0, "lb/min"
+#define TO_GALH     0.2641720, 0, "gal/h"
+
+/// a PID whose bytes aren't a value, e.g. bit fields
+#define PID_RAW(pid, bytes) \
+    { pid, bytes, PID_KIND_RAW, NO_FIELD, NO_FIELD, 1, 0, "", "" }
+/// a PID decoded to text by obdbase
+#define PID_TEXT(pid, bytes) \
+    { pid, bytes, PID_KIND_STRING, NO_FIELD, NO_FIELD, 1, 0, "", "" }
+/// all bytes make one unsigned value, the same in imperial
+#define PID_VALUE(pid, bytes, scale, offset, units) \
+    { pid, bytes, PID_KIND_VALUE, { 0, bytes, false, scale, offset }, NO_FIELD, 1, 0, units, units }
+/// all bytes make one unsigned value, converted for imperial
+#define PID_IMPERIAL(pid, bytes, scale, offset, units, imperial) \
+    { pid, bytes, PID_KIND_VALUE, { 0, bytes, false, scale, offset }, NO_FIELD, imperial, units }
+/// all bytes make one signed value, converted for imperial
+#define PID_SIGNED(pid, bytes, scale, offset, units, imperial) \
+    { pid, bytes, PID_KIND_VALUE, { 0, bytes, true, scale, offset }, NO_FIELD, imperial, units }
+/// two values, neither converted
+#define PID_DOUBLE(pid, bytes, main, secondary, units) \
+    { pid, bytes, PID_KIND_DOUBLE, main, secondary, 1, 0, units, units }
+
+// the fields of the oxygen sensor PIDs
+#define O2_VOLTS    { 0, 1, false, 0.005, 0 }
+#define O2_TRIM     { 1, 1, false, 100.0 / 128, -100 }
+#define WR_RATIO    { 0, 2, false, 2.0 / 65536, 0 }
+#define WR_VOLTS    { 2, 2, false, 8.0 / 65536, 0 }
+#define WR_MA       { 2, 2, false, 1.0 / 256, -128 }
+#define TRIM_A      { 0, 1, false, 100.0 / 128, -100 }
+
+/// SAE J1979 mode 01 PIDs 0x00 - 0x5F and the VIN, sorted by pid
+constexpr pidDescriptor builtinPids[] = {
+    PID_RAW      (0x0100, 4),                                           // supported 01 - 20
+    PID_RAW      (PID_DTC_STATUS, 4),
+    PID_RAW      (PID_DTCFRZF, 2),
+    PID_RAW      (PID_FUELSYS, 2),
+    PID_VALUE    (PID_LOAD_PCT, 1, 100.0 / 255, 0, "%"),
+    PID_IMPERIAL (PID_ECT, 1, 1, -40, DEG "C", TO_F),
+    PID_VALUE    (PID_BANK1_STFT, 1, 100.0 / 128, -100, "%"),
+    PID_VALUE    (PID_BANK1_LTFT, 1, 100.0 / 128, -100, "%"),
+    PID_VALUE    (PID_BANK2_STFT, 1, 100.0 / 128, -100, "%"),
+    PID_VALUE    (PID_BANK2_LTFT, 1, 100.0 / 128, -100, "%"),
+    PID_IMPERIAL (PID_FRP, 1, 3, 0, "kPa", TO_PSI),
+    PID_IMPERIAL (PID_MAP, 1, 1, 0, "kPa", TO_INHG),
+    PID_VALUE    (PID_RPM, 2, 0.25, 0, "rpm"),
+    PID_IMPERIAL (PID_VSS, 1, 1, 0, "kph", TO_MPH),
+    PID_VALUE    (PID_SPARKADV, 1, 0.5, -64, DEG),
+    PID_IMPERIAL (PID_IAT, 1, 1, -40, DEG "C", TO_F),
+    PID_IMPERIAL (PID_MAF, 2, 0.01, 0, "g/s", TO_LBMIN),
+    PID_VALUE    (PID_TP, 1, 100.0 / 255, 0, "%"),
+    PID_TEXT     (PID_AIR_STAT, 1),
+    PID_TEXT     (PID_O2SLOC, 1),
+    PID_DOUBLE   (PID_O2S11, 2, O2_VOLTS, O2_TRIM, "V"),
+    PID_DOUBLE   (PID_O2S12, 2, O2_VOLTS, O2_TRIM, "V"),
+    PID_DOUBLE   (PID_O2S13, 2, O2_VOLTS, O2_TRIM, "V"),
+    PID_DOUBLE   (PID_O2S14, 2, O2_VOLTS, O2_TRIM, "V"),
+    PID_DOUBLE   (PID_O2S21, 2, O2_VOLTS, O2_TRIM, "V"),
+    PID_DOUBLE   (PID_O2S22, 2, O2_VOLTS, O2_TRIM, "V"),
+    PID_DOUBLE   (PID_O2S23, 2, O2_VOLTS, O2_TRIM, "V"),
+    PID_DOUBLE   (PID_O2S24, 2, O2_VOLTS, O2_TRIM, "V"),
+    PID_TEXT     (PID_OBDSUP, 1),
+    PID_RAW      (0x011D, 1),                                           // oxygen sensors present
+    PID_TEXT     (PID_PTO_STAT, 1),
+    PID_VALUE    (PID_RUNTM, 2, 1, 0, "s"),
+    PID_RAW      (0x0120, 4),                                           // supported 21 - 40
+    PID_IMPERIAL (PID_MIL_DIST, 2, 1, 0, "km", TO_MILES),
+    PID_IMPERIAL (PID_FRP_REL, 2, 0.079, 0, "kPa", TO_PSI),
+    PID_IMPERIAL (PID_FRP_ATMO, 2, 10, 0, "kPa", TO_PSI),
+    PID_DOUBLE   (0x0124, 4, WR_RATIO, WR_VOLTS, ""),                   // wide range lambda
+    PID_DOUBLE   (0x0125, 4, WR_RATIO, WR_VOLTS, ""),
+    PID_DOUBLE   (0x0126, 4, WR_RATIO, WR_VOLTS, ""),
+    PID_DOUBLE   (0x0127, 4, WR_RATIO, WR_VOLTS, ""),
+    PID_DOUBLE   (0x0128, 4, WR_RATIO, WR_VOLTS, ""),
+    PID_DOUBLE   (0x0129, 4, WR_RATIO, WR_VOLTS, ""),
+    PID_DOUBLE   (0x012A, 4, WR_RATIO, WR_VOLTS, ""),
+    PID_DOUBLE   (0x012B, 4, WR_RATIO, WR_VOLTS, ""),
+    PID_VALUE    (PID_EGR_PCT, 1, 100.0 / 255, 0, "%"),
+    PID_VALUE    (PID_EGR_ERR, 1, 100.0 / 128, -100, "%"),
+    PID_VALUE    (PID_EVAP_PCT, 1, 100.0 / 255, 0, "%"),
+    PID_VALUE    (PID_FLI, 1, 100.0 / 255, 0, "%"),
+    PID_VALUE    (PID_WARM_UPS, 1, 1, 0, ""),
+    PID_IMPERIAL (PID_CLR_DIST, 2, 1, 0, "km", TO_MILES),
+    PID_SIGNED   (PID_EVAP_VP, 2, 0.25, 0, "Pa", PA_TO_INH2O),
+    PID_IMPERIAL (PID_BARO, 1, 1, 0, "kPa", TO_INHG),
+    PID_DOUBLE   (0x0134, 4, WR_RATIO, WR_MA, ""),                      // wide range lambda
+    PID_DOUBLE   (0x0135, 4, WR_RATIO, WR_MA, ""),
+    PID_DOUBLE   (0x0136, 4, WR_RATIO, WR_MA, ""),
+    PID_DOUBLE   (0x0137, 4, WR_RATIO, WR_MA, ""),
+    PID_DOUBLE   (0x0138, 4, WR_RATIO, WR_MA, ""),
+    PID_DOUBLE   (0x0139, 4, WR_RATIO, WR_MA, ""),
+    PID_DOUBLE   (0x013A, 4, WR_RATIO, WR_MA, ""),
+    PID_DOUBLE   (0x013B, 4, WR_RATIO, WR_MA, ""),
+    PID_IMPERIAL (PID_CATEMP11, 2, 0.1, -40, DEG "C", TO_F),
+    PID_IMPERIAL (PID_CATEMP21, 2, 0.1, -40, DEG "C", TO_F),
+    PID_IMPERIAL (PID_CATEMP12, 2, 0.1, -40, DEG "C", TO_F),
+    PID_IMPERIAL (PID_CATEMP22, 2, 0.1, -40, DEG "C", TO_F),
+    PID_RAW      (0x0140, 4),                                           // supported 41 - 60
+    PID_RAW      (0x0141, 4),                                           // monitor status this cycle
+    PID_VALUE    (PID_VPWR, 2, 0.001, 0, "V"),
+    PID_VALUE    (PID_LOAD_ABS, 2, 100.0 / 255, 0, "%"),
+    PID_VALUE    (PID_EQ_RAT, 2, 1.0 / 32768, 0, ""),
+    PID_VALUE    (PID_TP_R, 1, 100.0 / 255, 0, "%"),
+    PID_IMPERIAL (PID_AAT, 1, 1, -40, DEG "C", TO_F),
+    PID_VALUE    (PID_TP_B, 1, 100.0 / 255, 0, "%"),
+    PID_VALUE    (PID_TP_C, 1, 100.0 / 255, 0, "%"),
+    PID_VALUE    (PID_APP_D, 1, 100.0 / 255, 0, "%"),
+    PID_VALUE    (PID_APP_E, 1, 100.0 / 255, 0, "%"),
+    PID_VALUE    (PID_APP_F, 1, 100.0 / 255, 0, "%"),
+    PID_VALUE    (PID_TAC_PCT, 1, 100.0 / 255, 0, "%"),
+    PID_VALUE    (PID_MIL_TIME, 2, 1, 0, "min"),
+    PID_VALUE    (PID_CLR_TIME, 2, 1, 0, "min"),
+    PID_RAW      (0x014F, 4),                                           // maximum values
+    PID_RAW      (0x0150, 4),                                           // maximum air flow rate
+    PID_TEXT     (PID_FUEL_TYP, 1),
+    PID_VALUE    (PID_ALCH_PCT, 1, 100.0 / 255, 0, "%"),
+    PID_IMPERIAL (PID_EVAP_VPA, 2, 0.005, 0, "kPa", KPA_TO_INH2O),
+    PID_SIGNED   (PID_EVAP_OTHER, 2, 1, 0, "Pa", PA_TO_INH2O),
+    PID_DOUBLE   (0x0155, 2, TRIM_A, O2_TRIM, "%"),                    // secondary oxygen sensor trims
+    PID_DOUBLE   (0x0156, 2, TRIM_A, O2_TRIM, "%"),
+    PID_DOUBLE   (0x0157, 2, TRIM_A, O2_TRIM, "%"),
+    PID_DOUBLE   (0x0158, 2, TRIM_A, O2_TRIM, "%"),
+    PID_IMPERIAL (PID_FRP_ABS, 2, 10, 0, "kPa", TO_PSI),
+    PID_VALUE    (PID_APP_R, 1, 100.0 / 255, 0, "%"),
+    PID_VALUE    (0x015B, 1, 100.0 / 255, 0, "%"),                      // hybrid battery remaining
+    PID_IMPERIAL (0x015C, 1, 1, -40, DEG "C", TO_F),                    // engine oil temperature
+    PID_VALUE    (0x015D, 2, 1.0 / 128, -210, DEG),                     // fuel injection timing
+    PID_IMPERIAL (0x015E, 2, 0.05, 0, "L/h", TO_GALH),                  // engine fuel rate
+    PID_RAW      (0x015F, 1),                                           // emission requirements
+    PID_TEXT     (PID_VIN, 0),
+};
+
+static const int builtinCount = sizeof(builtinPids) / sizeof(builtinPids[0]);
+
+obdPidRegistry::obdPidRegistry ()
+{
+    for (int i = 0; i < 256; i++) {
+        mode01_[i] = NULL;
+    }
+    for (int i = 0; i < builtinCount; i++) {
+        this->set(&builtinPids[i]);
+    }
+}
+
+/// \brief The registry used by the devices
+obdPidRegistry& obdPidRegistry::get ()
+{
+    static obdPidRegistry registry;
+    return registry;
+}
+
+/// \brief Get the descriptor of a PID
+///
+/// \param[in] pid The pid, including the mode (e.g. 0x010C)
+/// \return The descriptor, NULL for an unknown pid
+const pidDescriptor* obdPidRegistry::find (int pid) const
+{
+    if ((pid & ~0xFF) == 0x0100) {
+        return mode01_[pid & 0xFF];
+    }
+
+    std::map<int, const pidDescriptor*>::const_iterator it = others_.find(pid);
+    return (it == others_.end()) ? NULL : it->second;
+}
+
+/// \brief Add a PID or replace the descriptor of a known one
+///
+/// The descriptor and its units are copied.
+///
+/// \param[in] descriptor The new descriptor
+/// \return False if the fields don't fit into the data bytes
+bool obdPidRegistry::add (const pidDescriptor& descriptor)
+{
+    switch (descriptor.kind) {
+        case PID_KIND_DOUBLE:
+            if (!fits(descriptor.secondary, descriptor.bytes)) {
+                return false;
+            }
+            // fall through
+        case PID_KIND_VALUE:
+            if (!fits(descriptor.main, descriptor.bytes)) {
+                return false;
+            }
+            break;
+        case PID_KIND_RAW:
+        case PID_KIND_STRING:
+            break;
+        default:
+            return false;
+    }
+
+    added_.push_back(descriptor);
+    pidDescriptor& copy = added_.back();
+    copy.units = this->keep(descriptor.units);
+    copy.unitsImperial = this->keep(descriptor.unitsImperial);
+    this->set(&copy);
+    return true;
+}
+
+/// \brief Add the PIDs described in the database
+///
+/// Reads the table pid_formulas, if there is one: a single value per
+/// pid, columns pid ('0x0162'), bytes, first, size, signed, scale,
+/// offset, units, imperial_scale, imperial_offset and units_imperial.
+/// Without the imperial columns the value isn't converted.
+///
+/// \param[in] db The open database
+/// \return The number of pids added
+int obdPidRegistry::load_db (sqlite3* db)
+{
+    const char* sql = "SELECT pid, bytes, first, size, signed, scale, offset, units, "
+                      "imperial_scale, imperial_offset, units_imperial FROM pid_formulas";
+    sqlite3_stmt* stmt;
+    int added = 0;
+
+    if (!db || sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* pid = (const char*)sqlite3_column_text(stmt, 0);
+        const char* units = (const char*)sqlite3_column_text(stmt, 7);
+        const char* unitsImperial = (const char*)sqlite3_column_text(stmt, 10);
+        pidDescriptor d;
+
+        if (!pid) {
+            continue;
+        }
+        d.pid = strtol(pid, NULL, 16);
+        d.bytes = sqlite3_column_int(stmt, 1);
+        d.kind = PID_KIND_VALUE;
+        d.main.first = sqlite3_column_int(stmt, 2);
+        d.main.size = sqlite3_column_int(stmt, 3);
+        d.main.isSigned = sqlite3_column_int(stmt, 4) != 0;
+        d.main.scale = sqlite3_column_double(stmt, 5);
+        d.main.offset = sqlite3_column_double(stmt, 6);
+        d.secondary = pidField();
+        d.units = units ? units : "";
+        if (sqlite3_column_type(stmt, 8) == SQLITE_NULL) {
+            d.imperialScale = 1;
+            d.imperialOffset = 0;
+            d.unitsImperial = d.units;
+        } else {
+            d.imperialScale = sqlite3_column_double(stmt, 8);
+            d.imperialOffset = sqlite3_column_double(stmt, 9);
+            d.unitsImperial = unitsImperial ? unitsImperial : "";
+        }
+
+        if (this->add(d)) {
+            added++;
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    return added;
+}
+
+/// \brief Add the PIDs described in a DBC file
+///
+/// Uses the multiplexed signals whose multiplexer value is a mode 01
+/// pid, laid out like the answer on the bus: length, 0x41, pid and the
+/// data bytes.  Only byte aligned signals of up to four bytes are
+/// understood, big endian (@0) or single bytes (@1).  A pid with two
+/// signals gets both values, the first one as the main value.
+///
+///	SG_ EngineRPM m12 : 31|16@0+ (0.25,0) [0|16383.75] "rpm" Vector__XXX
+///
+/// \param[in] path The DBC file
+/// \return The number of pids added, -1 if the file can't be read
+int obdPidRegistry::load_dbc (const char* path)
+{
+    std::map<int, pidDescriptor> found;
+    std::map<int, std::string> units;
+    char line[512];
+    int added = 0;
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char name[128];
+        char mux[16];
+        char unit[64] = "";
+        char sign;
+        int start, length, order;
+        double scale, offset, min, max;
+
+        int n = sscanf(line, " SG_ %127s %15s : %d|%d@%d%c (%lf,%lf) [%lf|%lf] \"%63[^\"]\"",
+                       name, mux, &start, &length, &order, &sign, &scale, &offset,
+                       &min, &max, unit);
+        if (n < 10 || mux[0] != 'm' || !isdigit((unsigned char)mux[1])) {
+            continue;
+        }
+
+        // the byte the signal starts in, the most significant one
+        int byte;
+        if (order == 0 && start % 8 == 7 && length % 8 == 0) {
+            byte = start / 8;
+        } else if (order == 1 && start % 8 == 0 && length == 8) {
+            byte = start / 8;
+        } else {
+            continue;
+        }
+
+        int value = atoi(mux + 1);
+        if (value > 0xFF || byte < 3 || length > 32) {
+            continue;
+        }
+
+        pidField field;
+        field.first = byte - 3;
+        field.size = length / 8;
+        field.isSigned = (sign == '-');
+        field.scale = scale;
+        field.offset = offset;
+
+        int pid = 0x0100 | value;
+        std::map<int, pidDescriptor>::iterator it = found.find(pid);
+        if (it == found.end()) {
+            pidDescriptor d;
+            d.pid = pid;
+            d.bytes = 0;
+            d.kind = PID_KIND_VALUE;
+            d.main = field;
+            d.secondary = pidField();
+            d.imperialScale = 1;
+            d.imperialOffset = 0;
+            it = found.insert(std::make_pair(pid, d)).first;
+            units[pid] = unit;
+        } else if (it->second.kind == PID_KIND_VALUE) {
+            it->second.kind = PID_KIND_DOUBLE;
+            it->second.secondary = field;
+        } else {
+            continue;
+        }
+        if (field.first + field.size > it->second.bytes) {
+            it->second.bytes = field.first + field.size;
+        }
+    }
+    fclose(f);
+
+    for (std::map<int, pidDescriptor>::iterator it = found.begin(); it != found.end(); it++) {
+        pidDescriptor& d = it->second;
+
+        // signals may leave out the last bytes of a known pid
+        const pidDescriptor* known = this->find(d.pid);
+        if (known && known->bytes > d.bytes) {
+            d.bytes = known->bytes;
+        }
+        d.units = units[d.pid].c_str();
+        d.unitsImperial = d.units;
+        if (this->add(d)) {
+            added++;
+        }
+    }
+
+    return added;
+}
+
+void obdPidRegistry::set (const pidDescriptor* descriptor)
+{
+    if ((descriptor->pid & ~0xFF) == 0x0100) {
+        mode01_[descriptor->pid & 0xFF] = descriptor;
+    } else {
+        others_[descriptor->pid] = descriptor;
+    }
+}
+
+bool obdPidRegistry::fits (const pidField& field, int bytes)
+{
+    return field.size >= 1 && field.size <= 4 && field.first + field.size <= bytes;
+}
+
+const char* obdPidRegistry::keep (const char* text)
+{
+    strings_.push_back(text ? text : "");
+    return strings_.back().c_str();
+}
+
+obdPidMap::obdPidMap ()
+{
+    for (int i = 0; i < 8; i++) {
+        bits_[i] = 0;
+    }
+}
+
+/// \brief Mark a pid as supported
+///
+/// \param[in] pid The pid without the mode, 0x00 - 0xFF
+void obdPidMap::set (int pid)
+{
+    pid &= 0xFF;
+    bits_[pid >> 5] |= 1u << (pid & 31);
+}
+
+/// \brief Whether a pid is supported
+///
+/// \param[in] pid The pid without the mode, 0x00 - 0xFF
+bool obdPidMap::test (int pid) const
+{
+    pid &= 0xFF;
+    return (bits_[pid >> 5] >> (pid & 31)) & 1;
+}
+
+bool obdPidMap::empty () const
+{
+    for (int i = 0; i < 8; i++) {
+        if (bits_[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// \brief Mark the pids of an answer to a supported pids request
+///
+/// \param[in] base The pid asked for, 0x00, 0x20 ... 0xE0
+/// \param[in] mask The four data bytes of the answer; the most
+/// significant bit stands for pid base + 1, the least for base + 0x20
+void obdPidMap::set_range (int base, unsigned long mask)
+{
+    for (int i = 1; i <= 32; i++) {
+        if ((mask >> (32 - i)) & 1) {
+            this->set(base + i);
+        }
+    }
+}
+
+/// \brief The map as 64 hex digits, pids 0x00 - 0x1F first
+std::string obdPidMap::to_hex () const
+{
+    char text[8 * 8 + 1];
+
+    for (int i = 0; i < 8; i++) {
+        snprintf(text + i * 8, 9, "%08x", bits_[i]);
+    }
+    return std::string(text);
+}
+
+/// \brief Read a map written by to_hex()
+///
+/// \return False, and the map unchanged, if the text isn't a map
+bool obdPidMap::from_hex (const char* hex)
+{
+    unsigned int bits[8];
+
+    if (!hex || strlen(hex) != 8 * 8) {
+        return false;
+    }
+    for (int i = 0; i < 8; i++) {
+        char word[9];
+        char* end;
+        memcpy(word, hex + i * 8, 8);
+        word[8] = 0;
+        bits[i] = strtoul(word, &end, 16);
+        if (*end) {
+            return false;
+        }
+    }
+    memcpy(bits_, bits, sizeof(bits_));
+    return true;
+}
+
+// Compile time checks of the built in table: sorted, the fields inside
+// the data, and every pid decoded from a reference answer.
+
+constexpr bool table_ok (int i)
+{
+    return (i == builtinCount) ? true :
+        (i == 0 || builtinPids[i - 1].pid < builtinPids[i].pid) &&
+        builtinPids[i].main.first + builtinPids[i].main.size <= builtinPids[i].bytes &&
+        builtinPids[i].secondary.first + builtinPids[i].secondary.size <= builtinPids[i].bytes &&
+        (builtinPids[i].kind == PID_KIND_RAW || builtinPids[i].kind == PID_KIND_STRING ||
+         builtinPids[i].main.size > 0) &&
+        (builtinPids[i].kind != PID_KIND_DOUBLE || builtinPids[i].secondary.size > 0) &&
+        table_ok(i + 1);
+}
+
+static_assert(table_ok(0), "builtin PID table unsorted or a field outside the data");
+
+constexpr const pidDescriptor& builtin (int pid, int i = 0)
+{
+    // runs past the end, and so fails to compile, for an unknown pid
+    return (builtinPids[i].pid == pid) ? builtinPids[i] : builtin(pid, i + 1);
+}
+
+constexpr bool close_to (double value, double expected)
+{
+    return value - expected < 0.0005 && expected - value < 0.0005;
+}
+
+#define CHECK_NAME2(line)   reference ## line
+#define CHECK_NAME(line)    CHECK_NAME2(line)
+
+/// the answer A B C D of pid decodes to value, imperial in imperial units
+#define CHECK_VALUE(pid, a, b, c, d, value, imperial) \
+    constexpr int CHECK_NAME(__LINE__)[] = { a, b, c, d }; \
+    static_assert(builtin(pid).kind == PID_KIND_VALUE && \
+                  close_to(obd_pid_field(builtin(pid).main, CHECK_NAME(__LINE__)), value) && \
+                  close_to(obd_pid_field(builtin(pid).main, CHECK_NAME(__LINE__)) * \
+                           builtin(pid).imperialScale + builtin(pid).imperialOffset, imperial), \
+                  "PID " #pid " decoded wrong")
+
+/// the answer A B C D of pid decodes to first and second
+#define CHECK_DOUBLE(pid, a, b, c, d, first, second) \
+    constexpr int CHECK_NAME(__LINE__)[] = { a, b, c, d }; \
+    static_assert(builtin(pid).kind == PID_KIND_DOUBLE && \
+                  close_to(obd_pid_field(builtin(pid).main, CHECK_NAME(__LINE__)), first) && \
+                  close_to(obd_pid_field(builtin(pid).secondary, CHECK_NAME(__LINE__)), second), \
+                  "PID " #pid " decoded wrong")
+
+/// pid has no numeric value
+#define CHECK_KIND(pid, expected) \
+    static_assert(builtin(pid).kind == expected, "PID " #pid " of the wrong kind")
+
+CHECK_KIND   (0x0100, PID_KIND_RAW);
+CHECK_KIND   (PID_DTC_STATUS, PID_KIND_RAW);
+CHECK_KIND   (PID_DTCFRZF, PID_KIND_RAW);
+CHECK_KIND   (PID_FUELSYS, PID_KIND_RAW);
+CHECK_VALUE  (PID_LOAD_PCT, 0xFF, 0, 0, 0, 100, 100);
+CHECK_VALUE  (PID_ECT, 0x7B, 0, 0, 0, 83, 181.4);
+CHECK_VALUE  (PID_BANK1_STFT, 0x00, 0, 0, 0, -100, -100);
+CHECK_VALUE  (PID_BANK1_LTFT, 0x80, 0, 0, 0, 0, 0);
+CHECK_VALUE  (PID_BANK2_STFT, 0x81, 0, 0, 0, 0.78125, 0.78125);
+CHECK_VALUE  (PID_BANK2_LTFT, 0xFF, 0, 0, 0, 99.21875, 99.21875);
+CHECK_VALUE  (PID_FRP, 0x64, 0, 0, 0, 300, 43.51131);
+CHECK_VALUE  (PID_MAP, 0x65, 0, 0, 0, 101, 29.825280);
+CHECK_VALUE  (PID_RPM, 0x1A, 0xF8, 0, 0, 1726, 1726);
+CHECK_VALUE  (PID_VSS, 0x64, 0, 0, 0, 100, 62.13712);
+CHECK_VALUE  (PID_SPARKADV, 0x91, 0, 0, 0, 8.5, 8.5);
+CHECK_VALUE  (PID_IAT, 0x00, 0, 0, 0, -40, -40);
+CHECK_VALUE  (PID_MAF, 0x01, 0x2C, 0, 0, 3, 0.396828);
+CHECK_VALUE  (PID_TP, 0x33, 0, 0, 0, 20, 20);
+CHECK_KIND   (PID_AIR_STAT, PID_KIND_STRING);
+CHECK_KIND   (PID_O2SLOC, PID_KIND_STRING);
+CHECK_DOUBLE (PID_O2S11, 0x5A, 0x80, 0, 0, 0.45, 0);
+CHECK_DOUBLE (PID_O2S12, 0xB4, 0x70, 0, 0, 0.9, -12.5);
+CHECK_DOUBLE (PID_O2S13, 0x00, 0xFF, 0, 0, 0, 99.21875);
+CHECK_DOUBLE (PID_O2S14, 0x14, 0x00, 0, 0, 0.1, -100);
+CHECK_DOUBLE (PID_O2S21, 0x5A, 0x80, 0, 0, 0.45, 0);
+CHECK_DOUBLE (PID_O2S22, 0xB4, 0x70, 0, 0, 0.9, -12.5);
+CHECK_DOUBLE (PID_O2S23, 0x00, 0xFF, 0, 0, 0, 99.21875);
+CHECK_DOUBLE (PID_O2S24, 0x14, 0x00, 0, 0, 0.1, -100);
+CHECK_KIND   (PID_OBDSUP, PID_KIND_STRING);
+CHECK_KIND   (0x011D, PID_KIND_RAW);
+CHECK_KIND   (PID_PTO_STAT, PID_KIND_STRING);
+CHECK_VALUE  (PID_RUNTM, 0x0E, 0x10, 0, 0, 3600, 3600);
+CHECK_KIND   (0x0120, PID_KIND_RAW);
+CHECK_VALUE  (PID_MIL_DIST, 0x00, 0x64, 0, 0, 100, 62.13712);
+CHECK_VALUE  (PID_FRP_REL, 0x03, 0xE8, 0, 0, 79, 11.457978);
+CHECK_VALUE  (PID_FRP_ATMO, 0x27, 0x10, 0, 0, 100000, 14503.77);
+CHECK_DOUBLE (0x0124, 0x80, 0x00, 0x80, 0x00, 1, 4);
+CHECK_DOUBLE (0x0125, 0xFF, 0xFF, 0xFF, 0xFF, 1.999969, 7.999878);
+CHECK_DOUBLE (0x0126, 0x40, 0x00, 0x20, 0x00, 0.5, 1);
+CHECK_DOUBLE (0x0127, 0x80, 0x00, 0x80, 0x00, 1, 4);
+CHECK_DOUBLE (0x0128, 0x80, 0x00, 0x80, 0x00, 1, 4);
+CHECK_DOUBLE (0x0129, 0x80, 0x00, 0x80, 0x00, 1, 4);
+CHECK_DOUBLE (0x012A, 0x80, 0x00, 0x80, 0x00, 1, 4);
+CHECK_DOUBLE (0x012B, 0x80, 0x00, 0x80, 0x00, 1, 4);
+CHECK_VALUE  (PID_EGR_PCT, 0x80, 0, 0, 0, 50.196078, 50.196078);
+CHECK_VALUE  (PID_EGR_ERR, 0x60, 0, 0, 0, -25, -25);
+CHECK_VALUE  (PID_EVAP_PCT, 0x00, 0, 0, 0, 0, 0);
+CHECK_VALUE  (PID_FLI, 0xCC, 0, 0, 0, 80, 80);
+CHECK_VALUE  (PID_WARM_UPS, 0x2A, 0, 0, 0, 42, 42);
+CHECK_VALUE  (PID_CLR_DIST, 0x03, 0xE8, 0, 0, 1000, 621.3712);
+CHECK_VALUE  (PID_EVAP_VP, 0xFF, 0x38, 0, 0, -50, -0.200732);
+CHECK_VALUE  (PID_BARO, 0x64, 0, 0, 0, 100, 29.52998);
+CHECK_DOUBLE (0x0134, 0x80, 0x00, 0x80, 0x00, 1, 0);
+CHECK_DOUBLE (0x0135, 0x80, 0x00, 0x81, 0x00, 1, 1);
+CHECK_DOUBLE (0x0136, 0x40, 0x00, 0x7F, 0x80, 0.5, -0.5);
+CHECK_DOUBLE (0x0137, 0x80, 0x00, 0x00, 0x00, 1, -128);
+CHECK_DOUBLE (0x0138, 0x80, 0x00, 0x80, 0x00, 1, 0);
+CHECK_DOUBLE (0x0139, 0x80, 0x00, 0x80, 0x00, 1, 0);
+CHECK_DOUBLE (0x013A, 0x80, 0x00, 0x80, 0x00, 1, 0);
+CHECK_DOUBLE (0x013B, 0x80, 0x00, 0x80, 0x00, 1, 0);
+CHECK_VALUE  (PID_CATEMP11, 0x1C, 0x84, 0, 0, 690, 1274);
+CHECK_VALUE  (PID_CATEMP21, 0x01, 0x90, 0, 0, 0, 32);
+CHECK_VALUE  (PID_CATEMP12, 0x1C, 0x84, 0, 0, 690, 1274);
+CHECK_VALUE  (PID_CATEMP22, 0x01, 0x90, 0, 0, 0, 32);
+CHECK_KIND   (0x0140, PID_KIND_RAW);
+CHECK_KIND   (0x0141, PID_KIND_RAW);
+CHECK_VALUE  (PID_VPWR, 0x36, 0xB0, 0, 0, 14, 14);
+CHECK_VALUE  (PID_LOAD_ABS, 0x01, 0xFE, 0, 0, 200, 200);
+CHECK_VALUE  (PID_EQ_RAT, 0x80, 0x00, 0, 0, 1, 1);
+CHECK_VALUE  (PID_TP_R, 0x33, 0, 0, 0, 20, 20);
+CHECK_VALUE  (PID_AAT, 0x3C, 0, 0, 0, 20, 68);
+CHECK_VALUE  (PID_TP_B, 0x33, 0, 0, 0, 20, 20);
+CHECK_VALUE  (PID_TP_C, 0x66, 0, 0, 0, 40, 40);
+CHECK_VALUE  (PID_APP_D, 0x33, 0, 0, 0, 20, 20);
+CHECK_VALUE  (PID_APP_E, 0x99, 0, 0, 0, 60, 60);
+CHECK_VALUE  (PID_APP_F, 0xFF, 0, 0, 0, 100, 100);
+CHECK_VALUE  (PID_TAC_PCT, 0x33, 0, 0, 0, 20, 20);
+CHECK_VALUE  (PID_MIL_TIME, 0x01, 0x00, 0, 0, 256, 256);
+CHECK_VALUE  (PID_CLR_TIME, 0x00, 0x3C, 0, 0, 60, 60);
+CHECK_KIND   (0x014F, PID_KIND_RAW);
+CHECK_KIND   (0x0150, PID_KIND_RAW);
+CHECK_KIND   (PID_FUEL_TYP, PID_KIND_STRING);
+CHECK_VALUE  (PID_ALCH_PCT, 0x26, 0, 0, 0, 14.901961, 14.901961);
+CHECK_VALUE  (PID_EVAP_VPA, 0x4E, 0x20, 0, 0, 100, 401.46309);
+CHECK_VALUE  (PID_EVAP_OTHER, 0x80, 0x00, 0, 0, -32768, -131.551445);
+CHECK_DOUBLE (0x0155, 0x80, 0x80, 0, 0, 0, 0);
+CHECK_DOUBLE (0x0156, 0x00, 0xFF, 0, 0, -100, 99.21875);
+CHECK_DOUBLE (0x0157, 0xA0, 0x60, 0, 0, 25, -25);
+CHECK_DOUBLE (0x0158, 0x80, 0x80, 0, 0, 0, 0);
+CHECK_VALUE  (PID_FRP_ABS, 0x27, 0x10, 0, 0, 100000, 14503.77);
+CHECK_VALUE  (PID_APP_R, 0x33, 0, 0, 0, 20, 20);
+CHECK_VALUE  (0x015B, 0xCC, 0, 0, 0, 80, 80);
+CHECK_VALUE  (0x015C, 0x82, 0, 0, 0, 90, 194);
+CHECK_VALUE  (0x015D, 0x69, 0x00, 0, 0, 0, 0);
+CHECK_VALUE  (0x015E, 0x00, 0xC8, 0, 0, 10, 2.64172);
+CHECK_KIND   (0x015F, PID_KIND_RAW);
+CHECK_KIND   (PID_VIN, PID_KIND_STRING);
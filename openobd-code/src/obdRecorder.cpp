@@ -0,0 +1,310 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \class obdRecorder
+/// \brief Writes every exchange with the device to a session file.
+///
+/// A session file starts with a header of OBD_SESSION_HEADER bytes:
+/// the magic "OBDSESS1", the version (u32), a zero u32 and the wall
+/// clock time the session started (u64, seconds since 1970).  The
+/// records follow, each OBD_RECORD_HEADER bytes and its data:
+///
+///	u64 time   microseconds since the start, from the monotonic clock
+///	u32 length bytes of data
+///	u8  kind   obdRecorder::recordKind
+///	u8  format obdParser::headerFormat the answer was parsed with, 0xFF if none
+///	u16        zero
+///
+/// All numbers are little endian.  The file is only ever appended to,
+/// so a session cut short ends with at most one partial record.
+///
+/// record() copies into a preallocated ring and returns; a background
+/// thread writes the ring to the file, at least every
+/// OBD_RECORDER_FLUSH_MS.  Only a full ring makes record() wait.
+
+#include <wx/wxprec.h>
+
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <cstring>
+#include <ctime>
+
+#include "obdRecorder.h"
+#include "ctb-0.15/timer.h"
+
+/// The writer thread, it just runs the writer loop.
+class obdRecorderThread : public wxThread
+{
+public:
+    obdRecorderThread(obdRecorder* owner) : wxThread(wxTHREAD_JOINABLE)
+    {
+        recorder = owner;
+    }
+
+protected:
+    ExitCode Entry()
+    {
+        recorder->run();
+        return 0;
+    }
+
+private:
+    obdRecorder* recorder;
+};
+
+static void put_u32 (unsigned char* p, unsigned long v)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static void put_u64 (unsigned char* p, unsigned long long v)
+{
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static unsigned long long get_le (const unsigned char* p, int bytes)
+{
+    unsigned long long v = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+obdRecorder::obdRecorder () : buffer(OBD_RECORDER_BUFFER), wake(0, 0)
+{
+    this->file = NULL;
+    this->thread = NULL;
+    this->stopRequested = false;
+    this->failed = false;
+    this->start = 0;
+}
+
+obdRecorder::~obdRecorder ()
+{
+    this->close();
+}
+
+/// \brief Start a session file
+///
+/// \param[in] path The file, an existing one is overwritten
+/// \return False if the file or the writer thread can't be created
+bool obdRecorder::open (const char* path)
+{
+    unsigned char header[OBD_SESSION_HEADER];
+
+    if (file) {
+        return false;
+    }
+    file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+
+    memcpy(header, OBD_SESSION_MAGIC, 8);
+    put_u32(header + 8, OBD_SESSION_VERSION);
+    put_u32(header + 12, 0);
+    put_u64(header + 16, (unsigned long long)time(NULL));
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+
+    start = ctb::monotonicus();
+    stopRequested = false;
+    failed = false;
+    thread = new obdRecorderThread(this);
+    if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR) {
+        delete thread;
+        thread = NULL;
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    return true;
+}
+
+/// \brief Write what is still buffered and close the file
+///
+/// \return False if not all of the session could be written
+bool obdRecorder::close ()
+{
+    if (!file) {
+        return true;
+    }
+
+    stopRequested = true;
+    wake.Post();
+    thread->Wait();
+    delete thread;
+    thread = NULL;
+
+    bool ok = !failed;
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    file = NULL;
+    return ok;
+}
+
+bool obdRecorder::is_open ()
+{
+    return file != NULL;
+}
+
+/// \brief Add a record to the session
+///
+/// Called by whichever thread holds the link lock, which makes them
+/// the single producer of the ring.
+///
+/// \param[in] kind What the data is, see recordKind
+/// \param[in] format The header format an answer is parsed with, -1 if none
+/// \param[in] data The bytes
+/// \param[in] len Number of bytes
+void obdRecorder::record (int kind, int format, const char* data, size_t len)
+{
+    unsigned char header[OBD_RECORD_HEADER];
+
+    if (!file) {
+        return;
+    }
+
+    put_u64(header, ctb::monotonicus() - start);
+    put_u32(header + 8, (unsigned long)len);
+    header[12] = (unsigned char)kind;
+    header[13] = (format < 0) ? 0xFF : (unsigned char)format;
+    header[14] = 0;
+    header[15] = 0;
+    this->append((const char*)header, sizeof(header));
+    this->append(data, len);
+
+    // don't let the writer fall behind
+    if (buffer.items() > OBD_RECORDER_BUFFER / 2) {
+        wake.Post();
+    }
+}
+
+/// \brief Copy into the ring, waiting for the writer while it is full
+void obdRecorder::append (const char* data, size_t len)
+{
+    while (len > 0) {
+        int n = buffer.write(data, (int)((len > OBD_RECORDER_BUFFER) ? OBD_RECORDER_BUFFER : len));
+        if (n == 0) {
+            wake.Post();
+            ctb::sleepms(1);
+            continue;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+/// \brief The writer loop
+///
+/// Runs in the writer thread until close() is called.
+void obdRecorder::run ()
+{
+    while (true) {
+        wake.WaitTimeout(OBD_RECORDER_FLUSH_MS);
+
+        // everything recorded before close() is in the ring by now
+        bool stop = stopRequested;
+        this->drain();
+        if (stop) {
+            break;
+        }
+    }
+}
+
+/// \brief Write the ring to the file
+///
+/// After a write error the ring is still emptied, so recording never
+/// blocks; close() reports the loss.
+void obdRecorder::drain ()
+{
+    const char* span;
+    size_t len;
+    bool wrote = false;
+
+    while ((len = buffer.readSpan(span)) > 0) {
+        if (!failed && fwrite(span, 1, len, file) != len) {
+            failed = true;
+        }
+        buffer.consume(len);
+        wrote = true;
+    }
+    if (wrote && !failed && fflush(file) != 0) {
+        failed = true;
+    }
+}
+
+/// \brief Check the header of a session file
+///
+/// \param[in] file Positioned at the start
+/// \param[out] started Wall clock time the session started, may be NULL
+/// \return False if it isn't a session file this version can read
+bool obdRecorder::read_header (FILE* file, unsigned long long* started)
+{
+    unsigned char header[OBD_SESSION_HEADER];
+
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, OBD_SESSION_MAGIC, 8) != 0 ||
+        get_le(header + 8, 4) != OBD_SESSION_VERSION) {
+        return false;
+    }
+    if (started) {
+        *started = get_le(header + 16, 8);
+    }
+    return true;
+}
+
+/// \brief Read the next record of a session file
+///
+/// \param[in] file Positioned after the header or the last record
+/// \param[out] result The record
+/// \return False at the end of the session, a partial last record
+/// included
+bool obdRecorder::read_record (FILE* file, obdRecorder::sessionRecord& result)
+{
+    unsigned char header[OBD_RECORD_HEADER];
+
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        return false;
+    }
+    size_t len = (size_t)get_le(header + 8, 4);
+    result.time = get_le(header, 8);
+    result.kind = header[12];
+    result.format = (header[13] == 0xFF) ? -1 : header[13];
+    result.data.resize(len);
+    if (len && fread(&result.data[0], 1, len, file) != len) {
+        return false;
+    }
+    return true;
+}
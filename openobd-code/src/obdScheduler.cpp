@@ -0,0 +1,355 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * openobd
+ * Copyright (C) Simon Booth 2010 <simesb@users.sourceforge.net>
+ *
+ * openobd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * openobd is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \class obdScheduler
+/// \brief Polls PIDs in a background thread, each at its own rate.
+///
+/// The worker thread owns the serial link while it runs.  Every cycle
+/// it takes the PIDs whose time has come, earliest deadline first, and
+/// asks for up to six of them with one obd_pid_values() call, so a
+/// device which can combine requests does so.  The values are handed
+/// to the GUI through a lock-free queue; the GUI never waits for the
+/// device.
+
+#include <wx/wxprec.h>
+
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#include "obdScheduler.h"
+#include "obdbase.h"
+#include "ctb-0.15/timer.h"
+
+#define SCHED_MAX_PIDS  6       ///< PIDs asked for in one cycle
+#define SCHED_IDLE_MS   250     ///< wait when nothing is configured
+
+/// The worker thread, it just runs the polling loop.
+class obdSchedulerThread : public wxThread
+{
+public:
+    obdSchedulerThread(obdScheduler* owner) : wxThread(wxTHREAD_JOINABLE)
+    {
+        scheduler = owner;
+    }
+
+protected:
+    ExitCode Entry()
+    {
+        scheduler->run();
+        return 0;
+    }
+
+private:
+    obdScheduler* scheduler;
+};
+
+obdScheduler::obdScheduler (obdbase* device) : wake(0, 0), results(1024)
+{
+    this->device = device;
+    this->thread = NULL;
+    this->discoverMode = 0;
+    this->stopRequested = false;
+    this->droppedCount = 0;
+}
+
+obdScheduler::~obdScheduler ()
+{
+    this->stop();
+}
+
+/// \brief Start polling in the background
+///
+/// \return True if the worker thread is running
+bool obdScheduler::start ()
+{
+    if (thread) {
+        return true;
+    }
+
+    stopRequested = false;
+    thread = new obdSchedulerThread(this);
+    if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR) {
+        delete thread;
+        thread = NULL;
+        return false;
+    }
+    return true;
+}
+
+/// \brief Stop polling and wait for the worker thread to finish
+///
+/// Returns after the request in progress, if any, has been answered.
+void obdScheduler::stop ()
+{
+    if (!thread) {
+        return;
+    }
+
+    stopRequested = true;
+    wake.Post();
+    thread->Wait();
+    delete thread;
+    thread = NULL;
+}
+
+bool obdScheduler::is_running ()
+{
+    return thread != NULL;
+}
+
+/// \brief Ask for the supported PIDs of a mode in the background
+///
+/// Every supported PID without a configured rate is then polled at
+/// its default rate.
+///
+/// \param[in] mode The mode to query, e.g. 0x01
+void obdScheduler::discover (int mode)
+{
+    wxMutexLocker lock(configLock);
+    discoverMode = mode;
+    wake.Post();
+}
+
+/// \brief Set the polling rate of a PID
+///
+/// \param[in] pid The pid to poll
+/// \param[in] hz Requests per second, 0 to stop polling the pid
+void obdScheduler::set_rate (int pid, double hz)
+{
+    wxMutexLocker lock(configLock);
+    std::vector<entry>::iterator it;
+
+    for (it = entries.begin(); it != entries.end() && it->pid != pid; it++) {
+    }
+
+    if (hz <= 0) {
+        if (it != entries.end()) {
+            entries.erase(it);
+        }
+        return;
+    }
+
+    if (it == entries.end()) {
+        entry e;
+        e.pid = pid;
+        e.due = 0;
+        it = entries.insert(entries.end(), e);
+    }
+    it->hz = hz;
+    it->period = (unsigned long long)(1000.0 / hz);
+    if (it->period == 0) {
+        it->period = 1;
+    }
+    wake.Post();
+}
+
+/// \brief Get the polling rate of a PID
+///
+/// \return Requests per second, 0 if the pid isn't polled
+double obdScheduler::get_rate (int pid)
+{
+    wxMutexLocker lock(configLock);
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].pid == pid) {
+            return entries[i].hz;
+        }
+    }
+    return 0;
+}
+
+/// \brief The rate a PID is polled at, unless set otherwise
+///
+/// Fast changing values are polled often, temperatures and static
+/// information rarely.
+///
+/// \param[in] pid The pid
+/// \return Requests per second, 0 for pids not worth polling
+double obdScheduler::default_rate (int pid)
+{
+    // the supported pid lists
+    if ((pid & 0x1F) == 0) {
+        return 0;
+    }
+
+    switch (pid) {
+        case PID_RPM:
+            return 20;
+        case PID_VSS:
+        case PID_TP:
+        case PID_APP_D:
+        case PID_APP_E:
+        case PID_MAF:
+        case PID_MAP:
+            return 10;
+        case PID_LOAD_PCT:
+        case PID_SPARKADV:
+            return 5;
+        case PID_FUELSYS:
+        case PID_O2SLOC:
+        case PID_OBDSUP:
+        case PID_PTO_STAT:
+        case PID_FUEL_TYP:
+            return 0.1;
+        default:
+            return 1;
+    }
+}
+
+/// \brief Get the oldest value not yet taken
+///
+/// Only one thread may take values.
+///
+/// \param[out] result The value
+/// \return False if there are no new values
+bool obdScheduler::pop (obdScheduler::sample& result)
+{
+    return results.pop(result);
+}
+
+/// \brief Values thrown away because the consumer didn't keep up
+unsigned long obdScheduler::dropped ()
+{
+    return droppedCount;
+}
+
+/// \brief The polling loop
+///
+/// Runs in the worker thread until stop() is called.
+void obdScheduler::run ()
+{
+    std::vector<obdbase::pidInfo> values;
+    std::vector<bool> retrieved;
+
+    while (!stopRequested) {
+        unsigned long long now;
+        long wait = SCHED_IDLE_MS;
+        int mode;
+
+        {
+            wxMutexLocker lock(configLock);
+            mode = discoverMode;
+            discoverMode = 0;
+        }
+
+        if (mode) {
+            std::vector<int> pids;
+            device->obdSupportedPids(mode, pids);
+
+            for (size_t i = 0; i < pids.size(); i++) {
+                if (this->get_rate(pids[i]) == 0) {
+                    this->set_rate(pids[i], default_rate(pids[i]));
+                }
+            }
+            continue;
+        }
+
+        // pick the pids due, earliest deadline first and the faster
+        // pid first if both are due at the same time
+        now = ctb::monotonicms();
+        batch.clear();
+        {
+            wxMutexLocker lock(configLock);
+
+            order.resize(entries.size());
+            for (size_t i = 0; i < order.size(); i++) {
+                order[i] = i;
+            }
+            const std::vector<entry>& e = entries;
+            std::sort(order.begin(), order.end(), [&e](size_t a, size_t b) {
+                if (e[a].due != e[b].due) {
+                    return e[a].due < e[b].due;
+                }
+                return e[a].hz > e[b].hz;
+            });
+
+            for (size_t i = 0; i < order.size(); i++) {
+                const entry& next = entries[order[i]];
+                if (next.due > now) {
+                    wait = (long)(next.due - now);
+                    break;
+                }
+                if (batch.size() == SCHED_MAX_PIDS) {
+                    wait = 0;
+                    break;
+                }
+                batch.push_back(next.pid);
+            }
+        }
+
+        if (batch.empty()) {
+            wake.WaitTimeout(wait);
+            continue;
+        }
+
+        device->obd_pid_values(batch, values, retrieved);
+        now = ctb::monotonicms();
+
+        {
+            wxMutexLocker lock(configLock);
+
+            for (size_t i = 0; i < entries.size(); i++) {
+                entry& e = entries[i];
+                if (std::find(batch.begin(), batch.end(), e.pid) == batch.end()) {
+                    continue;
+                }
+                // keep the rate, but don't try to catch up more than
+                // one period when the link can't keep up
+                e.due += e.period;
+                if (e.due + e.period < now) {
+                    e.due = now;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < batch.size(); i++) {
+            this->publish(batch[i], retrieved[i], values[i], now);
+        }
+    }
+}
+
+void obdScheduler::publish (int pid, bool valid, const obdbase::pidInfo& info, unsigned long long now)
+{
+    sample s;
+
+    s.pid = pid;
+    s.valid = valid;
+    s.pid_flag = info.pid_flag;
+    s.resultMain = info.resultMain;
+    s.resultSecondary = info.resultSecondary;
+    s.time = now;
+    s.resultString[0] = 0;
+    if (valid && info.pid_flag == obdbase::PID_FLAG_STRING) {
+        strncpy(s.resultString, (const char*)info.resultString.mb_str(wxConvUTF8),
+                sizeof(s.resultString) - 1);
+        s.resultString[sizeof(s.resultString) - 1] = 0;
+    }
+
+    if (!results.push(s)) {
+        droppedCount++;
+    }
+}
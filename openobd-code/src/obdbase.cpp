@@ -31,19 +31,24 @@
     #include <wx/string.h>
 #endif
 
+#include <algorithm>
+#include <cctype>
 #include <cstring>
 #include <fcntl.h>
+#include <sqlite3.h>
 
 #include <wx/tokenzr.h>
 
 #include "obdbase.h"
+#include "obdScheduler.h"
+#include "obdRecorder.h"
 #include "logPanel.h"
 #include "ctb-0.15/ctb.h"
 
 using namespace std;
 using namespace ctb;
 
-obdbase::obdbase ()
+obdbase::obdbase () : linkLock(wxMUTEX_RECURSIVE), supportedLock(wxMUTEX_RECURSIVE)
 {
     // create a new serial port object
 	port = new ctb::SerialPort();
@@ -54,14 +59,20 @@ obdbase::obdbase ()
 
 	this->logger = NULL;
 	this->logExtra = true;
+	this->lastErrorCount = 0;
+	this->scheduler = NULL;
+	this->recorder = NULL;
+	this->recording = false;
+	this->answerFormat = -1;
+	this->db = NULL;
+	this->baudrate = 0;
 }
 
 obdbase::obdbase (const wxString& SerialPort)
+    : linkLock(wxMUTEX_RECURSIVE), supportedLock(wxMUTEX_RECURSIVE)
 {
     // create a new serial port object
 	port = new ctb::SerialPort();
-	// and connect it to the chosen port
-    this->obdDeviceConnect(SerialPort);
 
 	// setup the defaults
 	this->obd_use_checksums(true);
@@ -70,26 +81,137 @@ obdbase::obdbase (const wxString& SerialPort)
 	this->logger = NULL;
 	this->logExtra = true;
 	this->lastErrorCount = 0;
+	this->scheduler = NULL;
+	this->recorder = NULL;
+	this->recording = false;
+	this->answerFormat = -1;
+	this->db = NULL;
+	this->baudrate = 0;
+
+	// and connect it to the chosen port
+    this->obdDeviceConnect(SerialPort);
 }
 
 obdbase::~obdbase ()
 {
     this->obdDeviceDisconnect();
+    delete scheduler;
     delete port;
 }
 
+/// \brief Open the serial port and find the rate the device talks at
+///
+/// The port stays open even if no device answers, so the caller sees
+/// it as connected as before; obd_baudrate() then returns 0.
 void obdbase::obdDeviceConnect (const wxString& SerialPort)
 {
-    int baudrate = 9600;
-
     // open the serial port
-    port->Open(SerialPort.mb_str(wxConvUTF8), baudrate);
+    this->baudrate = 0;
+    if (port->Open(SerialPort.mb_str(wxConvUTF8), OBD_BAUD_DEFAULT) < 0) {
+        return;
+    }
+    // drain the port in the background where ctb can; without the
+    // thread the answers are read from the port directly
+    port->StartReader();
+
+    this->baudrate = this->obdDetectBaudrate();
+}
+
+/// \brief Find the rate the device answers on
+///
+/// ELM327 devices ship set to 38400 or 9600 baud, clones use anything
+/// up to 500000.  The rates are tried most likely first, the port is
+/// left at the one the device answered on.
+///
+/// \return The rate, 0 if the device didn't answer on any of them
+/// \since 0.5.2
+int obdbase::obdDetectBaudrate ()
+{
+    static const int rates[] = {
+        38400, 9600, 115200, 57600, 230400, 500000, 19200
+    };
+    wxMutexLocker lock(linkLock);
+
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        if (port->SetBaudrate(rates[i]) < 0) {
+            continue;
+        }
+        if (this->obdProbe()) {
+            return rates[i];
+        }
+    }
+
+    // nobody there, stay with the default
+    port->SetBaudrate(OBD_BAUD_DEFAULT);
+    return 0;
+}
+
+/// \brief Check for a device answering at the current rate
+///
+/// Sends an invalid command, so the device neither repeats its last
+/// command nor does anything else, and waits for the prompt.  At the
+/// wrong rate the answer, if any, is garbage.
+///
+/// \return True if the device answered with a prompt
+/// \since 0.5.2
+bool obdbase::obdProbe ()
+{
+    char probe[] = "\x7f\x7f\r";
+    char junk[64];
+    const char* answer;
+    size_t size;
+
+    // forget what arrived at the previous rate
+    while (port->Read(junk, sizeof(junk)) > 0) {
+    }
+
+    if (port->Writev(probe, strlen(probe), OBD_PROBE_MS) != (int)strlen(probe)) {
+        return false;
+    }
+    if (port->ReadUntilEOS(answer, &size, ">", OBD_PROBE_MS, 0) != 1) {
+        return false;
+    }
+
+    // a misread byte rarely looks like plain ASCII
+    for (size_t i = 0; i < size; i++) {
+        unsigned char c = answer[i];
+        if (c >= 0x80 || (c < 0x20 && c != '\r' && c != '\n')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// \brief The rate of the serial link
+///
+/// \return The rate in baud, 0 if no device answered when connecting
+/// \since 0.5.2
+int obdbase::obd_baudrate ()
+{
+    if (!this->obd_is_connected()) {
+        return 0;
+    }
+    return this->baudrate;
 }
 
 void obdbase::obdDeviceDisconnect ()
 {
+    // stop polling before the port goes away
+    this->obd_stop_polling();
+
+    // the session ends with the connection
+    this->obd_stop_recording();
+
     // close the port
     port->Close();
+    this->baudrate = 0;
+
+    // the next connection may be to another vehicle
+    {
+        wxMutexLocker lock(supportedLock);
+        vin.Empty();
+    }
+    this->obdForgetEcus();
 }
 
 void obdbase::obd_use_checksums (bool use)
@@ -112,6 +234,118 @@ void obdbase::obd_set_logger (logPanel* log)
 	this->logger = log;
 }
 
+/// \brief Set the database the supported PIDs are kept in
+///
+/// With a database, the supported PIDs of a vehicle are only asked
+/// for the first time it is connected to; after that they are looked
+/// up by its VIN.
+///
+/// \param[in] database The open database, NULL for none
+/// \since 0.5.2
+void obdbase::obd_set_database (sqlite3* database)
+{
+	this->db = database;
+}
+
+/// \brief Get the background poller of this device
+///
+/// While the scheduler runs, it owns the link: other requests still
+/// work, but wait for the request of the scheduler in progress.
+///
+/// \return The scheduler, created on first use
+/// \since 0.5.2
+obdScheduler* obdbase::obd_scheduler ()
+{
+    if (!scheduler) {
+        scheduler = new obdScheduler(this);
+    }
+    return scheduler;
+}
+
+/// \brief Stop the background poller, if there is one
+///
+/// Unlike obd_scheduler()->stop(), no scheduler is created for a
+/// device which has never polled.
+///
+/// \since 0.5.2
+void obdbase::obd_stop_polling ()
+{
+    if (scheduler) {
+        scheduler->stop();
+    }
+}
+
+/// \brief Write every exchange with the device to a session file
+///
+/// Requests and answers are recorded with their monotonic time until
+/// obd_stop_recording() or the disconnect.  A recording already
+/// running is ended first.
+///
+/// \param[in] path The session file, see obdRecorder for its layout
+/// \return False if the file can't be written
+/// \since 0.5.2
+bool obdbase::obd_start_recording (const wxString& path)
+{
+	wxString msg;
+
+	// no exchange may be half recorded
+	wxMutexLocker lock(linkLock);
+
+	this->obd_stop_recording();
+	recorder = new obdRecorder();
+	if (!recorder->open((const char*)path.mb_str(wxConvUTF8))) {
+		delete recorder;
+		recorder = NULL;
+		if (logger) {
+			msg.Printf(_("Cannot record the session to %s\n"), path.c_str());
+			logger->appendLog(msg, logPanel::LOG_ERROR);
+		}
+		return false;
+	}
+	recording = true;
+
+	if (logger) {
+		msg.Printf(_("Recording the session to %s\n"), path.c_str());
+		logger->appendLog(msg, logPanel::LOG_OTHER);
+	}
+	return true;
+}
+
+/// \brief End the recording of the session
+///
+/// \return False if not all of the session could be written
+/// \since 0.5.2
+bool obdbase::obd_stop_recording ()
+{
+	wxMutexLocker lock(linkLock);
+
+	if (!recorder) {
+		return true;
+	}
+
+	bool complete = recorder->close();
+	delete recorder;
+	recorder = NULL;
+	recording = false;
+
+	if (logger && !complete) {
+		wxString msg(_("The session file is incomplete\n"));
+		logger->appendLog(msg, logPanel::LOG_ERROR);
+	}
+	return complete;
+}
+
+/// \brief Tell if the session is being recorded
+///
+/// Doesn't wait for the link, so the GUI can ask while an exchange
+/// is running.
+///
+/// \since 0.5.2
+bool obdbase::obd_is_recording ()
+{
+	return recording;
+}
+
 int obdbase::obd_mil_status()
 {
 	int result = -1;
@@ -125,7 +359,7 @@ int obdbase::obd_mil_status()
 	}
 
 	// return -1 if we haven't got a well formed response
-	if (this->obd_pid_get_raw(PID_DTC_STATUS, toks, sizeof(toks))) {
+	if (this->obd_pid_get_raw(PID_DTC_STATUS, toks, sizeof(toks) / sizeof(toks[0]))) {
 
 		// get the value of the '3rd byte' and apply conversion formula
 		if (toks[2] > 0x80) {
@@ -179,7 +413,7 @@ wxArrayString obdbase::obd_mil_error_codes ()
             logger->appendLog(msg, logPanel::LOG_OUT);
         }
 
-        if (this->obd_pid_get_raw(0x03, toks, sizeof(toks))) {
+        if (this->obd_pid_get_raw(0x03, toks, sizeof(toks) / sizeof(toks[0]))) {
 
             // for each code, convert to string
             for (int i = 0; i < this->lastErrorCount; i++) {
@@ -253,7 +487,7 @@ bool obdbase::obd_clear_dtc ()
 	}
 
 	// return -1 if we haven't got a well formed response
-	if (this->obd_pid_get_raw(0x04, toks, sizeof(toks))) {
+	if (this->obd_pid_get_raw(0x04, toks, sizeof(toks) / sizeof(toks[0]))) {
 		result = true;
 
 		// write to log if necessary
@@ -282,6 +516,9 @@ bool obdbase::obdWrite(const wxString& command, int count)
 
 	// end the command correctly with a CR
 	len = strlen(cstring);
+	if (recorder) {
+		recorder->record(obdRecorder::RECORD_REQUEST, -1, cstring, len);
+	}
 	cstring[len] = 0x0d;
 	cstring[len+1] = 0x00;
 
@@ -292,29 +529,75 @@ bool obdbase::obdWrite(const wxString& command, int count)
 	return retval;
 }
 
+/// \brief Make the answer of the device printable
+///
+/// Control characters (the line ends) become spaces.
+/// \since 0.5.2
+wxString obdbase::obdPrintable(const char* buf, size_t len)
+{
+	wxString result = wxString::From8BitData(buf, len);
+
+	for (size_t i = 0; i < result.length(); i++) {
+		if (iscntrl((unsigned char)buf[i]))
+			result[i] = 0x20;
+	}
+	return result.Strip(wxString::both);
+}
+
 wxString obdbase::obdRead()
 {
-	wxString result;
-	char * buff = NULL;
-	char * p = (char *)">";
-	int read;
+	const char* buff;
 	size_t size;
 
-	read = port->ReadUntilEOS(buff, &size, p, 5000, 0);
+	this->obdReadRaw(buff, &size);
+
+	// set up the return string, without non printing chars
+	return obdPrintable(buff, size);
+}
+
+/// \brief Read the answer of the device up to the prompt
+///
+/// The answer stays in the buffer of the port, it is valid until the
+/// next read.  Hold the link lock while using it.
+///
+/// \param[out] buf The answer, null terminated, without the prompt
+/// \param[out] len Length of the answer
+/// \return True if the prompt was seen, false on a timeout or error
+/// \since 0.5.2
+bool obdbase::obdReadRaw(const char*& buf, size_t* len)
+{
+	bool prompt = port->ReadUntilEOS(buf, len, ">", 5000, 0) == 1;
 
-	// strip out non printing chars
-	for (int i = 0; i < sizeof(buff); i++) {
-		if (iscntrl(buff[i]))
-			buff[i] = 0x20;
+	if (recorder) {
+		recorder->record(prompt ? obdRecorder::RECORD_ANSWER : obdRecorder::RECORD_TIMEOUT,
+						 answerFormat, buf, *len);
 	}
+	answerFormat = -1;
+	return prompt;
+}
 
-	// set up the return string
-	result = wxString::From8BitData(buff);
-	result = result.Strip(wxString::both);
+/// \brief How the answers show their headers
+///
+/// \return The format to parse the answers with
+/// \since 0.5.2
+obdParser::headerFormat obdbase::obdHeaderFormat()
+{
+	return obdParser::HEADERS_NONE;
+}
 
-	delete buff;
+/// \brief The header format to parse the answer to the next request with
+///
+/// Asks obdHeaderFormat() and remembers the result, so the session
+/// file shows how the answer was parsed.
+///
+/// \return The format
+/// \since 0.5.2
+obdParser::headerFormat obdbase::obdAnswerFormat()
+{
+	obdParser::headerFormat format = this->obdHeaderFormat();
 
-	return result;
+	answerFormat = format;
+	return format;
 }
 
 void obdbase::obdChecksumCalculate ()
@@ -344,53 +627,107 @@ wxString obdbase::obdProtocolGet()
 	return result;
 }
 
-bool obdbase::obd_pid_get_raw(int pid, int tokens[], int toksize)
+/// \brief Send a request and parse the answer
+///
+/// \param[in] pid The pid, or just the mode for requests without one
+/// \param[out] parser Receives the answers of all ECUs
+/// \return False if the request couldn't be sent
+/// \since 0.5.2
+bool obdbase::obdRequest(int pid, obdParser& parser)
 {
-	wxString raw;
+	obdParser::headerFormat format;
+	const char* raw;
+	size_t size;
 	wxString msg;
-	bool chkHead = false;
-	bool chkSum = false;
-	int scale;
-	int index = 0;
-	int expHead;
-	int actHead;
 
-	// convert pid to wxString
-	scale = ((pid / 255) + 1) * 2;		// number of 'bytes' * 2
-	wxString pidString = wxString::Format(_T("%0*x"), scale, pid);
+	// one exchange at a time
+	wxMutexLocker lock(linkLock);
+
+	// may ask the device, so before the request
+	format = this->obdAnswerFormat();
+
+	// convert pid to wxString, the mode and the pid byte if there is one
+	wxString pidString = wxString::Format(_T("%0*x"), (pid > 0xFF) ? 4 : 2, pid);
 
 	// send to device
-	if (this->obdWrite(pidString, pidString.length())) {
+	if (!this->obdWrite(pidString, pidString.length())) {
+		parser.parse("", 0);
+		return false;
+	}
 
-//		sleep(10);
-//		usleep(20000);
-		// read return from device
-		raw = this->obdRead();
+	// read return from device
+	this->obdReadRaw(raw, &size);
 
-		// write the raw response to the log if needed
-		if (logger && logExtra) {
-			msg.Printf(_("Raw data: %s\n"), raw.c_str());
-			logger->appendLog(msg, logPanel::LOG_IN);
-		}
+	// write the raw response to the log if needed
+	if (logger && logExtra) {
+		msg.Printf(_("Raw data: %s\n"), obdPrintable(raw, size).c_str());
+		logger->appendLog(msg, logPanel::LOG_IN);
+	}
 
-		// tokenise the string
-		wxStringTokenizer tkz(raw, wxT(" "));
-		while ( tkz.HasMoreTokens()  && index <= toksize )
-		{
-			wxString token = tkz.GetNextToken();
-			token.ToLong((long int*)&tokens[index], 16);
-			index++;
-		}
+	parser.parse(raw, size, format);
+	return true;
+}
 
-		// check header
-		scale = (scale / 2);			// redefine scale as no of 'bytes' expected
-		expHead = pid + (64 * pow(256, (scale - 1)));
-		actHead = 0;
-		for (int i = 0; i < scale; i++) {
-			actHead += pow(256, (scale - 1 - i)) * tokens[i];
+/// \brief Copy the answer of one ECU
+///
+/// \param[in] parser The parsed answers
+/// \param[in] found The first message of the ECU
+/// \param[in] service The mode of the answer, e.g. 0x41
+/// \param[in] pidByte The pid byte of the answer, -1 if none
+/// \param[out] tokens Receives the bytes of all messages of the ECU,
+/// zero filled
+/// \param[in] toksize Number of elements of tokens
+/// \return True if the messages are complete
+/// \since 0.5.2
+bool obdbase::obdAnswerBytes(const obdParser& parser, int found, int service, int pidByte,
+                             int tokens[], int toksize)
+{
+	int ecu = parser.get(found).ecu;
+	bool complete = true;
+	int index = 0;
+
+	for (int i = found; i >= 0 && index < toksize; i = parser.find(service, pidByte, i + 1)) {
+		if (parser.get(i).ecu != ecu) {
+			continue;
+		}
+		complete = complete && parser.complete(i);
+		const unsigned char* bytes = parser.data(i);
+		for (int k = 0; k < parser.get(i).length && index < toksize; k++) {
+			tokens[index++] = bytes[k];
 		}
-		if (actHead == expHead) {
-			chkHead = true;
+	}
+	while (index < toksize) {
+		tokens[index++] = 0;
+	}
+	return complete;
+}
+
+/// \brief Request a PID and get the bytes of the answer
+///
+/// The answer of the first ECU with the expected header is returned,
+/// all lines of it one after the other.
+///
+/// \param[in] pid The pid, or just the mode for requests without one
+/// \param[out] tokens Receives the bytes, starting with the header
+/// \param[in] toksize Number of elements of tokens
+/// \return True for a complete answer with the expected header
+bool obdbase::obd_pid_get_raw(int pid, int tokens[], int toksize)
+{
+	obdParser parser;
+	bool chkHead = false;
+	bool chkSum = false;
+	int service;
+	int pidByte;
+
+	service = ((pid > 0xFF) ? (pid >> 8) : pid) + 0x40;
+	pidByte = (pid > 0xFF) ? (pid & 0xFF) : -1;
+
+	if (this->obdRequest(pid, parser)) {
+
+		// check header, and copy the lines of that ECU
+		int found = parser.find(service, pidByte);
+		if (found >= 0) {
+			chkHead = obdAnswerBytes(parser, found, service, pidByte, tokens, toksize);
 		}
 
 		// check checksum
@@ -402,19 +739,38 @@ bool obdbase::obd_pid_get_raw(int pid, int tokens[], int toksize)
 		}
 	}
 
+	if (!chkHead) {
+		for (int i = 0; i < toksize; i++) {
+			tokens[i] = 0;
+		}
+	}
+
 	return (chkHead && chkSum);
 }
 
 /// \brief Get the value associated with a PID from the ECU
 ///
+/// The request goes to all ECUs.  With headers on, each ECU answering
+/// gets its value, see obd_pid_ecu_value(); the first one is returned.
+///
 /// \param[in] pid The pid you wish to enquire
 /// \param[out] result Pointer to receive the calculated value
 /// \result True if a value has been successfully retreived
 bool obdbase::obd_pid_value(int pid, obdbase::pidInfo* result)
 {
     bool retVal = false;
-    int toks[40];
+    int toks[OBD_RAW_TOKENS];
+    obdParser parser;
+    std::vector<int> seen;
     wxString msg;
+    int service = ((pid > 0xFF) ? (pid >> 8) : pid) + 0x40;
+    int pidByte = (pid > 0xFF) ? (pid & 0xFF) : -1;
+
+	// write to log if necessary
+	if (logger) {
+		msg.Printf(_("Requesting PID: %#.4x\n"), pid);
+		logger->appendLog(msg, logPanel::LOG_OUT);
+	}
 
     // set sensible defaults
     result->pid_flag = PID_FLAG_SINGLE;
@@ -422,364 +778,527 @@ bool obdbase::obd_pid_value(int pid, obdbase::pidInfo* result)
     result->resultSecondary = 0;
     result->resultString.Empty();
 
-	// write to log if necessary
-	if (logger) {
-		msg.Printf(_("Requesting PID: %#.4x\n"), pid);
-		logger->appendLog(msg, logPanel::LOG_OUT);
-	}
+    if (this->obdRequest(pid, parser)) {
+        for (int m = parser.find(service, pidByte); m >= 0; m = parser.find(service, pidByte, m + 1)) {
+            obdbase::pidInfo info;
+            int ecu = parser.get(m).ecu;
 
-    // ask for the raw data
-    if (this->obd_pid_get_raw(pid, toks, sizeof(toks))) {
-        // we have a good result so...
-        retVal = true;
-
-        switch (pid) {
-            case PID_MAP:
-            case PID_VSS:
-            case PID_WARM_UPS:
-            case PID_BARO:
-                result->resultMain = toks[2];
-                break;
-            case PID_BANK1_STFT:
-            case PID_BANK1_LTFT:
-            case PID_BANK2_STFT:
-            case PID_BANK2_LTFT:
-            case PID_EGR_ERR:
-                result->resultMain = (toks[2] - 128) * 100 / 128;
-                break;
-            case PID_ECT:
-            case PID_IAT:
-            case PID_AAT:
-                result->resultMain = toks[2] - 40;
-                break;
-            case PID_MIL_DIST:
-            case PID_CLR_DIST:
-            case PID_MIL_TIME:
-            case PID_CLR_TIME:
-            case PID_RUNTM:
-                result->resultMain = (toks[2] * 256) + toks[3];
-                break;
-            case PID_FRP:
-                result->resultMain = toks[2] * 3;
-                break;
-            case PID_SPARKADV:
-                result->resultMain = (toks[2] / 2) - 64;
-                break;
-            case PID_MAF:
-                result->resultMain = ((toks[2] * 256) + toks[3]) / 100;
-                break;
-            case PID_TP:
-            case PID_TP_R:
-            case PID_TP_B:
-            case PID_TP_C:
-            case PID_APP_D:
-            case PID_APP_E:
-            case PID_APP_F:
-            case PID_LOAD_PCT:
-            case PID_EGR_PCT:
-            case PID_EVAP_PCT:
-            case PID_FLI:
-            case PID_TAC_PCT:
-            case PID_ALCH_PCT:
-            case PID_APP_R:
-                result->resultMain = toks[2] * 100 / 255;
-                break;
-            case PID_RPM:
-            case PID_EVAP_VP:
-                result->resultMain = ((toks[2] * 256) + toks[3]) / 4;
-                break;
-            case PID_O2S11:
-            case PID_O2S12:
-            case PID_O2S13:
-            case PID_O2S14:
-            case PID_O2S21:
-            case PID_O2S22:
-            case PID_O2S23:
-            case PID_O2S24:
-                result->resultMain = toks[2] * 0.005;
-                result->resultSecondary = (toks[3] - 128) * 100 / 128;
-                result->pid_flag = PID_FLAG_DOUBLE;
-                break;
-            case PID_CATEMP11:
-            case PID_CATEMP21:
-            case PID_CATEMP12:
-            case PID_CATEMP22:
-                result->resultMain = ((toks[2] * 256) + toks[3]) / 10 - 40;
-                break;
-            case PID_FRP_REL:
-                result->resultMain = (((toks[2] * 256) + toks[3]) * 10) / 128;
-                break;
-            case PID_FRP_ATMO:
-            case PID_FRP_ABS:
-                result->resultMain = ((toks[2] * 256) + toks[3]) * 10;
-            case PID_AIR_STAT:
-                result->resultString = obd_pid_air_stat(toks[2]);
-                result->pid_flag = PID_FLAG_STRING;
-                break;
-            case PID_O2SLOC:
-                //TODO: Support PID_O2SLOC
-                result->resultString = _("Not yet supported");
-                result->pid_flag = PID_FLAG_STRING;
-                break;
-            case PID_OBDSUP:
-                result->resultString = this->obd_pid_obd_supported(toks[2]);
-                result->pid_flag = PID_FLAG_STRING;
-                break;
-            case PID_PTO_STAT:
-                if (toks[2] == 0x80) {
-                    result->resultString = _T("ON");
+            // all messages of an ECU are decoded together
+            if (std::find(seen.begin(), seen.end(), ecu) != seen.end()) {
+                continue;
+            }
+            seen.push_back(ecu);
+
+            if (!obdAnswerBytes(parser, m, service, pidByte, toks, OBD_RAW_TOKENS) ||
+                !this->obd_pid_decode(pid, toks, &info)) {
+                continue;
+            }
+
+            // write to log if necessary
+            if (logger) {
+                if (ecu >= 0) {
+                    msg.Printf(_("Result for PID(%#.4x) from %X: %f\n"), pid, ecu, info.resultMain);
                 } else {
-                    result->resultString = _T("OFF");
+                    msg.Printf(_("Result for PID(%#.4x): %f\n"), pid, info.resultMain);
                 }
-                result->pid_flag = PID_FLAG_STRING;
-                break;
-            case PID_VPWR:
-                result->resultMain = ((toks[2] * 256) + toks[3]) / 1000;
-                break;
-            case PID_LOAD_ABS:
-                result->resultMain = ((toks[2] * 256) + toks[3]) * 100 / 255;
-                break;
-            case PID_EQ_RAT:
-                result->resultMain = ((toks[2] * 256) + toks[3]) / 32768;
-                break;
-            case PID_FUEL_TYP:
-                result->resultString = obd_pid_fuel_type(toks[2]);
-                result->pid_flag = PID_FLAG_STRING;
-                break;
-            case PID_VIN:
-                result->resultString = obd_pid_vin(toks);
-                result->pid_flag = PID_FLAG_STRING;
-                break;
-            case PID_EVAP_VPA:
-                result->resultMain = ((toks[2] * 256) + toks[3]) / 200;
-                break;
-            default:
-                // bail out if we don't support the PID in this function
-                retVal = false;
-        }
+                logger->appendLog(msg, logPanel::LOG_IN);
+            }
 
-        // write to log if necessary
-        if (logger) {
-            msg.Printf(_("Result for PID(%#.4x): %f\n"), pid, result->resultMain);
-            logger->appendLog(msg, logPanel::LOG_IN);
-        }
-    } else {
-		// write to log if necessary
-		if (logger) {
-			msg.Printf(_("Could not get result for PID: %#.4x\n"), pid);
-			logger->appendLog(msg, logPanel::LOG_ERROR);
-		}
-	}
+            if (this->useImperial) {
+                this->convertToImperial(pid, &info);
+            }
+            this->obdStoreEcuValue(ecu, pid, info);
 
-    if (this->useImperial) {
-        this->convertToImperial(pid, result);
+            if (!retVal) {
+                *result = info;
+                retVal = true;
+            }
+        }
     }
 
+	// write to log if necessary
+	if (!retVal && logger) {
+		msg.Printf(_("Could not get result for PID: %#.4x\n"), pid);
+		logger->appendLog(msg, logPanel::LOG_ERROR);
+	}
+
     return retVal;
 }   // obd_pid_value()
 
-/// \brief Get the PIDS/OBDMIDS supported by the ECU
-///
-/// Not all ECUs support the whole range of Mode 0x01 PIDs.  This
-/// function will parse the 3 PID which provide the full list of PIDS
-/// supported by this particular ECU.
+/// \brief Keep the value an ECU answered with
 ///
-/// \param[in] mode The modes we wish the list of supports for
-/// \param[out] pids A vector to receive the supported PIDs.
-/// \since 0.3.3
-void obdbase::obdSupportedPids(int mode, std::vector<int>& pids)
+/// \param[in] ecu The ECU, -1 for answers without headers
+/// \param[in] pid The pid
+/// \param[in] info The value, converted to imperial if in use
+/// \since 0.5.2
+void obdbase::obdStoreEcuValue(int ecu, int pid, const obdbase::pidInfo& info)
 {
-    std::vector<int> retVal;
-    int start = 0x100 * mode;
-    bool stopCondition = false;
-
-    while (stopCondition == false) {
-
-        int toks[7];
-        unsigned int bitMask = 0x80000000;
-        unsigned int indicator;
+    wxMutexLocker lock(ecuLock);
+    ecuValues[ecu][pid] = info;
+}
 
-        if (this->obd_pid_get_raw(start, toks, sizeof(toks))) {
+/// \brief Get the last value an ECU answered for a PID
+///
+/// \param[in] pid The pid
+/// \param[in] ecu The ECU as returned by obd_ecus()
+/// \param[out] result Receives the value
+/// \return False if the ECU didn't answer for the pid yet
+/// \since 0.5.2
+bool obdbase::obd_pid_ecu_value(int pid, int ecu, obdbase::pidInfo* result)
+{
+    wxMutexLocker lock(ecuLock);
+    std::map<int, std::map<int, obdbase::pidInfo> >::iterator it = ecuValues.find(ecu);
 
-            unsigned int pidEncoded = (toks[2] * pow(256, 3)) + (toks[3] * pow(256, 2)) + (toks[4] * 256) + toks[5];
+    if (it == ecuValues.end() || it->second.find(pid) == it->second.end()) {
+        return false;
+    }
+    *result = it->second[pid];
+    return true;
+}
 
-            for (int i = start; i <= start + 0x20; i++) {
-                // apply the bit mask
-                indicator = pidEncoded & bitMask;
-                // result will be == 0, or > 0
-                if (indicator > 0) {
-                    retVal.push_back(start + i);
-                }
-                // get the bitmask ready for the next loop
-                bitMask = bitMask / 2;
+/// \brief The ECUs which answered so far
+///
+/// \return CAN ids or source addresses, ascending; -1 stands for the
+/// answers received with headers off
+/// \since 0.5.2
+std::vector<int> obdbase::obd_ecus ()
+{
+    std::vector<int> ecus;
+
+    {
+        wxMutexLocker lock(supportedLock);
+        std::map<int, std::map<int, obdPidMap> >::iterator mode;
+        for (mode = supported.begin(); mode != supported.end(); mode++) {
+            std::map<int, obdPidMap>::iterator it;
+            for (it = mode->second.begin(); it != mode->second.end(); it++) {
+                ecus.push_back(it->first);
             }
         }
-
-        // do we have a stop condition
-        start += 0x20;
-        if (!retVal.empty() && retVal.back() == start) {
-            retVal.pop_back();
-        } else {
-            stopCondition = true;
+    }
+    {
+        wxMutexLocker lock(ecuLock);
+        std::map<int, std::map<int, obdbase::pidInfo> >::iterator it;
+        for (it = ecuValues.begin(); it != ecuValues.end(); it++) {
+            ecus.push_back(it->first);
         }
     }
 
-    // copy the retrieved list into the class variable
-    pids.swap(retVal);
-
-}   // obd_pid_supported_pids()
+    std::sort(ecus.begin(), ecus.end());
+    ecus.erase(std::unique(ecus.begin(), ecus.end()), ecus.end());
+    return ecus;
+}
 
-/// \brief Determine if the serial port is open
+/// \brief Get the PIDs of a mode one ECU supports
 ///
+/// \param[in] mode The mode, e.g. 0x01
+/// \param[in] ecu The ECU as returned by obd_ecus()
+/// \param[out] map Receives the supported pids
+/// \return False if the mode wasn't asked for or the ECU didn't answer
+/// \since 0.5.2
+bool obdbase::obd_supported_map(int mode, int ecu, obdPidMap& map)
+{
+    wxMutexLocker lock(supportedLock);
+    std::map<int, std::map<int, obdPidMap> >::iterator it = supported.find(mode);
+
+    if (it == supported.end() || it->second.find(ecu) == it->second.end()) {
+        return false;
+    }
+    map = it->second[ecu];
+    return true;
+}
+
+/// \brief Show the headers of the answers, to tell the ECUs apart
 ///
+/// The base class doesn't know how to turn them on.
 ///
-/// \return True if the serial port is open
-bool obdbase::obd_is_connected ()
+/// \param[in] use True to show the headers
+/// \return True if the device now shows them as asked
+/// \since 0.5.2
+bool obdbase::obd_use_headers (bool use)
 {
-    bool retval;
+    return !use;
+}
 
-    if (port->IsOpen() == 1) {
-        retval = true;
-    } else {
-        retval = false;
+/// \brief Forget what was learnt about the ECUs
+///
+/// Called when the headers are turned on or off, as the answers are
+/// then told apart differently.
+/// \since 0.5.2
+void obdbase::obdForgetEcus ()
+{
+    {
+        wxMutexLocker lock(supportedLock);
+        supported.clear();
     }
-
-    return retval;
+    wxMutexLocker lock(ecuLock);
+    ecuValues.clear();
 }
 
-/// \brief Convert the results to imperial
+/// \brief Get the values of several PIDs
 ///
-/// \param[in] pid The pid we are currently working with
-/// \param[in,out] result The result in metric, returned in imperial
-/// \since 0.5.1
-void obdbase::convertToImperial(int pid, obdbase::pidInfo* result)
+/// The base class simply asks for one PID after the other.  Devices
+/// which can request several PIDs at once override this.
+///
+/// \param[in] pids The pids you wish to enquire
+/// \param[out] results Receives the calculated value of each pid
+/// \param[out] retrieved True for each pid with a valid result
+/// \since 0.5.2
+void obdbase::obd_pid_values(const std::vector<int>& pids,
+                             std::vector<obdbase::pidInfo>& results,
+                             std::vector<bool>& retrieved)
 {
-    switch (pid) {
-        case PID_ECT:
-        case PID_IAT:
-        case PID_CATEMP11:
-        case PID_CATEMP12:
-        case PID_CATEMP21:
-        case PID_CATEMP22:
-        case PID_AAT:
-            result->resultMain = this->convert_c_to_f(result->resultMain);
+    results.resize(pids.size());
+    retrieved.resize(pids.size());
+
+    for (size_t i = 0; i < pids.size(); i++) {
+        retrieved[i] = this->obd_pid_value(pids[i], &results[i]);
+    }
+}   // obd_pid_values()
+
+/// \brief Calculate the value of a PID from the response bytes
+///
+/// Looks the pid up in the registry and applies the formula of its
+/// descriptor; only the pids with a text value need code of their own.
+///
+/// \param[in] pid The pid the response belongs to
+/// \param[in] tokens The response, starting with the mode and pid
+/// bytes (e.g. 41 0C 1A F8)
+/// \param[out] result Pointer to receive the calculated value
+/// \return True if the pid is supported by this function
+/// \since 0.5.2
+bool obdbase::obd_pid_decode(int pid, int tokens[], obdbase::pidInfo* result)
+{
+    const pidDescriptor* descriptor = obdPidRegistry::get().find(pid);
+    bool retVal = true;
+
+    // set sensible defaults
+    result->pid_flag = PID_FLAG_SINGLE;
+    result->resultMain = 0;
+    result->resultSecondary = 0;
+    result->resultString.Empty();
+
+    if (!descriptor) {
+        return false;
+    }
+
+    switch (descriptor->kind) {
+        case PID_KIND_DOUBLE:
+            result->resultSecondary = obd_pid_field(descriptor->secondary, tokens + 2);
+            result->pid_flag = PID_FLAG_DOUBLE;
+            // fall through
+        case PID_KIND_VALUE:
+            result->resultMain = obd_pid_field(descriptor->main, tokens + 2);
             break;
-        case PID_VSS:
-        case PID_CLR_DIST:
-        case PID_MIL_DIST:
-            result->resultMain = this->convert_kph_to_mph(result->resultMain);
+        case PID_KIND_STRING:
+            retVal = this->obd_pid_text(pid, tokens, result);
             break;
-        case PID_FRP:
-        case PID_FRP_ATMO:
-        case PID_FRP_REL:
-        case PID_FRP_ABS:
-            result->resultMain =  this->convert_kpa_to_psi(result->resultMain);
+        default:
+            // bail out if the bytes have no value
+            retVal = false;
+    }
+
+    return retVal;
+}   // obd_pid_decode()
+
+/// \brief Decode the PIDs with a text value
+///
+/// \param[in] pid The pid the response belongs to
+/// \param[in] tokens The response, starting with the mode and pid
+/// \param[out] result Pointer to receive the text
+/// \return True if the pid is supported by this function
+/// \since 0.5.2
+bool obdbase::obd_pid_text(int pid, int tokens[], obdbase::pidInfo* result)
+{
+    result->pid_flag = PID_FLAG_STRING;
+
+    switch (pid) {
+        case PID_AIR_STAT:
+            result->resultString = obd_pid_air_stat(tokens[2]);
             break;
-        case PID_EVAP_VP:
-            result->resultMain = this->convert_pa_to_inh20(result->resultMain);
+        case PID_O2SLOC:
+            //TODO: Support PID_O2SLOC
+            result->resultString = _("Not yet supported");
             break;
-        case PID_MAP:
-            result->resultMain = this->convert_pa_to_inhg(result->resultMain);
+        case PID_OBDSUP:
+            result->resultString = this->obd_pid_obd_supported(tokens[2]);
             break;
-        case PID_BARO:
-            result->resultMain = this->convert_kpa_to_inhg(result->resultMain);
+        case PID_PTO_STAT:
+            if (tokens[2] == 0x80) {
+                result->resultString = _T("ON");
+            } else {
+                result->resultString = _T("OFF");
+            }
             break;
-        case PID_MAF:
-            result->resultMain = this->convert_gs_to_lbmin(result->resultMain);
+        case PID_FUEL_TYP:
+            result->resultString = obd_pid_fuel_type(tokens[2]);
             break;
-        case PID_EVAP_VPA:
-            result->resultMain = this->convert_kpa_to_inh20(result->resultMain);
+        case PID_VIN:
+            result->resultString = obd_pid_vin(tokens);
             break;
+        default:
+            result->pid_flag = PID_FLAG_SINGLE;
+            return false;
     }
-}
 
-/// \brief Convert temperature from centigrade to farenheit
+    return true;
+}   // obd_pid_text()
+
+/// \brief The number of data bytes returned for a PID
+///
+/// Needed to split a response to a request for several PIDs.
 ///
-/// \param[in] centigrade Temperature in degrees centigrade.
-/// \return Temperature in degrees farenheit.
-int obdbase::convert_c_to_f (int centigrade)
+/// \param[in] pid The pid, including the mode (e.g. 0x010C)
+/// \return The number of data bytes, 0 if not known
+/// \since 0.5.2
+int obdbase::obd_pid_length(int pid)
 {
-	return (9 / 5) * centigrade + 32;
+    const pidDescriptor* descriptor = obdPidRegistry::get().find(pid);
+
+    return descriptor ? descriptor->bytes : 0;
 }
 
-/// \brief Convert pressure from kPa to PSI.
+/// \brief Get the PIDS/OBDMIDS supported by the ECU
 ///
-/// \param[in] kpa Pressure in kPa
-/// \return Pressure in PSI
-/// \since 0.5.1
-double obdbase::convert_kpa_to_psi(double kpa)
+/// Not all ECUs support the whole range of Mode 0x01 PIDs.  The
+/// first call for a mode asks every ECU for the supported pids, or
+/// looks them up in the database if the vehicle is known; later calls
+/// return what was found then.
+///
+/// \param[in] mode The modes we wish the list of supports for
+/// \param[out] pids Receives the pids supported by any ECU, without
+/// the supported pids pids themselves (0x0100, 0x0120 ...)
+/// \since 0.3.3
+void obdbase::obdSupportedPids(int mode, std::vector<int>& pids)
 {
-    return kpa * 0.1450377;
-}
+    std::vector<int> retVal;
+    wxMutexLocker lock(supportedLock);
+
+    if (supported.find(mode) == supported.end() && !this->obdLoadSupported(mode)) {
+        if (this->obdDiscoverSupported(mode)) {
+            this->obdSaveSupported(mode);
+        }
+    }
+
+    std::map<int, std::map<int, obdPidMap> >::iterator it = supported.find(mode);
+    if (it != supported.end()) {
+        for (int pid = 0x01; pid <= 0xFF; pid++) {
+            if ((pid & 0x1F) == 0) {
+                continue;
+            }
+            std::map<int, obdPidMap>::iterator ecu;
+            for (ecu = it->second.begin(); ecu != it->second.end(); ecu++) {
+                if (ecu->second.test(pid)) {
+                    retVal.push_back((mode << 8) | pid);
+                    break;
+                }
+            }
+        }
+    }
 
-/// \brief Convert kilometres to miles
+    // copy the retrieved list into the class variable
+    pids.swap(retVal);
+
+}   // obd_pid_supported_pids()
+
+/// \brief Whether any ECU supports a PID
+///
+/// Only knows the modes obdSupportedPids() was called for.
 ///
-/// \param[in] kilometres Distance or speed in kilometres.
-/// \return distance or speed in miles.
-int obdbase::convert_kph_to_mph (int kph)
+/// \param[in] pid The pid, including the mode (e.g. 0x010C)
+/// \return False if no ECU supports it or the mode wasn't asked for
+/// \since 0.5.2
+bool obdbase::obd_pid_supported(int pid)
 {
-	return kph / 1.60934400061;
+    wxMutexLocker lock(supportedLock);
+    std::map<int, std::map<int, obdPidMap> >::iterator it = supported.find(pid >> 8);
+
+    if (it != supported.end()) {
+        std::map<int, obdPidMap>::iterator ecu;
+        for (ecu = it->second.begin(); ecu != it->second.end(); ecu++) {
+            if (ecu->second.test(pid & 0xFF)) {
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
-/// \brief Convert Pa to in H20
+/// \brief Ask the ECUs which PIDs of a mode they support
 ///
-/// \param[in] pa Pressure in Pa
-/// \return Pressure in inches of H20
-/// \since 0.5.1
-double obdbase::convert_pa_to_inh20(double pa)
+/// Each of the pids 0x00, 0x20 ... 0xE0 says which of the following
+/// 32 are supported, the last one of them whether to go on.  Every
+/// ECU answering gets a map of its own.
+///
+/// \param[in] mode The mode, e.g. 0x01
+/// \return True if any ECU answered
+/// \since 0.5.2
+bool obdbase::obdDiscoverSupported(int mode)
 {
-    return pa * 0.0040146309;
+    std::map<int, obdPidMap> found;
+    obdParser parser;
+
+    for (int base = 0x00; base <= 0xE0; base += 0x20) {
+        bool more = false;
+
+        if (!this->obdRequest((mode << 8) | base, parser)) {
+            break;
+        }
+
+        for (int m = parser.find(0x40 + mode, base); m >= 0; m = parser.find(0x40 + mode, base, m + 1)) {
+            const unsigned char* bytes = parser.data(m);
+            if (!parser.complete(m) || parser.get(m).length < 6) {
+                continue;
+            }
+
+            unsigned long mask = ((unsigned long)bytes[2] << 24) | (bytes[3] << 16) | (bytes[4] << 8) | bytes[5];
+            found[parser.get(m).ecu].set_range(base, mask);
+            if (mask & 1) {
+                more = true;
+            }
+        }
+
+        if (!more) {
+            break;
+        }
+    }
+
+    if (found.empty()) {
+        return false;
+    }
+    supported[mode].swap(found);
+    return true;
 }
 
-/// \brief Convert g/s to lb/s
+/// \brief Look the supported PIDs of a mode up by VIN
 ///
-/// \param[in] gs Mass air flow rate in grammes per second
-/// \return Mass air flow rate in pounds per second
-/// \since 0.5.1
-double obdbase::convert_gs_to_lbs(double gs)
+/// \param[in] mode The mode, e.g. 0x01
+/// \return True if the vehicle and mode are in the database
+/// \since 0.5.2
+bool obdbase::obdLoadSupported(int mode)
 {
-    return gs * 0.0022046;
+    const char* sql = "SELECT ecu, bitmap FROM supported_pids WHERE vin = ?1 AND mode = ?2";
+    std::map<int, obdPidMap> found;
+    sqlite3_stmt* stmt;
+
+    if (!db || this->obd_vin().IsEmpty()) {
+        return false;
+    }
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        // no vehicle saved yet
+        return false;
+    }
+
+    wxCharBuffer key = vin.mb_str(wxConvUTF8);
+    sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, mode);
+    // the ECUs are only told apart with headers on
+    bool headers = this->obdHeaderFormat() != obdParser::HEADERS_NONE;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        obdPidMap map;
+        int ecu = sqlite3_column_int(stmt, 0);
+        if ((ecu >= 0) == headers && map.from_hex((const char*)sqlite3_column_text(stmt, 1))) {
+            found[ecu] = map;
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    if (found.empty()) {
+        return false;
+    }
+    supported[mode].swap(found);
+
+    if (logger) {
+        wxString msg;
+        msg.Printf(_("Supported PIDs of mode %02x for %s from the database\n"), mode, vin.c_str());
+        logger->appendLog(msg, logPanel::LOG_OTHER);
+    }
+    return true;
 }
 
-/// \brief Convert Pa to in Hg
+/// \brief Keep the supported PIDs of a mode for the next connection
 ///
-/// \param pa Pressure in Pascals
-/// \return Pressure in inches of Mercury
-/// \since 0.5.1
-double obdbase::convert_pa_to_inhg(double pa)
+/// \param[in] mode The mode, e.g. 0x01
+/// \since 0.5.2
+void obdbase::obdSaveSupported(int mode)
 {
-    // TODO: Get conversion formula pa->inHG
-    return pa;
+    const char* create = "CREATE TABLE IF NOT EXISTS supported_pids ("
+                         "vin TEXT NOT NULL, ecu INTEGER NOT NULL, mode INTEGER NOT NULL, "
+                         "bitmap TEXT NOT NULL, PRIMARY KEY (vin, ecu, mode))";
+    const char* sql = "INSERT OR REPLACE INTO supported_pids VALUES (?1, ?2, ?3, ?4)";
+    sqlite3_stmt* stmt;
+
+    if (!db || this->obd_vin().IsEmpty()) {
+        return;
+    }
+    if (sqlite3_exec(db, create, NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return;
+    }
+
+    wxCharBuffer key = vin.mb_str(wxConvUTF8);
+    std::map<int, obdPidMap>& maps = supported[mode];
+    for (std::map<int, obdPidMap>::iterator it = maps.begin(); it != maps.end(); it++) {
+        std::string bitmap = it->second.to_hex();
+        sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, it->first);
+        sqlite3_bind_int(stmt, 3, mode);
+        sqlite3_bind_text(stmt, 4, bitmap.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
 }
 
-/// \brief Convert grammes per second to pounds per minute
+/// \brief Get the Vehicle Identification Number
 ///
-/// \param[in] gs Air flow rate in grammes per second
-/// \return Air flow rate in pounds per minute
-/// \since 0.5.1
-double obdbase::convert_gs_to_lbmin(double gs)
+/// Asked for once per connection.
+///
+/// \return The VIN, empty if the vehicle doesn't report one
+/// \since 0.5.2
+wxString obdbase::obd_vin ()
 {
-    return this->convert_gs_to_lbs(gs) * 60;
+    wxMutexLocker lock(supportedLock);
+
+    if (vin.IsEmpty()) {
+        obdbase::pidInfo result;
+        if (this->obd_pid_value(PID_VIN, &result) && result.resultString.length() == 17) {
+            vin = result.resultString;
+        }
+    }
+    return vin;
 }
 
-/// \brief Convert kPa to inHg
+/// \brief Determine if the serial port is open
 ///
-/// \param[in] kpa Pressure in kPa
-/// \return Pressure in inHg
-/// \since 0.5.1
-double obdbase::convert_kpa_to_inhg(double kpa)
+///
+///
+/// \return True if the serial port is open
+bool obdbase::obd_is_connected ()
 {
-    return this->convert_pa_to_inhg(kpa * 1000);
+    bool retval;
+
+    if (port->IsOpen() == 1) {
+        retval = true;
+    } else {
+        retval = false;
+    }
+
+    return retval;
 }
 
-/// \brief Convert kPa to in H20
+/// \brief Convert the results to imperial
 ///
-/// \param kpa Pressure in kPa
-/// \return Pressure in in H20
+/// \param[in] pid The pid we are currently working with
+/// \param[in,out] result The result in metric, returned in imperial
 /// \since 0.5.1
-double obdbase::convert_kpa_to_inh20(double kpa)
+void obdbase::convertToImperial(int pid, obdbase::pidInfo* result)
 {
-    return this->convert_pa_to_inh20(kpa * 1000);
+    const pidDescriptor* descriptor = obdPidRegistry::get().find(pid);
+
+    if (descriptor && result->pid_flag != PID_FLAG_STRING) {
+        result->resultMain = result->resultMain * descriptor->imperialScale
+                             + descriptor->imperialOffset;
+    }
 }
 
 /// \brief Decodes the Commanded Secondary Air Status.
@@ -943,16 +1462,24 @@ wxString obdbase::obd_pid_fuel_type(int encByte)
 
 /// \brief Decodes PID_VIN
 ///
-/// \param[in] tokens An array of bytes returned by the ECU.
+/// On CAN the answer is 49 02 01 and the 17 characters, the older
+/// protocols send five lines 49 02 nn and four bytes each, the first
+/// one padded with zeros.
+///
+/// \param[in] tokens An array of OBD_RAW_TOKENS bytes returned by the ECU.
 /// \return A string representation of the VIN.
 /// \since 0.5.1
-/// \todo The CAN standard is different and currently not supported.
 wxString obdbase::obd_pid_vin(int tokens[])
 {
     wxString retVal;
 
-    for (int i = 6; i < 35; i++) {
-        retVal.Append(tokens[i]);
+    for (int i = 0; i < OBD_RAW_TOKENS && retVal.length() < 17; i++) {
+        // the VIN never has an I (0x49), so this is the start of a line
+        if (tokens[i] == 0x49 && i + 1 < OBD_RAW_TOKENS && tokens[i + 1] == 0x02) {
+            i += 2;
+        } else if (isalnum(tokens[i])) {
+            retVal.Append((wxChar)tokens[i]);
+        }
     }
 
     return retVal;
@@ -31,10 +31,15 @@
 
 #include <vector>
 #include "pidPanel.h"
+#include "obdScheduler.h"
+
+#define PID_DRAIN_MS    100     ///< how often the list shows new values
 
 pidPanel::pidPanel( wxWindow* parent, obdbase* device, sqlite3* sql  )
 :
-pidBasePanel( parent )
+pidBasePanel( parent ),
+drainTimer( this ),
+polling( false )
 {
     // get the parameters passed in constructor
     obd = device;
@@ -45,93 +50,152 @@ pidBasePanel( parent )
 	pidList->InsertColumn(1, _("Description"), wxLIST_FORMAT_LEFT, -1);
 	pidList->InsertColumn(2, _("Value"), wxLIST_FORMAT_LEFT, -1);
 	pidList->InsertColumn(3, _("Units"), wxLIST_FORMAT_LEFT, -1);
+
+	this->Connect(wxEVT_TIMER, wxTimerEventHandler(pidPanel::onDrainTimer));
+}
+
+pidPanel::~pidPanel()
+{
+    drainTimer.Stop();
+    obd->obd_stop_polling();
 }
 
+/// \brief Start polling the supported PIDs
+///
+/// The supported PIDs are looked up and polled in the background, the
+/// list is filled as the values arrive.
 void pidPanel::onRefreshClick( wxCommandEvent& WXUNUSED(event) )
 {
-    obdbase::pidInfo result;
-    std::vector<int> pids;
-    vector<int>::iterator it;
+	if (!obd->obd_is_connected()) {
+	    wxString msg(_("You are not connected to an ELM device.\n"
+            "Please connect first"));
+        wxMessageDialog dialog(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
+        dialog.ShowModal();
+	} else {
+	    polling = true;
+	    this->startPolling();
+	}
+}   // onRefreshClick()
+
+/// \brief Clear the list and poll the supported PIDs of the device
+void pidPanel::startPolling()
+{
+    pidList->DeleteAllItems();
+    rows.clear();
+
+    obdScheduler* scheduler = obd->obd_scheduler();
+    scheduler->discover(0x01);
+    scheduler->start();
+    drainTimer.Start(PID_DRAIN_MS);
+}
+
+/// \brief Show the values polled since the last call
+void pidPanel::onDrainTimer( wxTimerEvent& WXUNUSED(event) )
+{
+    obdScheduler::sample result;
+    obdScheduler* scheduler = obd->obd_scheduler();
+    wxString resultString;
+
+    while (scheduler->pop(result)) {
+        // only show the pids with a value
+        if (!result.valid) {
+            continue;
+        }
+
+        std::map<int, long>::iterator it = rows.find(result.pid);
+        long itemIndex = (it != rows.end()) ? it->second : this->addRow(result.pid);
+
+        // update the results column
+        switch (result.pid_flag) {
+            case obdbase::PID_FLAG_SINGLE:
+                resultString.Printf(_T("%f\n"), result.resultMain);
+                break;
+            case obdbase::PID_FLAG_DOUBLE:
+                resultString.Printf(_T("%f / %f\n"), result.resultMain, result.resultSecondary);
+                break;
+            case obdbase::PID_FLAG_STRING:
+                resultString = wxString::FromUTF8(result.resultString);
+                break;
+        }
+        pidList->SetItem(itemIndex, 2, resultString);
+    }
+
+    if (!scheduler->is_running()) {
+        drainTimer.Stop();
+    }
+}
+
+/// \brief Add a list entry for a PID
+///
+/// \param[in] pid The pid
+/// \return The index of the new entry
+long pidPanel::addRow(int pid)
+{
     long itemIndex;
     wxString pidString;
-    wxString resultString;
     wxString descString;
     wxString unitString;
     wxString sql(_T("SELECT * FROM pids WHERE pid = ?1"));
 	sqlite3_stmt *stmt;
 	char buf[100];
-	bool imperial;
-
-	if (!obd->obd_is_connected()) {
-	    wxString msg(_("You are not connected to an ELM device.\n"
-            "Please connect first"));
-        wxMessageDialog dialog(NULL, msg, _("Error"), wxOK | wxICON_ERROR);
-        dialog.ShowModal();
-	} else {
-	    obd->obdSupportedPids(0x01, pids);
-	    pidList->DeleteAllItems();
-	    imperial = obd->obd_is_imperial();
-
-	     // prepare the statement for the db
-        if (sqlite3_prepare_v2(db, sql.mb_str(), -1, &stmt, NULL) == SQLITE_OK)
-        {
-            // parse each pid in turn
-            for (it = pids.begin(); it < pids.end(); it++) {
-                // get the value of the pid
-                if (obd->obd_pid_value(*it, &result)) {
-
-                    pidString.Printf(_T("%#.4x"), *it);
-                    itemIndex = pidList->InsertItem(0, pidString);
-
-                    // get the results from the db
-                    // bind the pid to the statement
-                    strcpy( buf, (const char*)pidString.mb_str(wxConvUTF8) );
-                    int sqlResult = sqlite3_bind_text(stmt, 1, buf, -1, SQLITE_STATIC);
-
-                    // the statement should only have one step
-                    while (sqlite3_step(stmt) == SQLITE_ROW) {
-                        // insert the code and description into the list control
-                        descString = wxString::FromUTF8((const char *)sqlite3_column_text(stmt, 1));
-                        pidList->SetItem(itemIndex, 1, descString);
-
-                        if (imperial) {
-                            unitString = wxString::FromUTF8((const char *)sqlite3_column_text(stmt, 3));
-                        } else {
-                            unitString = wxString::FromUTF8((const char *)sqlite3_column_text(stmt, 2));
-                        }
-                        pidList->SetItem(itemIndex, 3, unitString);
-
-                    }
-
-                    // update the results column
-                    switch (result.pid_flag) {
-                        case obdbase::PID_FLAG_SINGLE:
-                            resultString.Printf(_T("%f\n"), result.resultMain);
-                            break;
-                        case obdbase::PID_FLAG_DOUBLE:
-                            resultString.Printf(_T("%f / %f\n"), result.resultMain, result.resultSecondary);
-                            break;
-                        case obdbase::PID_FLAG_STRING:
-                            resultString = result.resultString;
-                            break;
-                    }
-                    pidList->SetItem(itemIndex, 2, resultString);
-
-                    // reset the sql
-                    sqlite3_reset(stmt);
-
-                    // new result added so update the GUI
-                    this->Update();
+	bool imperial = obd->obd_is_imperial();
+
+    pidString.Printf(_T("%#.4x"), pid);
+    itemIndex = pidList->InsertItem(pidList->GetItemCount(), pidString);
+    rows[pid] = itemIndex;
+
+    // the units the values are decoded to
+    const pidDescriptor* descriptor = obdPidRegistry::get().find(pid);
+    if (descriptor) {
+        unitString = wxString::FromUTF8(imperial ? descriptor->unitsImperial : descriptor->units);
+        pidList->SetItem(itemIndex, 3, unitString);
+    }
+
+    // get the description and units from the db
+    if (sqlite3_prepare_v2(db, sql.mb_str(), -1, &stmt, NULL) == SQLITE_OK)
+    {
+        // bind the pid to the statement
+        strcpy( buf, (const char*)pidString.mb_str(wxConvUTF8) );
+        sqlite3_bind_text(stmt, 1, buf, -1, SQLITE_STATIC);
+
+        // the statement should only have one step
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            // insert the code and description into the list control
+            descString = wxString::FromUTF8((const char *)sqlite3_column_text(stmt, 1));
+            pidList->SetItem(itemIndex, 1, descString);
+
+            if (!descriptor) {
+                if (imperial) {
+                    unitString = wxString::FromUTF8((const char *)sqlite3_column_text(stmt, 3));
+                } else {
+                    unitString = wxString::FromUTF8((const char *)sqlite3_column_text(stmt, 2));
                 }
+                pidList->SetItem(itemIndex, 3, unitString);
             }
-
-            // don't need the stmt any more
-            sqlite3_finalize(stmt);
         }
-	}
-}   // onRefreshClick()
 
+        // don't need the stmt any more
+        sqlite3_finalize(stmt);
+    }
+
+    return itemIndex;
+}
+
+/// \brief Show the PIDs of another device
+///
+/// The old device stops polling. If the list was being polled, the new
+/// device is polled in its place.
+///
+/// \param[in] device The device, e.g. after a reconnect
 void pidPanel::updateDevice(obdbase* device)
 {
+    drainTimer.Stop();
+    if (obd != device) {
+        obd->obd_stop_polling();
+    }
     obd = device;
+
+    if (polling && obd->obd_is_connected()) {
+        this->startPolling();
+    }
 }